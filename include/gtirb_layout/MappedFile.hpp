@@ -0,0 +1,81 @@
+//===- MappedFile.hpp -------------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#ifndef GTIRB_LAYOUT_MAPPED_FILE_H
+#define GTIRB_LAYOUT_MAPPED_FILE_H
+
+#include "Export.hpp"
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <string>
+
+namespace gtirb_layout {
+
+/// A streambuf that reads directly from a block of memory, without copying
+/// it into a buffer of its own.
+class GTIRB_LAYOUT_EXPORT_API MemoryInputBuffer : public std::streambuf {
+public:
+  MemoryInputBuffer(const char* Data, size_t Size);
+
+protected:
+  std::streamsize showmanyc() override;
+  std::streamsize xsgetn(char* S, std::streamsize N) override;
+  pos_type seekoff(off_type Off, std::ios_base::seekdir Dir,
+                   std::ios_base::openmode Which) override;
+  pos_type seekpos(pos_type Pos, std::ios_base::openmode Which) override;
+};
+
+/// A read-only memory mapping of a whole file, advised for sequential
+/// access. Concurrent readers of the same file share its pages in the page
+/// cache, and reading through stream() does not copy the file into a stream
+/// buffer.
+class GTIRB_LAYOUT_EXPORT_API MappedFile {
+public:
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /// Map a file.
+  ///
+  /// \param Path  the file to map
+  ///
+  /// \return the mapping, or \c nullptr if the file could not be mapped, for
+  /// instance because it is a pipe or the platform does not support it.
+  static std::unique_ptr<MappedFile> open(const std::string& Path);
+
+  const char* data() const { return Data; }
+  size_t size() const { return Size; }
+
+  /// Drop the pages wholly inside a range of the mapping from memory, once
+  /// they will no longer be read. Reading them again maps them back in.
+  void discard(const char* Begin, size_t Length);
+
+  /// A stream reading the mapped file from the beginning.
+  std::istream& stream() { return Stream; }
+
+private:
+  MappedFile(const char* D, size_t S);
+
+  const char* Data;
+  size_t Size;
+  MemoryInputBuffer Buffer;
+  std::istream Stream;
+};
+
+} // namespace gtirb_layout
+
+#endif /* GTIRB_LAYOUT_MAPPED_FILE_H */
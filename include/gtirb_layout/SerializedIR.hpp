@@ -0,0 +1,70 @@
+//===- SerializedIR.hpp -----------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#ifndef GTIRB_LAYOUT_SERIALIZED_IR_H
+#define GTIRB_LAYOUT_SERIALIZED_IR_H
+
+#include "Export.hpp"
+#include <cstddef>
+#include <gtirb/gtirb.hpp>
+#include <optional>
+#include <vector>
+
+namespace gtirb_layout {
+
+/// An index of the modules of a serialized IR held in memory, such as a
+/// MappedFile. Building the index only scans the top level of the protobuf
+/// encoding, so modules can then be deserialized one at a time without
+/// parsing the others.
+class GTIRB_LAYOUT_EXPORT_API SerializedIR {
+public:
+  /// Index a serialized IR. The memory must outlive the index.
+  ///
+  /// \return the index, or \c std::nullopt if the memory does not hold a
+  /// well-formed serialized IR.
+  static std::optional<SerializedIR> index(const char* Data, size_t Size);
+
+  /// The number of modules in the IR.
+  size_t moduleCount() const { return Modules.size(); }
+
+  /// The serialized module at \p Index.
+  const char* moduleData(size_t Index) const { return Modules[Index].Data; }
+
+  /// The size in bytes of the serialized module at \p Index.
+  size_t moduleSize(size_t Index) const { return Modules[Index].Size; }
+
+  /// Deserialize an IR holding only the module at \p Index, along with the
+  /// IR's UUID, version and AuxData. The IR's CFG is not loaded, because its
+  /// edges refer to the blocks of every module.
+  ///
+  /// \return the IR, or \c nullptr if the module could not be deserialized.
+  gtirb::IR* loadModule(gtirb::Context& Ctx, size_t Index) const;
+
+private:
+  struct Span {
+    const char* Data;
+    size_t Size;
+  };
+
+  SerializedIR() = default;
+
+  /// The file header and the IR fields other than its modules and CFG.
+  std::vector<Span> Shared;
+  /// The complete encoded field of each module.
+  std::vector<Span> Modules;
+};
+
+} // namespace gtirb_layout
+
+#endif /* GTIRB_LAYOUT_SERIALIZED_IR_H */
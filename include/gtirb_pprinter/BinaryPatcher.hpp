@@ -0,0 +1,72 @@
+//===- BinaryPatcher.hpp ----------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#ifndef GTIRB_PP_BINARY_PATCHER_H
+#define GTIRB_PP_BINARY_PATCHER_H
+
+#include "Export.hpp"
+
+#include <gtirb/gtirb.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace gtirb_bprint {
+
+/// Builds the binary of a module by patching the binary it was built from,
+/// instead of printing, assembling and linking it, when the changes made to
+/// the module keep its layout.
+///
+/// The bytes of each section of the module replace those of the section of
+/// the same name in the original binary, which must be at the same address
+/// and of the same size, and the symbols of the binary, in its symbol table
+/// or in its dynamic one, must not have moved. The field of every symbolic
+/// expression is then recomputed from the addresses of its symbols, and a
+/// pointer that the loader relocates has the addend of its relative
+/// relocation updated instead.
+///
+/// Only x86 ELF binaries are patched. Changes that move sections or symbols,
+/// that add pointers to a position-independent binary, or that touch
+/// references whose value depends on a GOT or PLT entry require a full
+/// rebuild, which patch() reports.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API BinaryPatcher {
+public:
+  /// \param Original  the binary to patch, or empty for the binary path of
+  ///                  the module, relative to the current directory
+  explicit BinaryPatcher(const std::string& Original = std::string())
+      : Original(Original) {}
+
+  /// Write the binary of a module to \p Output by patching the original.
+  ///
+  /// \param Error  set to the reason on failure
+  ///
+  /// \return \c false if the module needs a full rebuild, or if a binary
+  /// could not be read or written. No output is left behind then.
+  bool patch(const gtirb::Module& Module, const std::string& Output,
+             std::string& Error);
+
+  /// The number of bytes, and of relocations, that the last patch changed.
+  uint64_t patchedBytes() const { return PatchedBytes; }
+  size_t patchedRelocations() const { return PatchedRelocations; }
+
+private:
+  std::string Original;
+  uint64_t PatchedBytes = 0;
+  size_t PatchedRelocations = 0;
+};
+
+} // namespace gtirb_bprint
+
+#endif /* GTIRB_PP_BINARY_PATCHER_H */
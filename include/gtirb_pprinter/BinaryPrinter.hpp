@@ -15,8 +15,17 @@
 #ifndef GTIRB_PP_BINARY_PRINTER_H
 #define GTIRB_PP_BINARY_PRINTER_H
 
+#include "Compression.hpp"
+#include "ObjectCache.hpp"
 #include "PrettyPrinter.hpp"
+#include "file_utils.hpp"
 #include <gtirb/gtirb.hpp>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -25,29 +34,151 @@ namespace gtirb_bprint {
 class TempFile;
 
 class DEBLOAT_PRETTYPRINTER_EXPORT_API BinaryPrinter {
+public:
+  /// A step of building a binary, and the time it took.
+  struct BuildStep {
+    std::string Name;
+    double Seconds;
+  };
+
+  /// A run of an external tool, and the resources it used.
+  struct ToolRun {
+    std::string Tool;
+    ProcessUsage Usage;
+  };
+
 protected:
   std::vector<std::string> ExtraCompileArgs;
   std::vector<std::string> LibraryPaths;
-  const gtirb_pprint::PrettyPrinter& Printer;
+  // A copy of the caller's printer, so that the emission profile can differ.
+  gtirb_pprint::PrettyPrinter Printer;
+  gtirb_pprint::Compression SourceCompression =
+      gtirb_pprint::Compression::None;
+  std::shared_ptr<ObjectCache> Cache;
+  unsigned Jobs = 0;
+  bool PipeSources = false;
+  bool DirectObjects = false;
+  std::vector<BuildStep> Steps;
+  // Tools run on the threads of setJobs, so their runs are recorded under a
+  // lock.
+  mutable std::mutex RunsMutex;
+  mutable std::vector<ToolRun> Runs;
+  // The objects written straight from the IR, on the threads of setJobs.
+  mutable std::atomic<size_t> DirectWrites{0};
+
+  // A rough estimate of the size of the assembly of a module, to decide
+  // whether its temporary file fits in memory.
+  static uint64_t estimateSourceSize(const gtirb::Module& mod);
 
   bool prepareSource(gtirb::Context& ctx, gtirb::Module& mod,
                      TempFile& tempFile) const;
 
+  // Print the module into tempFile compressed with SourceCompression.
+  bool prepareCompressedSource(gtirb::Context& ctx, gtirb::Module& mod,
+                               TempFile& tempFile) const;
+
   bool prepareSources(gtirb::Context& ctx, gtirb::IR& ir,
                       std::vector<TempFile>& tempFiles) const;
 
+  // Forget the steps and the tool runs of the previous link().
+  void startLink();
+
+  // Record that a step of link() named name ran from start until now.
+  void recordStep(const std::string& name,
+                  std::chrono::steady_clock::time_point start);
+
+  // Run tool as execute does, and record what it used, see toolRuns().
+  std::optional<int> executeTool(const std::string& tool,
+                                 const std::vector<std::string>& args) const;
+  std::optional<int>
+  executeTool(const std::string& tool, const std::vector<std::string>& args,
+              const std::function<bool(std::ostream&)>& writeInput) const;
+  std::optional<int>
+  executeTool(const std::string& tool, const std::vector<std::string>& args,
+              const std::vector<std::string>& fifos,
+              const std::function<bool(size_t, std::ostream&)>& writeInput)
+      const;
+
+  // Run tool to build output from inputs, or copy output from the object
+  // cache if the same build is stored in it. See ObjectCache::key.
+  std::optional<int> executeCached(const std::string& tool,
+                                   const std::vector<std::string>& args,
+                                   const std::vector<std::string>& inputs,
+                                   const std::string& output) const;
+
 public:
   BinaryPrinter(const gtirb_pprint::PrettyPrinter& prettyPrinter,
                 const std::vector<std::string>& extraCompileArgs,
                 const std::vector<std::string>& libraryPaths)
       : ExtraCompileArgs(extraCompileArgs), LibraryPaths(libraryPaths),
-        Printer(prettyPrinter) {}
+        Printer(prettyPrinter) {
+    // The assembly only feeds the assembler, unless it is being debugged.
+    if (!Printer.getDebug())
+      Printer.setEmissionProfile(gtirb_pprint::Machine);
+  }
 
   virtual ~BinaryPrinter() = default;
+
+  /// Keep the temporary assembly produced by \link assemble compressed, and
+  /// decompress it into the assembler's standard input. This trades CPU time
+  /// for temporary storage. Printers whose assembler cannot read its standard
+  /// input ignore this setting.
+  void setSourceCompression(gtirb_pprint::Compression Format) {
+    SourceCompression = Format;
+  }
+
+  /// Stream the assembly into the assembler while it is printed, instead of
+  /// printing it into a temporary file first, so that the assembler runs
+  /// alongside the printer. The outputs of such builds are not taken from,
+  /// or stored in, the object cache. Printers whose assembler cannot read a
+  /// pipe ignore this setting.
+  void setPipeSources(bool Pipe) { PipeSources = Pipe; }
+
+  /// Write the objects of modules straight from the IR, see
+  /// \link ElfObjectPrinter and \link CoffObjectPrinter, instead of printing
+  /// and assembling them, and link them. Modules that need extra compiler
+  /// arguments, or that the writer does not support, are still assembled.
+  /// Printers without such a writer ignore this setting.
+  void setDirectObjects(bool Direct) { DirectObjects = Direct; }
+
+  /// Reuse the objects and binaries of identical earlier builds from a
+  /// cache, and store the ones built in it. The cache may be shared with
+  /// other printers.
+  void setObjectCache(std::shared_ptr<ObjectCache> cache) {
+    Cache = std::move(cache);
+  }
+
+  /// Run up to \p jobs assemblers at once, or as many as the machine runs
+  /// threads at once if \p jobs is 0. Linking an IR with several modules
+  /// then prints and assembles its modules concurrently, unless \p jobs is 1.
+  void setJobs(unsigned jobs) { Jobs = jobs; }
+
+  /// Select the \link gtirb_pprint::EmissionProfile of the temporary
+  /// assembly. The machine profile is the default unless debugging messages
+  /// are enabled.
+  void setEmissionProfile(gtirb_pprint::EmissionProfile Profile) {
+    Printer.setEmissionProfile(Profile);
+  }
   virtual int assemble(const std::string& outputFilename,
                        gtirb::Context& context, gtirb::Module& mod) const = 0;
   virtual int link(const std::string& outputFilename, gtirb::Context& context,
                    gtirb::IR& ir) = 0;
+
+  /// The steps that the last call to \link link ran, in order, such as
+  /// printing the assembly, assembling it and linking the objects.
+  const std::vector<BuildStep>& buildSteps() const { return Steps; }
+
+  /// The external tools, such as the assembler and the linker, that ran
+  /// since the last call to \link link started, in the order they exited.
+  /// Outputs copied from the object cache run no tool.
+  std::vector<ToolRun> toolRuns() const {
+    std::lock_guard<std::mutex> lock(RunsMutex);
+    return Runs;
+  }
+
+  /// The number of objects written straight from the IR since construction,
+  /// see \link setDirectObjects.
+  size_t directWrites() const { return DirectWrites; }
 };
 } // namespace gtirb_bprint
 
@@ -0,0 +1,122 @@
+//===- BlockCache.hpp -------------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#ifndef GTIRB_PP_BLOCK_CACHE_H
+#define GTIRB_PP_BLOCK_CACHE_H
+
+#include "Export.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace gtirb_pprint {
+
+/// A 128-bit fingerprint of a sequence of values.
+struct Fingerprint {
+  uint64_t High = 0;
+  uint64_t Low = 0;
+
+  bool operator==(const Fingerprint& Other) const {
+    return High == Other.High && Low == Other.Low;
+  }
+};
+
+/// Computes a \link Fingerprint incrementally.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API FingerprintBuilder {
+public:
+  void add(const void* Data, size_t Size);
+  void add(uint64_t Value);
+  void add(const std::string& Value) {
+    add(Value.size());
+    add(Value.data(), Value.size());
+  }
+
+  Fingerprint get() const;
+
+private:
+  void addWord(uint64_t Word);
+
+  uint64_t H1 = 0x9e3779b97f4a7c15ULL;
+  uint64_t H2 = 0xc2b2ae3d27d4eb4fULL;
+  uint64_t Length = 0;
+};
+
+/// The assembly printed for blocks, keyed by a fingerprint of everything the
+/// printer reads to print each block: its bytes, the symbolic expressions,
+/// symbols, alignment, CFI directives and comments in it, the names of the
+/// symbols it refers to, and the printer's target and policy. A printer
+/// given a cache with \link PrettyPrinter::setBlockCache prints only the
+/// blocks whose fingerprint is not in the cache and copies the text of the
+/// others.
+///
+/// Printers on several threads may share a cache, but loading, saving and
+/// clearing it must not overlap with printing.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API BlockCache {
+public:
+  struct Entry {
+    std::string Text;
+    /// Whether a \c .cfi_startproc without its \c .cfi_endproc had been
+    /// printed at the end of the block.
+    bool InProcedure = false;
+    /// Whether printing the block moved the program counter to its end.
+    bool AdvancesPC = true;
+    bool Used = false;
+  };
+
+  /// The entry for a fingerprint, or \c nullptr if there is none. An entry
+  /// does not change once inserted.
+  const Entry* find(const Fingerprint& Key);
+
+  void insert(const Fingerprint& Key, std::string Text, bool InProcedure,
+              bool AdvancesPC);
+
+  size_t size() const { return Entries.size(); }
+  void clear() { Entries.clear(); }
+
+  /// The number of lookups that found an entry and that did not.
+  size_t hits() const { return Hits; }
+  size_t misses() const { return Misses; }
+
+  /// Add the entries stored in a file by save().
+  ///
+  /// \return \c false if the file could not be read or is not a cache file.
+  bool load(const std::string& Path);
+
+  /// Store the entries that were found or inserted since the cache was
+  /// created or loaded, so that the file does not keep blocks that are no
+  /// longer printed.
+  ///
+  /// \return \c false if the file could not be written.
+  bool save(const std::string& Path) const;
+
+private:
+  struct Hash {
+    size_t operator()(const Fingerprint& F) const {
+      return static_cast<size_t>(F.Low);
+    }
+  };
+
+  std::unordered_map<Fingerprint, Entry, Hash> Entries;
+  std::mutex Mutex;
+  std::atomic<size_t> Hits{0};
+  std::atomic<size_t> Misses{0};
+};
+
+} // namespace gtirb_pprint
+
+#endif /* GTIRB_PP_BLOCK_CACHE_H */
@@ -0,0 +1,70 @@
+//===- CoffObjectPrinter.hpp ------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#ifndef GTIRB_PP_COFF_OBJECT_PRINTER_H
+#define GTIRB_PP_COFF_OBJECT_PRINTER_H
+
+#include "Export.hpp"
+#include "PrettyPrinter.hpp"
+
+#include <gtirb/gtirb.hpp>
+
+#include <string>
+
+namespace gtirb_bprint {
+
+/// Writes a COFF object straight from a module, without printing its
+/// assembly and running ml64 on it.
+///
+/// The object holds what ml64 would make of the module's MASM assembly: the
+/// sections laid out by ObjectLayout, with their \c peSectionProperties, a
+/// relocation for each symbolic expression, the exported symbols and the
+/// entry point as external symbols, and a \c .drectve section naming the
+/// import libraries of the module's \c libraries and the exported functions.
+/// References to forwarded symbols are to the imports they are forwarded
+/// to, through \c __imp_ for the memory operands of instructions that do
+/// not refer to code, as the MASM printer prints them. Differences from
+/// \c __ImageBase are image-relative relocations.
+///
+/// Only x86-64 modules are supported, and references relative to the
+/// program counter must be 4 bytes, or resolved within their section;
+/// write() fails otherwise, so that the caller can assemble the module
+/// instead.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API CoffObjectPrinter {
+public:
+  /// \param Printer  the printer whose policy selects what is written
+  explicit CoffObjectPrinter(const gtirb_pprint::PrettyPrinter& Printer)
+      : Printer(Printer) {}
+
+  /// Whether write() supports a module.
+  static bool supports(const gtirb::Module& Module);
+
+  /// Write the object of a module. As the MASM printer does, this names the
+  /// entry point \c __EntryPoint in the module if it has no symbol.
+  ///
+  /// \param Output  the object file to write
+  /// \param Error   set to the reason on failure
+  ///
+  /// \return \c false if the module uses what the writer does not support,
+  /// or if the object could not be written. No object is left behind then.
+  bool write(gtirb::Context& Context, gtirb::Module& Module,
+             const std::string& Output, std::string& Error) const;
+
+private:
+  const gtirb_pprint::PrettyPrinter& Printer;
+};
+
+} // namespace gtirb_bprint
+
+#endif /* GTIRB_PP_COFF_OBJECT_PRINTER_H */
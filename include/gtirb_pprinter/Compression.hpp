@@ -0,0 +1,103 @@
+//===- Compression.hpp ------------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#ifndef GTIRB_PP_COMPRESSION_H
+#define GTIRB_PP_COMPRESSION_H
+
+#include "Export.hpp"
+#include "OutputBuffer.hpp"
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace gtirb_pprint {
+
+/// Compression formats for assembly output.
+enum class Compression { None, Gzip, Zstd };
+
+/// The compression format implied by the extension of \p Path: \c .gz for
+/// gzip and \c .zst for zstd.
+DEBLOAT_PRETTYPRINTER_EXPORT_API Compression
+compressionForPath(const std::string& Path);
+
+/// The file extension, including the leading dot, for a compression format.
+DEBLOAT_PRETTYPRINTER_EXPORT_API std::string
+compressionExtension(Compression Format);
+
+/// Whether this build of the library can read and write \p Format.
+DEBLOAT_PRETTYPRINTER_EXPORT_API bool
+isCompressionSupported(Compression Format);
+
+/// The best compression format this build supports, or
+/// \c Compression::None.
+DEBLOAT_PRETTYPRINTER_EXPORT_API Compression preferredCompression();
+
+/// An OutputBuffer that compresses its content as it is drained and writes
+/// the compressed stream to a file, so that the uncompressed text is never
+/// stored. zstd output is compressed by several worker threads when the zstd
+/// library supports it.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API CompressedOutputBuffer
+    : public OutputBuffer {
+public:
+  ~CompressedOutputBuffer() override;
+
+  /// Create (or truncate) a file and open it for compressed writing.
+  ///
+  /// \param Path      the file to write
+  /// \param Format    the compression format; must not be Compression::None
+  /// \param Capacity  the size of the buffer of uncompressed text
+  ///
+  /// \return the buffer, or \c nullptr if the file could not be opened or the
+  /// format is not supported.
+  static std::unique_ptr<CompressedOutputBuffer>
+  open(const std::string& Path, Compression Format,
+       size_t Capacity = DefaultCapacity);
+
+  /// Compress the remaining output, finish the compressed stream, and close
+  /// the file.
+  ///
+  /// \return \c false if compressing, writing or closing failed.
+  bool close() override;
+
+  class Encoder;
+
+protected:
+  bool drain(const char* Data, size_t Size) override;
+
+private:
+  CompressedOutputBuffer(std::unique_ptr<FdOutputBuffer> Sink,
+                         std::unique_ptr<Encoder> E, size_t Capacity);
+
+  std::unique_ptr<FdOutputBuffer> Sink;
+  std::unique_ptr<Encoder> StreamEncoder;
+  bool Failed = false;
+};
+
+/// Decompress a file and pass its content to \p Consumer in blocks.
+///
+/// \param Path      the compressed file
+/// \param Format    the compression format of the file
+/// \param Consumer  called with each block of decompressed data; returns
+///                  \c false to stop
+///
+/// \return \c false if the file could not be read or decompressed, or if
+/// \p Consumer stopped early.
+DEBLOAT_PRETTYPRINTER_EXPORT_API bool
+decompressFile(const std::string& Path, Compression Format,
+               const std::function<bool(const char*, size_t)>& Consumer);
+
+} // namespace gtirb_pprint
+
+#endif /* GTIRB_PP_COMPRESSION_H */
@@ -16,9 +16,11 @@
 #define GTIRB_PP_ELF_BINARY_PRINTER_H
 
 #include "BinaryPrinter.hpp"
+#include "LibraryIndex.hpp"
 
 #include <gtirb/gtirb.hpp>
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -30,14 +32,39 @@ class DEBLOAT_PRETTYPRINTER_EXPORT_API ElfBinaryPrinter : public BinaryPrinter {
 private:
   std::string compiler = "gcc";
   bool debug = false;
+  std::string ObjectDirectory;
+  uint64_t UnitSize = 0;
+  size_t Shards = 1;
+  bool IntegratedAssembler = false;
+  std::string Linker;
+  std::shared_ptr<LibraryIndex> Libraries = std::make_shared<LibraryIndex>();
   std::optional<std::string>
   getInfixLibraryName(const std::string& library) const;
   std::optional<std::string>
   findLibrary(const std::string& library,
               const std::vector<std::string>& paths) const;
+  std::optional<std::string> linkerName() const;
+  std::vector<std::string> linkerArgs() const;
   std::vector<std::string>
   buildCompilerArgs(std::string outputFilename,
-                    const std::vector<TempFile>& asmPath, gtirb::IR& ir) const;
+                    const std::vector<std::string>& inputPaths,
+                    gtirb::IR& ir) const;
+  std::vector<std::string> assemblerArgs(const gtirb::Module& mod) const;
+  bool assembleIntegrated(const std::string& outputFilename,
+                          gtirb::Context& context, gtirb::Module& mod) const;
+  int assembleCompressed(const std::string& outputFilename,
+                         gtirb::Context& context, gtirb::Module& mod) const;
+  int assemblePiped(const std::string& outputFilename, gtirb::Context& context,
+                    gtirb::Module& mod) const;
+  int linkPiped(const std::string& outputFilename, gtirb::Context& context,
+                gtirb::IR& ir) const;
+  bool assembleUnits(gtirb::Context& context, gtirb::Module& mod,
+                     std::vector<std::string>& objects,
+                     std::vector<std::unique_ptr<TempFile>>& tempObjects) const;
+  bool
+  assembleModules(gtirb::Context& context, gtirb::IR& ir,
+                  std::vector<std::string>& objects,
+                  std::vector<std::unique_ptr<TempFile>>& tempObjects) const;
 
 public:
   /// Construct a ElfBinaryPrinter with the default configuration.
@@ -49,6 +76,43 @@ public:
         debug(debugFlag) {}
   virtual ~ElfBinaryPrinter() = default;
 
+  /// Make link() assemble each module as the units of a
+  /// \link gtirb_pprint::ModuleSplit of about \p unitSize bytes, and keep
+  /// their objects in \p directory under a fingerprint of their assembly and
+  /// of the assembler's arguments. Linking again after changing a few
+  /// functions then only assembles the units holding them.
+  void setObjectDirectory(const std::string& directory, uint64_t unitSize) {
+    ObjectDirectory = directory;
+    UnitSize = unitSize;
+  }
+
+  /// Make link() assemble each module as up to \p shards units of about the
+  /// same size, see \link gtirb_pprint::ModuleSplit, on up to
+  /// \link setJobs assemblers at once, and link their objects. Without an
+  /// object directory, this speeds up the assembly of large modules.
+  void setShards(size_t shards) { Shards = shards; }
+
+  /// Assemble modules in this process, see \link hasIntegratedAssembler,
+  /// instead of running the compiler, and link their objects. Modules that
+  /// need extra compiler arguments, or that the integrated assembler rejects,
+  /// are still assembled by the compiler.
+  void setIntegratedAssembler(bool enable) { IntegratedAssembler = enable; }
+
+  /// Link with \p linker, one of "bfd", "gold", "lld" and "mold", which the
+  /// compiler is given as -fuse-ld, or with the first of mold, lld and gold
+  /// found on the PATH if \p linker is "auto". A linker that is not found is
+  /// replaced by the compiler's default one. The linkers that run threads
+  /// run as many as \link setJobs allows.
+  void setLinker(const std::string& linker) { Linker = linker; }
+
+  /// Find the libraries that the modules need, and that are not found by
+  /// the compiler, in \p index instead of an index of this printer's own.
+  /// The index may be shared with other printers, and loaded from and saved
+  /// to a file, to keep the listings of the library paths across links.
+  void setLibraryIndex(std::shared_ptr<LibraryIndex> index) {
+    Libraries = std::move(index);
+  }
+
   int assemble(const std::string& outputFilename, gtirb::Context& context,
                gtirb::Module& mod) const override;
   int link(const std::string& outputFilename, gtirb::Context& context,
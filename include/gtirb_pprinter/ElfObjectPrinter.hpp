@@ -0,0 +1,67 @@
+//===- ElfObjectPrinter.hpp -------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#ifndef GTIRB_PP_ELF_OBJECT_PRINTER_H
+#define GTIRB_PP_ELF_OBJECT_PRINTER_H
+
+#include "Export.hpp"
+#include "PrettyPrinter.hpp"
+
+#include <gtirb/gtirb.hpp>
+
+#include <string>
+
+namespace gtirb_bprint {
+
+/// Writes a relocatable ELF object straight from a module, without printing
+/// its assembly and running the assembler on it.
+///
+/// The object holds what the assembly of the module would: the blocks of
+/// the sections and functions that the printing policy keeps, aligned as the
+/// printer aligns them, the symbols with their \c elfSymbolInfo, and a
+/// relocation for each symbolic expression, typed by the bytes it covers and
+/// by its attributes. References between blocks of the same section are
+/// resolved in place, as the assembler resolves them.
+///
+/// Only x86-64 modules without call frame information are supported, since
+/// no .eh_frame is written. TLS references and symbol differences across
+/// sections are not written either; write() fails on a module that needs
+/// them, so that the caller can assemble it instead.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API ElfObjectPrinter {
+public:
+  /// \param Printer  the printer whose policy selects what is written
+  explicit ElfObjectPrinter(const gtirb_pprint::PrettyPrinter& Printer)
+      : Printer(Printer) {}
+
+  /// Whether write() supports a module: an x86-64 ELF module without
+  /// \c cfiDirectives.
+  static bool supports(const gtirb::Module& Module);
+
+  /// Write the object of a module.
+  ///
+  /// \param Output  the object file to write
+  /// \param Error   set to the reason on failure
+  ///
+  /// \return \c false if the module uses what the writer does not support,
+  /// or if the object could not be written. No object is left behind then.
+  bool write(gtirb::Context& Context, gtirb::Module& Module,
+             const std::string& Output, std::string& Error) const;
+
+private:
+  const gtirb_pprint::PrettyPrinter& Printer;
+};
+
+} // namespace gtirb_bprint
+
+#endif /* GTIRB_PP_ELF_OBJECT_PRINTER_H */
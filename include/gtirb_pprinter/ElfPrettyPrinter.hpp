@@ -127,6 +127,8 @@ protected:
 
   void printSymbolHeader(std::ostream& os, const gtirb::Symbol& symbol);
 
+  std::string getSymbolName(const gtirb::Symbol& symbol) const override;
+
   std::optional<uint64_t> getAlignment(const gtirb::CodeBlock& Block) override;
 };
 
@@ -0,0 +1,45 @@
+//===- IntegratedAssembler.hpp ----------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#ifndef GTIRB_PP_INTEGRATED_ASSEMBLER_H
+#define GTIRB_PP_INTEGRATED_ASSEMBLER_H
+
+#include "Export.hpp"
+
+#include <string>
+
+namespace gtirb_bprint {
+
+/// Whether this build of gtirb-pprinter can assemble in its own process,
+/// which it does with LLVM's MC layer when built with
+/// GTIRB_PPRINTER_ENABLE_LLVM_MC.
+DEBLOAT_PRETTYPRINTER_EXPORT_API bool hasIntegratedAssembler();
+
+/// Assemble GNU assembly into an object file without running a process.
+///
+/// \param Source  the assembly
+/// \param Triple  the LLVM target triple, for instance
+///                "x86_64-pc-linux-gnu"
+/// \param Output  the object file to write
+/// \param Error   set to the assembler's messages on failure
+///
+/// \return \c false if the assembly could not be assembled, or if there is
+/// no integrated assembler. No object is left behind then.
+DEBLOAT_PRETTYPRINTER_EXPORT_API bool
+assembleInProcess(const std::string& Source, const std::string& Triple,
+                  const std::string& Output, std::string& Error);
+
+} // namespace gtirb_bprint
+
+#endif /* GTIRB_PP_INTEGRATED_ASSEMBLER_H */
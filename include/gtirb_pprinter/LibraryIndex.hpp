@@ -0,0 +1,89 @@
+//===- LibraryIndex.hpp -----------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#ifndef GTIRB_PP_LIBRARY_INDEX_H
+#define GTIRB_PP_LIBRARY_INDEX_H
+
+#include "Export.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace gtirb_bprint {
+
+/// The names of the files in the directories that libraries are searched
+/// in, so that finding a library takes a lookup instead of a file system
+/// access per directory.
+///
+/// A directory is listed the first time a library is looked up in it, and
+/// listed again if its modification time changed since. Only the libraries
+/// looked up are resolved to the regular file their symbolic links lead to.
+/// An index saved to a file, and loaded by a later run, spares that run the
+/// listings of the directories that did not change, and the resolutions
+/// that are still regular files. A directory modified within a second of
+/// the save is listed again, since a later change may not have changed its
+/// time.
+///
+/// Printers on several threads may share an index, but loading and saving
+/// it must not overlap with lookups.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API LibraryIndex {
+public:
+  /// The regular file that the file named \p Library, in the first of
+  /// \p Directories holding one that resolves to a regular file, leads to,
+  /// as resolveRegularFilePath finds it.
+  std::optional<std::string> find(const std::string& Library,
+                                  const std::vector<std::string>& Directories);
+
+  /// Load an index saved by save(), replacing this one.
+  ///
+  /// \return \c false if the file is not a valid index.
+  bool load(const std::string& Path);
+
+  /// Save the index to a file.
+  ///
+  /// \return \c false if it could not be written.
+  bool save(const std::string& Path) const;
+
+  /// The number of directories listed, since construction or loading.
+  size_t listings() const { return Listings; }
+
+private:
+  struct Directory {
+    // The modification time, in nanoseconds since the epoch.
+    int64_t Time = 0;
+    std::unordered_set<std::string> Names;
+    // The regular files that names were resolved to, or an empty string for
+    // the names that lead to none.
+    std::unordered_map<std::string, std::string> Resolved;
+  };
+
+  Directory* directory(const std::string& Path);
+
+  std::mutex Mutex;
+  std::unordered_map<std::string, Directory> Directories;
+  // The directories, and the resolutions, checked against the file system
+  // by this process.
+  std::unordered_set<std::string> CheckedDirectories;
+  std::unordered_set<std::string> CheckedFiles;
+  size_t Listings = 0;
+};
+
+} // namespace gtirb_bprint
+
+#endif /* GTIRB_PP_LIBRARY_INDEX_H */
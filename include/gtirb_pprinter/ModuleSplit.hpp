@@ -0,0 +1,76 @@
+//===- ModuleSplit.hpp ------------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#ifndef GTIRB_PP_MODULE_SPLIT_H
+#define GTIRB_PP_MODULE_SPLIT_H
+
+#include "Export.hpp"
+
+#include <gtirb/gtirb.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace gtirb_pprint {
+
+/// A division of a module into units that are printed and assembled
+/// separately. The units are consecutive runs of the module's blocks, in the
+/// order of its sections, so linking their objects in order lays the module
+/// out as if it had been assembled whole.
+///
+/// A unit starts either at the beginning of a section, or in a section of
+/// code at the entry of a function that no block falls through to. The units
+/// that hold the two ends of a symbol difference, and the block using it,
+/// are merged, since the assembler can only compute such differences within
+/// one object. The symbols that one unit defines are exported to the others
+/// when the units are printed.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API ModuleSplit {
+public:
+  /// Split a module into units of about \p UnitSize bytes of code and data.
+  /// A function, or a section of data, larger than that is a unit of its
+  /// own, and a size of 0 starts a unit wherever one can start.
+  ///
+  /// If the IR holding the module has no CFG, sections of code are not split,
+  /// because the fallthroughs between functions are not known.
+  static ModuleSplit bySize(gtirb::Context& Context, gtirb::Module& Module,
+                            uint64_t UnitSize);
+
+  /// Split a module into at most \p Count units of about the same size, for
+  /// instance to assemble them in parallel.
+  static ModuleSplit byCount(gtirb::Context& Context, gtirb::Module& Module,
+                             size_t Count);
+
+  /// The number of units.
+  size_t size() const { return Units; }
+
+  /// The unit in which a section starts, and where each later unit starts in
+  /// it, as the index of its first block in the section.
+  const std::vector<std::pair<size_t, size_t>>&
+  starts(const gtirb::Section& Section) const;
+
+private:
+  ModuleSplit() = default;
+
+  size_t Units = 0;
+  std::unordered_map<const gtirb::Section*,
+                     std::vector<std::pair<size_t, size_t>>>
+      Starts;
+};
+
+} // namespace gtirb_pprint
+
+#endif /* GTIRB_PP_MODULE_SPLIT_H */
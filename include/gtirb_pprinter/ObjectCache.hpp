@@ -0,0 +1,107 @@
+//===- ObjectCache.hpp ------------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#ifndef GTIRB_PP_OBJECT_CACHE_H
+#define GTIRB_PP_OBJECT_CACHE_H
+
+#include "BlockCache.hpp"
+#include "Export.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace gtirb_bprint {
+
+/// A directory of the objects and binaries built by the binary printers,
+/// keyed by a fingerprint of everything that went into building each one:
+/// the files the tool read, the tool itself and its arguments. A build whose
+/// fingerprint is in the cache is not run again; its output is copied from
+/// the cache instead.
+///
+/// As with ccache, a tool is identified by the file it resolves to on the
+/// PATH, along with that file's size and modification time, so updating the
+/// tool invalidates what it built without having to run it. A compiler
+/// driver is identified by the assembler and linker it runs as well, which
+/// it is asked for once per process. Libraries that
+/// the linker finds by name, rather than by path, are not fingerprinted.
+///
+/// The first store scans the directory for its size, and the stores after it
+/// add to that size. Once it is over the limit, the directory is scanned
+/// again and the least recently used outputs are evicted, until the directory
+/// is under the limit with room to spare. Outputs are written under a
+/// temporary name and renamed, so several processes can share a directory;
+/// what the others store is only counted when the directory is scanned.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API ObjectCache {
+public:
+  /// \param Directory  the cache directory, created if needed
+  /// \param MaxSize    the size in bytes the directory is kept under
+  ObjectCache(const std::string& Directory, uint64_t MaxSize);
+
+  /// The fingerprint of a build.
+  ///
+  /// \param Tool    the tool, found on the PATH
+  /// \param Args    the tool's arguments
+  /// \param Inputs  the files the tool reads. Other arguments that name
+  ///                existing files are taken as inputs too.
+  /// \param Output  the file the tool writes
+  ///
+  /// \return the fingerprint, or \c std::nullopt if the tool or an input
+  /// could not be read. The paths of the inputs and of the output do not
+  /// affect the fingerprint; their content, and their order, do.
+  std::optional<gtirb_pprint::Fingerprint>
+  key(const std::string& Tool, const std::vector<std::string>& Args,
+      const std::vector<std::string>& Inputs, const std::string& Output) const;
+
+  /// The fingerprint of a tool, found on the PATH, as it enters \link key:
+  /// the file it resolves to, and that file's size and modification time.
+  /// For a compiler driver, it includes those of the assembler and linker
+  /// that the driver reports with \c -print-prog-name.
+  ///
+  /// \return \c std::nullopt if the tool could not be found.
+  static std::optional<gtirb_pprint::Fingerprint>
+  toolIdentity(const std::string& Tool);
+
+  /// Copy the output stored under a key to \p Output.
+  ///
+  /// \return \c false if there is none.
+  bool fetch(const gtirb_pprint::Fingerprint& Key, const std::string& Output);
+
+  /// Store a copy of \p Output under a key.
+  ///
+  /// \return \c false if it could not be stored.
+  bool store(const gtirb_pprint::Fingerprint& Key, const std::string& Output);
+
+  /// The number of fetches that found an output and that did not.
+  size_t hits() const { return Hits; }
+  size_t misses() const { return Misses; }
+
+private:
+  std::string path(const gtirb_pprint::Fingerprint& Key) const;
+  void evict();
+
+  std::string Directory;
+  uint64_t MaxSize;
+  std::atomic<size_t> Hits{0};
+  std::atomic<size_t> Misses{0};
+  std::mutex SizeMutex;
+  std::optional<uint64_t> DirectorySize;
+};
+
+} // namespace gtirb_bprint
+
+#endif /* GTIRB_PP_OBJECT_CACHE_H */
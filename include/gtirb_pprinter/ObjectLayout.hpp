@@ -0,0 +1,195 @@
+//===- ObjectLayout.hpp -----------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#ifndef GTIRB_PP_OBJECT_LAYOUT_H
+#define GTIRB_PP_OBJECT_LAYOUT_H
+
+#include "Export.hpp"
+#include "PrettyPrinter.hpp"
+
+#include <gtirb/gtirb.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace gtirb_bprint {
+
+/// The contents of a module laid out as in the object that assembling its
+/// assembly would produce, for the writers of objects that bypass the
+/// assembler, such as ElfObjectPrinter.
+///
+/// The layout keeps the sections, blocks and symbols that the printing policy
+/// keeps, and places the blocks of each section one after the other, aligned
+/// as the printer aligns them. It then tells, for each symbolic expression,
+/// which field it covers and how the field refers to its symbols. The size of
+/// the field, and whether it is relative to the program counter, are read
+/// from the bytes as the original link resolved them. References to skipped
+/// symbols, and differences between symbols of the same section, are
+/// resolved in place; the writers turn the others into relocations.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API ObjectLayout {
+public:
+  /// A place in the object.
+  struct Location {
+    size_t Section;
+    uint64_t Offset;
+  };
+
+  struct Section {
+    const gtirb::Section* Source;
+    uint64_t Alignment = 1;
+    uint64_t Size = 0;
+    /// The contents, empty for a section with no initialized bytes.
+    std::vector<uint8_t> Bytes;
+    bool ZeroFill = false;
+  };
+
+  enum class ReferenceKind {
+    /// The field holds the address of Symbol, plus Addend.
+    Absolute,
+    /// The field holds the address of Symbol plus Addend, minus that of the
+    /// field.
+    PcRelative,
+    /// The field holds the address of Symbol minus that of Base, plus
+    /// Addend.
+    Difference,
+  };
+
+  struct Reference {
+    Location Field;
+    uint64_t Size;
+    ReferenceKind Kind;
+    /// The symbol referred to, after following its forwarding.
+    const gtirb::Symbol* Symbol;
+    /// The symbol of the expression, before following its forwarding.
+    const gtirb::Symbol* Original;
+    const gtirb::Symbol* Base = nullptr;
+    int64_t Addend;
+    /// Whether an absolute field of 4 bytes held its value sign-extended.
+    bool Signed = false;
+    /// Whether the field is in an instruction, and whether it is the
+    /// displacement of a call or jump.
+    bool Code = false;
+    bool Branch = false;
+    gtirb::SymAttributeSet Attributes;
+  };
+
+  /// \param Printer  the printer whose policy selects what is laid out
+  ObjectLayout(gtirb::Context& Context, gtirb::Module& Module,
+               const gtirb_pprint::PrettyPrinter& Printer);
+
+  /// Lay the module out.
+  ///
+  /// \return \c false, with the reason in \p Error, if the module has
+  /// blocks without addresses or expressions whose fields cannot be told.
+  bool build(std::string& Error);
+
+  std::vector<Section>& sections() { return Sections; }
+  const std::vector<Reference>& references() const { return References; }
+
+  /// Where a symbol is in the object, or \c std::nullopt if it is not
+  /// defined in it.
+  std::optional<Location> locate(const gtirb::Symbol& Symbol) const;
+
+  /// Whether the printing policy skips a symbol.
+  bool skipSymbol(const gtirb::Symbol& Symbol) const;
+
+  /// Write \p Value into the \p Size bytes at a place in the object.
+  void store(const Location& Where, int64_t Value, uint64_t Size);
+
+  /// Whether \p Value fits in a field of \p Size bytes, signed or not.
+  static bool fits(int64_t Value, uint64_t Size);
+
+private:
+  struct BlockView {
+    const gtirb::Node* Node;
+    const gtirb::ByteInterval* Interval;
+    uint64_t Offset;
+    uint64_t Size;
+    std::optional<gtirb::Addr> Address;
+    bool Code;
+  };
+  struct Placed {
+    Location Where;
+    uint64_t Size;
+  };
+
+  static BlockView view(const gtirb::Node& Node);
+  bool skipSection(const gtirb::Section& Section) const;
+  bool skipBlock(const BlockView& Block) const;
+  bool inSkippedFunction(gtirb::Addr Addr) const;
+  uint64_t alignment(const BlockView& Block, bool ArraySection) const;
+  const gtirb::Symbol* forwarded(const gtirb::Symbol& Symbol) const;
+  std::optional<uint64_t> address(const gtirb::Symbol& Symbol) const;
+  uint8_t byte(const gtirb::ByteInterval& BI, uint64_t Offset) const;
+  int64_t readSigned(const gtirb::ByteInterval& BI, uint64_t Offset,
+                     uint64_t Size) const;
+
+  bool place();
+  bool refer(const BlockView& Block, const Placed& Where);
+  bool fail(const std::string& Message) {
+    Error = Message;
+    return false;
+  }
+
+  gtirb::Context& Context;
+  gtirb::Module& Module;
+  gtirb_pprint::PrintingPolicy Policy;
+  std::string Error;
+
+  std::set<gtirb::Addr> FunctionEntries;
+  std::vector<Section> Sections;
+  std::vector<Reference> References;
+  std::unordered_map<const gtirb::Node*, Placed> Blocks;
+  std::vector<std::pair<BlockView, Placed>> Order;
+  std::set<std::pair<const gtirb::ByteInterval*, uint64_t>> Referred;
+};
+
+/// Little-endian encoding of the fields of an object file.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API ObjectEncoder {
+public:
+  void u8(uint8_t V) { Bytes.push_back(V); }
+  void u16(uint16_t V) { put(V, 2); }
+  void u32(uint32_t V) { put(V, 4); }
+  void u64(uint64_t V) { put(V, 8); }
+  void pad(size_t Alignment) {
+    while (Bytes.size() % Alignment != 0)
+      Bytes.push_back(0);
+  }
+  void append(const std::vector<uint8_t>& Data) {
+    Bytes.insert(Bytes.end(), Data.begin(), Data.end());
+  }
+  size_t size() const { return Bytes.size(); }
+
+  /// Write the bytes to a file.
+  ///
+  /// \return \c false if the file could not be written.
+  bool write(const std::string& Path) const;
+
+  std::vector<uint8_t> Bytes;
+
+private:
+  void put(uint64_t V, size_t Size) {
+    for (size_t I = 0; I < Size; ++I)
+      Bytes.push_back(static_cast<uint8_t>(V >> (8 * I)));
+  }
+};
+
+} // namespace gtirb_bprint
+
+#endif /* GTIRB_PP_OBJECT_LAYOUT_H */
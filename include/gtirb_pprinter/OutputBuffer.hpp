@@ -0,0 +1,256 @@
+//===- OutputBuffer.hpp -----------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#ifndef GTIRB_PP_OUTPUT_BUFFER_H
+#define GTIRB_PP_OUTPUT_BUFFER_H
+
+#include "Export.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace gtirb_pprint {
+
+/// A stream buffer that collects output in a single contiguous block of
+/// memory and hands it to a sink in large pieces.
+///
+/// The pretty printers write assembly as many small tokens. Attaching an
+/// OutputBuffer to a \c std::ostream keeps the existing \c std::ostream
+/// interface while turning those tokens into a few large writes. Requests to
+/// synchronize the stream (\c std::endl, \c std::flush) are ignored: the
+/// buffer is only drained when it is full or when \link flush is called.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API OutputBuffer : public std::streambuf {
+public:
+  static constexpr size_t DefaultCapacity = 1 << 20;
+
+  explicit OutputBuffer(size_t Capacity = DefaultCapacity);
+  OutputBuffer(const OutputBuffer&) = delete;
+  OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+  /// Subclasses must call \link close in their destructor: the sink is gone
+  /// by the time this destructor runs.
+  virtual ~OutputBuffer() = default;
+
+  /// Change the capacity of the buffer. Buffered content is drained first if
+  /// it does not fit in the new capacity.
+  ///
+  /// \return \c false if draining the buffered content failed or the buffer
+  /// does not support resizing.
+  virtual bool reserve(size_t Capacity);
+
+  /// The number of bytes the buffer can hold before it is drained.
+  size_t capacity() const { return static_cast<size_t>(epptr() - pbase()); }
+
+  /// The number of bytes currently held in the buffer.
+  size_t size() const { return static_cast<size_t>(pptr() - pbase()); }
+
+  /// Hand all buffered content to the sink.
+  ///
+  /// \return \c false if the sink reported an error.
+  bool flush();
+
+  /// Hand all buffered content to the sink and release the sink.
+  ///
+  /// \return \c false if the sink reported an error at any point.
+  virtual bool close() { return flush(); }
+
+protected:
+  /// Write a block of output to the sink.
+  ///
+  /// Implementations that manage their own memory may call \link setArea
+  /// from here to direct further output to a different block of memory, for
+  /// instance while the sink still reads from this one.
+  ///
+  /// \return \c false on error.
+  virtual bool drain(const char* Data, size_t Size) = 0;
+
+  /// Write the buffered content immediately followed by a block of output
+  /// that was too large to be copied into the buffer. Sinks that support
+  /// gathered writes should override this; the default drains each block in
+  /// turn.
+  ///
+  /// \return \c false on error.
+  virtual bool drainv(const char* Buffered, size_t BufferedSize,
+                      const char* Data, size_t Size);
+
+  /// Direct further output to \p Size bytes of memory starting at \p Begin.
+  /// The memory must outlive its use by this buffer.
+  void setArea(char* Begin, size_t Size) { setp(Begin, Begin + Size); }
+
+  /// Move the output position forward by \p Count bytes, which may exceed
+  /// the range of \c int.
+  void advance(size_t Count);
+
+  int_type overflow(int_type Ch) override;
+  std::streamsize xsputn(const char* S, std::streamsize N) override;
+  int sync() override;
+
+private:
+  std::vector<char> Buffer;
+};
+
+/// An OutputBuffer that drains to a file descriptor with \c write and
+/// \c writev.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API FdOutputBuffer : public OutputBuffer {
+public:
+  /// Wrap an already open file descriptor.
+  ///
+  /// \param Fd        the descriptor to write to
+  /// \param OwnsFd    whether \link close should close the descriptor
+  /// \param Capacity  the size of the buffer
+  explicit FdOutputBuffer(int Fd, bool OwnsFd = false,
+                          size_t Capacity = DefaultCapacity);
+  ~FdOutputBuffer() override;
+
+  /// Create (or truncate) a file and open it for buffered writing.
+  ///
+  /// \return the buffer, or \c nullptr if the file could not be opened.
+  static std::unique_ptr<FdOutputBuffer>
+  open(const std::string& Path, size_t Capacity = DefaultCapacity);
+
+  /// Drain the buffer and, if this object owns it, close the descriptor.
+  ///
+  /// \return \c false if any write or the close failed.
+  bool close() override;
+
+  int fd() const { return Fd; }
+
+protected:
+  bool drain(const char* Data, size_t Size) override;
+  bool drainv(const char* Buffered, size_t BufferedSize, const char* Data,
+              size_t Size) override;
+
+private:
+  int Fd;
+  bool OwnsFd;
+  bool Failed = false;
+};
+
+/// An OutputBuffer that collects all output in memory.
+///
+/// The output is written straight into a string that grows geometrically from
+/// a capacity hint, and \link take hands the string over without copying it.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API StringOutputBuffer
+    : public OutputBuffer {
+public:
+  /// \param CapacityHint  the number of bytes to allocate up front
+  explicit StringOutputBuffer(size_t CapacityHint = DefaultCapacity);
+
+  /// Make room for at least \p Capacity bytes of output in total.
+  bool reserve(size_t Capacity) override;
+
+  /// Move the collected output out of the buffer and start over empty.
+  std::string take();
+
+protected:
+  bool drain(const char* Data, size_t Size) override;
+
+private:
+  void grow(size_t MinSize);
+
+  std::string Text;
+  size_t Committed = 0;
+};
+
+/// An OutputBuffer that hands each full block of output to a callback, for
+/// instance to stream it into a network or storage layer without copying it
+/// again.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API CallbackOutputBuffer
+    : public OutputBuffer {
+public:
+  /// \param Callback  called with each block of output; the block is only
+  ///                  valid during the call. Returns \c false to report an
+  ///                  error, after which no further output is delivered.
+  /// \param Capacity  the size of the blocks
+  explicit CallbackOutputBuffer(
+      std::function<bool(const char*, size_t)> Callback,
+      size_t Capacity = DefaultCapacity);
+  ~CallbackOutputBuffer() override;
+
+  /// Deliver the remaining output.
+  ///
+  /// \return \c false if the callback reported an error at any point.
+  bool close() override;
+
+protected:
+  bool drain(const char* Data, size_t Size) override;
+
+private:
+  std::function<bool(const char*, size_t)> Callback;
+  bool Failed = false;
+};
+
+/// An OutputBuffer that writes a file asynchronously, so that formatting the
+/// next block of output overlaps with writing the previous one.
+///
+/// Output is collected in a ring of fixed-size buffers. Each full buffer is
+/// submitted through io_uring when the library was built with liburing and the
+/// kernel supports it, and handed to a background writer thread otherwise.
+/// The printer only blocks when every buffer in the ring is still in flight.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API AsyncFileOutputBuffer
+    : public OutputBuffer {
+public:
+  static constexpr size_t DefaultSlotCount = 4;
+
+  ~AsyncFileOutputBuffer() override;
+
+  /// Create (or truncate) a file and open it for asynchronous writing.
+  ///
+  /// \param Path       the file to write
+  /// \param SlotSize   the size of each buffer in the ring
+  /// \param SlotCount  the number of buffers in the ring
+  ///
+  /// \return the buffer, or \c nullptr if the file could not be opened.
+  static std::unique_ptr<AsyncFileOutputBuffer>
+  open(const std::string& Path, size_t SlotSize = DefaultCapacity,
+       size_t SlotCount = DefaultSlotCount);
+
+  /// The size of the ring buffers is fixed; always returns \c false.
+  bool reserve(size_t Capacity) override;
+
+  /// Submit the remaining output, wait for all writes to complete, and close
+  /// the file.
+  ///
+  /// \return \c false if any write or the close failed.
+  bool close() override;
+
+  /// Whether writes are submitted through io_uring rather than a thread.
+  bool usesIoUring() const;
+
+  class Writer;
+
+protected:
+  bool drain(const char* Data, size_t Size) override;
+  bool drainv(const char* Buffered, size_t BufferedSize, const char* Data,
+              size_t Size) override;
+
+private:
+  AsyncFileOutputBuffer(int Fd, std::unique_ptr<Writer> W, size_t SlotSize,
+                        size_t SlotCount);
+
+  int Fd;
+  std::unique_ptr<Writer> AsyncWriter;
+  std::vector<char*> Slots;
+  std::vector<std::vector<char>> SlotStorage;
+  size_t Current = 0;
+  bool Failed = false;
+};
+
+} // namespace gtirb_pprint
+
+#endif /* GTIRB_PP_OUTPUT_BUFFER_H */
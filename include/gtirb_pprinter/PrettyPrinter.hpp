@@ -15,7 +15,9 @@
 #ifndef GTIRB_PP_PRETTY_PRINTER_H
 #define GTIRB_PP_PRETTY_PRINTER_H
 
+#include "BlockCache.hpp"
 #include "Export.hpp"
+#include "ModuleSplit.hpp"
 #include "Syntax.hpp"
 
 #include <gtirb/gtirb.hpp>
@@ -37,12 +39,19 @@
 namespace gtirb_pprint {
 
 struct PrintingPolicy;
+class OutputBuffer;
 class PrettyPrinterFactory;
 class PrettyPrinterBase;
+class PreparedModule;
 
 /// Whether a pretty printer should include debugging messages in it output.
 enum DebugStyle { NoDebug, DebugMessages };
 
+/// Who the assembly is for. The machine profile drops everything the
+/// assembler does not need (banners, section-end comments, indentation,
+/// leading padding) and uses short names for ambiguous symbols.
+enum EmissionProfile { HumanReadable, Machine };
+
 /// A range containing strings. These can be standard library containers or
 /// pairs of iterators, for example.
 using string_range = boost::any_range<std::string, boost::forward_traversal_tag,
@@ -137,6 +146,8 @@ struct DEBLOAT_PRETTYPRINTER_EXPORT_API PrintingPolicy {
   std::unordered_set<std::string> compilerArguments{};
 
   DebugStyle debug = NoDebug;
+
+  EmissionProfile profile = HumanReadable;
 };
 
 using NamedPolicyMap = std::unordered_map<std::string, PrintingPolicy>;
@@ -177,6 +188,20 @@ public:
   /// \c false.
   bool getDebug() const;
 
+  /// Select the \link EmissionProfile of the printed assembly.
+  void setEmissionProfile(EmissionProfile profile) { m_profile = profile; }
+  EmissionProfile getEmissionProfile() const { return m_profile; }
+
+  /// Print blocks through a cache of their text, so that printing a module
+  /// again after a few of its blocks changed only prints those blocks. The
+  /// cache is shared by copies of this PrettyPrinter.
+  void setBlockCache(std::shared_ptr<BlockCache> cache) {
+    m_blockCache = std::move(cache);
+  }
+  const std::shared_ptr<BlockCache>& getBlockCache() const {
+    return m_blockCache;
+  }
+
   /// Pretty-print the IR module to a stream. The default output target is
   /// deduced from the file format of the IR if it is not explicitly set with
   /// \link setTarget.
@@ -190,6 +215,71 @@ public:
   std::error_condition print(std::ostream& stream, gtirb::Context& context,
                              gtirb::Module& module) const;
 
+  /// Pretty-print the IR module into an \link OutputBuffer, such as a
+  /// \link StringOutputBuffer or a \link CallbackOutputBuffer. All output
+  /// has been handed to the buffer's sink when this returns.
+  ///
+  /// \param buffer  the buffer to print to
+  /// \param context context to use for allocating AuxData objects if needed
+  /// \param module  the module to pretty-print
+  ///
+  /// \return a condition indicating if there was an error, or condition 0 if
+  /// there were no errors.
+  std::error_condition print(OutputBuffer& buffer, gtirb::Context& context,
+                             gtirb::Module& module) const;
+
+  /// Pretty-print the IR module in several syntaxes at once. The module is
+  /// traversed a single time and each syntax's printer emits into its own
+  /// stream, so work that does not depend on the syntax, such as walking the
+  /// function AuxData and finding the symbols of each block, is done once.
+  ///
+  /// \param streams  for each output, the syntax and the stream to print to
+  /// \param context  context to use for allocating AuxData objects if needed
+  /// \param module   the module to pretty-print
+  ///
+  /// \return a condition indicating if there was an error, or condition 0 if
+  /// there were no errors.
+  std::error_condition
+  print(const std::vector<std::pair<std::string, std::ostream*>>& streams,
+        gtirb::Context& context, gtirb::Module& module) const;
+
+  /// Pretty-print the units of a \link ModuleSplit of the module, each to
+  /// its own stream, so that they can be assembled separately. Only the ELF
+  /// printers export the symbols of each unit to the others.
+  ///
+  /// \param split    the units of the module
+  /// \param streams  the stream of each unit
+  /// \param context  context to use for allocating AuxData objects if needed
+  /// \param module   the module to pretty-print
+  ///
+  /// \return a condition indicating if there was an error, or condition 0 if
+  /// there were no errors.
+  std::error_condition print(const ModuleSplit& split,
+                             const std::vector<std::ostream*>& streams,
+                             gtirb::Context& context,
+                             gtirb::Module& module) const;
+
+  /// Pretty-print a \link PreparedModule to a stream, reusing the
+  /// information about the module gathered by earlier prints of it.
+  ///
+  /// \param stream  the stream to print to
+  /// \param module  the module to pretty-print
+  ///
+  /// \return a condition indicating if there was an error, or condition 0 if
+  /// there were no errors.
+  std::error_condition print(std::ostream& stream,
+                             PreparedModule& module) const;
+
+  /// Pretty-print a \link PreparedModule into an \link OutputBuffer.
+  ///
+  /// \param buffer  the buffer to print to
+  /// \param module  the module to pretty-print
+  ///
+  /// \return a condition indicating if there was an error, or condition 0 if
+  /// there were no errors.
+  std::error_condition print(OutputBuffer& buffer,
+                             PreparedModule& module) const;
+
   PolicyOptions& functionPolicy() { return FunctionPolicy; }
   const PolicyOptions& functionPolicy() const { return FunctionPolicy; }
 
@@ -214,10 +304,14 @@ private:
   std::string m_isa;
   std::string m_syntax;
   DebugStyle m_debug;
+  EmissionProfile m_profile = HumanReadable;
+  std::shared_ptr<BlockCache> m_blockCache;
   PolicyOptions FunctionPolicy, SymbolPolicy, SectionPolicy, ArraySectionPolicy;
   std::string PolicyName = "default";
 
   PrettyPrinterFactory& getFactory(gtirb::Module& Module) const;
+  std::unique_ptr<PrettyPrinterBase> createPrinter(gtirb::Context& Context,
+                                                   gtirb::Module& Module) const;
 };
 
 /// Abstract factory - encloses default printing configuration and a method for
@@ -267,6 +361,22 @@ public:
 
   virtual std::ostream& print(std::ostream& out);
 
+  /// Print a module with several printers, for instance one per syntax, in a
+  /// single traversal of the module. Each printer writes to its own stream.
+  /// All printers must have been created for the same module.
+  static void
+  printAll(const std::vector<std::pair<PrettyPrinterBase*, std::ostream*>>&
+               printers);
+
+  /// Print the units of a \link ModuleSplit of the module, each to its own
+  /// stream.
+  void printUnits(const ModuleSplit& Split,
+                  const std::vector<std::ostream*>& Streams);
+
+  /// Print blocks through a cache of their text. The cache must outlive the
+  /// printer.
+  void setBlockCache(BlockCache* cache) { RenderCache = cache; }
+
 protected:
   const Syntax& syntax;
   PrintingPolicy policy;
@@ -424,6 +534,13 @@ protected:
 
   bool debug;
 
+  /// Whether the machine \link EmissionProfile is selected.
+  bool compact;
+
+  /// Whether the module is printed as the units of a \link ModuleSplit, so
+  /// that the symbols each unit defines must be visible to the others.
+  bool ExportSymbols = false;
+
   gtirb::Context& context;
   gtirb::Module& module;
 
@@ -444,23 +561,78 @@ protected:
   std::optional<uint64_t> getAlignment(gtirb::Addr Addr) const;
 
 private:
-  std::set<gtirb::Addr> functionEntry;
-  std::set<gtirb::Addr> functionLastBlock;
+  friend class PreparedModule;
+
+  /// Syntax-independent information about the module, computed on first use
+  /// and shared by the printers driven by printAll() and by the prints of a
+  /// PreparedModule.
+  struct ModuleIndex;
+  mutable std::shared_ptr<ModuleIndex> Index;
   gtirb::Addr programCounter;
 
   std::optional<gtirb::Addr> CFIStartProc;
 
+  BlockCache* RenderCache = nullptr;
+  std::optional<Fingerprint> ConfigFingerprint;
+
   template <typename BlockType>
   void printBlockImpl(std::ostream& OS, BlockType& Block);
+  template <typename BlockType>
+  void printBlockText(std::ostream& OS, BlockType& Block);
+  template <typename BlockType>
+  Fingerprint blockFingerprint(BlockType& Block);
+  const Fingerprint& configFingerprint();
+
+  ModuleIndex& moduleIndex() const;
+  size_t disambiguationIndex(const gtirb::Symbol& Symbol) const;
+  const std::vector<const gtirb::Symbol*>&
+  blockSymbols(const gtirb::Node& Block) const;
+  void printSectionBlock(std::ostream& OS, const gtirb::Node& Block);
+  void printTrailingSymbol(std::ostream& OS, const gtirb::Symbol& Sym,
+                           bool Integral = true);
 
   template <typename BlockType>
   std::optional<uint64_t> getAlignmentImpl(const BlockType& Block);
 
+  void skipFunctionAliases();
+
 protected:
   std::string m_accum_comment;
   static std::string s_symaddr_0_warning(uint64_t symAddr);
 };
 
+/// A module prepared for being printed several times, for instance with
+/// different policies or targets. The information about the module that
+/// depends on neither, such as the function boundaries and the ambiguous
+/// symbol names, is gathered by the first print and reused by the others.
+///
+/// Changes to the symbols of the module are picked up by the next print.
+/// The function boundaries are not updated when the module changes: call
+/// invalidate() after changing the FunctionEntries or FunctionBlocks
+/// AuxData.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API PreparedModule {
+public:
+  PreparedModule(gtirb::Context& Context, gtirb::Module& Module)
+      : Ctx(Context), Mod(Module) {}
+
+  gtirb::Context& context() const { return Ctx; }
+  gtirb::Module& module() const { return Mod; }
+
+  /// Discard the information gathered about the module.
+  void invalidate() { Index.reset(); }
+
+private:
+  friend class PrettyPrinter;
+
+  /// Give a printer of the module the gathered information, gathering it
+  /// first if needed.
+  void attach(PrettyPrinterBase& Printer);
+
+  gtirb::Context& Ctx;
+  gtirb::Module& Mod;
+  std::shared_ptr<PrettyPrinterBase::ModuleIndex> Index;
+};
+
 /// !brief Register AuxData types used by the pretty printer.
 DEBLOAT_PRETTYPRINTER_EXPORT_API void registerAuxDataTypes();
 
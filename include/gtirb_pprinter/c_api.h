@@ -0,0 +1,119 @@
+/*===- c_api.h ----------------------------------------------------*- C -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===*/
+#ifndef GTIRB_PP_C_API_H
+#define GTIRB_PP_C_API_H
+
+#include "Export.hpp"
+
+#include <stddef.h>
+
+/*
+ * A C interface for pretty-printing GTIRB to memory, for callers that cannot
+ * use the C++ API. Each module is laid out the same way gtirb-pprinter lays
+ * it out before printing. The first load registers the AuxData types and the
+ * printers, unless the host program has registered the printers already.
+ * No function throws: an error while loading or printing is returned as
+ * GTIRB_PPRINT_LOAD_FAILED or GTIRB_PPRINT_OUTPUT_FAILED.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Status codes returned by the functions below. */
+typedef enum gtirb_pprint_status {
+  GTIRB_PPRINT_OK = 0,
+  GTIRB_PPRINT_INVALID_ARGUMENT,
+  GTIRB_PPRINT_LOAD_FAILED,
+  GTIRB_PPRINT_UNSUPPORTED_TARGET,
+  GTIRB_PPRINT_OUTPUT_FAILED
+} gtirb_pprint_status;
+
+/** A loaded GTIRB IR together with the memory that holds it. */
+typedef struct gtirb_pprint_ir gtirb_pprint_ir;
+
+/**
+ * Receives a block of assembly. The block is only valid during the call.
+ * Return non-zero to continue and zero to stop printing with
+ * GTIRB_PPRINT_OUTPUT_FAILED.
+ */
+typedef int (*gtirb_pprint_write_fn)(void* user_data, const char* data,
+                                     size_t size);
+
+/** Load a serialized GTIRB IR from a file. */
+DEBLOAT_PRETTYPRINTER_EXPORT_API gtirb_pprint_status
+gtirb_pprint_ir_load_file(const char* path, gtirb_pprint_ir** ir);
+
+/** Load a serialized GTIRB IR from memory. The memory is not retained. */
+DEBLOAT_PRETTYPRINTER_EXPORT_API gtirb_pprint_status
+gtirb_pprint_ir_load_memory(const void* data, size_t size,
+                            gtirb_pprint_ir** ir);
+
+/** Release an IR. Accepts NULL. */
+DEBLOAT_PRETTYPRINTER_EXPORT_API void
+gtirb_pprint_ir_free(gtirb_pprint_ir* ir);
+
+/** The number of modules in an IR. */
+DEBLOAT_PRETTYPRINTER_EXPORT_API size_t
+gtirb_pprint_ir_module_count(const gtirb_pprint_ir* ir);
+
+/**
+ * Print a module of an IR, handing the assembly to a callback in blocks.
+ *
+ * \param ir         the IR
+ * \param module     the index of the module to print
+ * \param syntax     the assembly syntax, or NULL for the module's default
+ * \param write      receives the assembly
+ * \param user_data  passed to \c write
+ */
+DEBLOAT_PRETTYPRINTER_EXPORT_API gtirb_pprint_status
+gtirb_pprint_print_module(gtirb_pprint_ir* ir, size_t module,
+                          const char* syntax, gtirb_pprint_write_fn write,
+                          void* user_data);
+
+/** A block of assembly owned by the library. */
+typedef struct gtirb_pprint_string gtirb_pprint_string;
+
+/**
+ * Print a module of an IR into a single block of memory.
+ *
+ * \param ir      the IR
+ * \param module  the index of the module to print
+ * \param syntax  the assembly syntax, or NULL for the module's default
+ * \param result  receives the assembly, to be released with
+ *                gtirb_pprint_string_free
+ */
+DEBLOAT_PRETTYPRINTER_EXPORT_API gtirb_pprint_status
+gtirb_pprint_print_module_to_string(gtirb_pprint_ir* ir, size_t module,
+                                    const char* syntax,
+                                    gtirb_pprint_string** result);
+
+/** The assembly text. It is NUL-terminated. */
+DEBLOAT_PRETTYPRINTER_EXPORT_API const char*
+gtirb_pprint_string_data(const gtirb_pprint_string* str);
+
+/** The size of the assembly text, excluding the terminating NUL. */
+DEBLOAT_PRETTYPRINTER_EXPORT_API size_t
+gtirb_pprint_string_size(const gtirb_pprint_string* str);
+
+/** Release assembly. Accepts NULL. */
+DEBLOAT_PRETTYPRINTER_EXPORT_API void
+gtirb_pprint_string_free(gtirb_pprint_string* str);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GTIRB_PP_C_API_H */
@@ -15,7 +15,11 @@
 #ifndef GTIRB_FILE_UTILS_H
 #define GTIRB_FILE_UTILS_H
 
+#include "Export.hpp"
+
+#include <cstdint>
 #include <fstream>
+#include <functional>
 #include <optional>
 #include <string>
 #include <vector>
@@ -23,20 +27,72 @@
 namespace gtirb_bprint {
 /// Auxiliary class to make sure we delete the temporary assembly file at the
 /// end
-class TempFile {
+///
+/// On Linux, a file of known size is kept in memory, with memfd_create, as
+/// long as the files kept in memory fit in the memory budget, and its name is
+/// then /proc/self/fd/N. Child processes inherit the file under the same name.
+/// Other files go to the temporary directory, as does a file in memory that
+/// outgrows the budget by the time it is closed.
+class DEBLOAT_PRETTYPRINTER_EXPORT_API TempFile {
   std::string Name;
+  std::string Extension;
   std::ofstream FileStream;
+  int Fd = -1;
+  uint64_t Reserved = 0;
 
 public:
-  TempFile(const std::string extension = std::string(".s"));
+  /// The expected size of a file that must be on disk, for instance because
+  /// a tool writes it by replacing it.
+  static constexpr uint64_t OnDisk = UINT64_MAX;
+
+  /// \param extension     the extension of the file name
+  /// \param expectedSize  the size the file is expected to reach, which is
+  ///                      reserved in the memory budget until it is closed,
+  ///                      or 0 if it is not known, to keep the file on disk
+  TempFile(const std::string extension = std::string(".s"),
+           uint64_t expectedSize = 0);
+  TempFile(TempFile&& Other);
   ~TempFile();
 
   bool isOpen() const { return static_cast<bool>(FileStream); }
-  void close() { FileStream.close(); }
+
+  /// Close the stream, and take the size of a file in memory from the memory
+  /// budget. A file that no longer fits in the budget is moved to disk, and
+  /// its name changes. The file may be closed again after writing it by
+  /// name, to account for what was written.
+  void close();
+
+  /// Whether the file is kept in memory.
+  bool inMemory() const { return Fd >= 0; }
 
   operator const std::ofstream&() const { return FileStream; }
   operator std::ofstream&() { return FileStream; }
   const std::string& fileName() const { return Name; }
+
+  /// Put the files on disk in \p directory instead of the system's temporary
+  /// directory, or in the latter again if \p directory is empty.
+  static void setDirectory(const std::string& directory);
+
+  /// Keep files in memory while they total at most \p budget bytes. A budget
+  /// of 0 keeps all the files on disk.
+  static void setMemoryBudget(uint64_t budget);
+
+private:
+  bool spill();
+};
+
+// A named pipe, alone in a new temporary directory that is removed with it.
+// Named pipes are not made on Windows, where isOpen() is always false.
+class TempFifo {
+  std::string Directory;
+  std::string Name;
+
+public:
+  TempFifo(const std::string& extension = std::string(".s"));
+  ~TempFifo();
+
+  bool isOpen() const { return !Name.empty(); }
+  const std::string& fileName() const { return Name; }
 };
 
 std::string replaceExtension(const std::string path, const std::string new_ext);
@@ -46,12 +102,58 @@ std::optional<std::string> resolveRegularFilePath(const std::string& path);
 std::optional<std::string> resolveRegularFilePath(const std::string& path,
                                                   const std::string& fileName);
 
+// Helper function to find a tool on the PATH, as execute does.
+std::optional<std::string> findTool(const std::string& tool);
+
+// The resources that a process, and the processes it waited for, used. Only
+// the wall time is known on Windows.
+struct ProcessUsage {
+  double WallSeconds = 0;
+  double UserSeconds = 0;
+  double SystemSeconds = 0;
+  uint64_t PeakRssBytes = 0;
+};
+
 // Helper function to execute a process with arguments; will search for the
 // given tool on PATH automatically. If the tool cannot be found, the function
 // returns nullopt. Otherwise, the function returns the return code from
-// executing the tool.
+// executing the tool, and fills usage, if given, with what the tool used.
 std::optional<int> execute(const std::string& tool,
-                           const std::vector<std::string>& args);
+                           const std::vector<std::string>& args,
+                           ProcessUsage* usage = nullptr);
+
+// Like execute, but connects the standard input of the tool to a pipe that
+// writeInput fills. The pipe is closed once writeInput returns. If writeInput
+// reports a failure, or writing fails because the tool closed its input, and
+// the tool succeeded anyway, the function returns -1.
+std::optional<int>
+execute(const std::string& tool, const std::vector<std::string>& args,
+        const std::function<bool(std::ostream&)>& writeInput,
+        ProcessUsage* usage = nullptr);
+
+// Like execute, but returns what the tool writes to its standard output, and
+// discards what it writes to its standard error. Returns nullopt if the tool
+// cannot be found or fails.
+std::optional<std::string> executeOutput(const std::string& tool,
+                                         const std::vector<std::string>& args);
+
+// Like execute, but a thread writes each of the named pipes in fifos with
+// writeInput while the tool runs. The pipes are written in order, once the
+// tool opens each for reading, and a pipe is closed once its writeInput
+// returns. If writing a pipe fails and the tool succeeded anyway, or the tool
+// exits without opening all of the pipes, the function returns -1.
+std::optional<int>
+execute(const std::string& tool, const std::vector<std::string>& args,
+        const std::vector<std::string>& fifos,
+        const std::function<bool(size_t, std::ostream&)>& writeInput,
+        ProcessUsage* usage = nullptr);
+
+// Helper function to call work(0), ..., work(count - 1) on up to jobs
+// threads, or on as many threads as the machine runs at once if jobs is 0.
+// Once a call returns false, no further calls are started and the function
+// returns false.
+bool runJobs(size_t count, unsigned jobs,
+             const std::function<bool(size_t)>& work);
 
 } // namespace gtirb_bprint
 #endif /* GTIRB_FILE_UTILS_H */
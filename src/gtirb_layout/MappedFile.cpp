@@ -0,0 +1,123 @@
+//===- MappedFile.cpp -------------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace gtirb_layout;
+
+MemoryInputBuffer::MemoryInputBuffer(const char* Data, size_t Size) {
+  char* Begin = const_cast<char*>(Data);
+  setg(Begin, Begin, Begin + Size);
+}
+
+std::streamsize MemoryInputBuffer::showmanyc() { return egptr() - gptr(); }
+
+std::streamsize MemoryInputBuffer::xsgetn(char* S, std::streamsize N) {
+  std::streamsize Count = std::min(N, std::streamsize(egptr() - gptr()));
+  std::memcpy(S, gptr(), static_cast<size_t>(Count));
+  setg(eback(), gptr() + Count, egptr());
+  return Count;
+}
+
+MemoryInputBuffer::pos_type
+MemoryInputBuffer::seekoff(off_type Off, std::ios_base::seekdir Dir,
+                           std::ios_base::openmode Which) {
+  if (!(Which & std::ios_base::in)) {
+    return pos_type(off_type(-1));
+  }
+  off_type Base = 0;
+  if (Dir == std::ios_base::cur) {
+    Base = gptr() - eback();
+  } else if (Dir == std::ios_base::end) {
+    Base = egptr() - eback();
+  }
+  off_type Target = Base + Off;
+  if (Target < 0 || Target > egptr() - eback()) {
+    return pos_type(off_type(-1));
+  }
+  setg(eback(), eback() + Target, egptr());
+  return pos_type(Target);
+}
+
+MemoryInputBuffer::pos_type
+MemoryInputBuffer::seekpos(pos_type Pos, std::ios_base::openmode Which) {
+  return seekoff(off_type(Pos), std::ios_base::beg, Which);
+}
+
+MappedFile::MappedFile(const char* D, size_t S)
+    : Data(D), Size(S), Buffer(D, S), Stream(&Buffer) {}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+  munmap(const_cast<char*>(Data), Size);
+#endif
+}
+
+void MappedFile::discard(const char* Begin, size_t Length) {
+#ifdef _WIN32
+  (void)Begin;
+  (void)Length;
+#else
+  uintptr_t PageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+  uintptr_t Start = reinterpret_cast<uintptr_t>(Begin);
+  uintptr_t End = Start + Length;
+  Start = (Start + PageSize - 1) & ~(PageSize - 1);
+  End &= ~(PageSize - 1);
+  if (Start < End) {
+    madvise(reinterpret_cast<void*>(Start), End - Start, MADV_DONTNEED);
+  }
+#endif
+}
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string& Path) {
+#ifdef _WIN32
+  (void)Path;
+  return nullptr;
+#else
+  int Fd = ::open(Path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (Fd < 0) {
+    return nullptr;
+  }
+  struct stat Info;
+  if (fstat(Fd, &Info) != 0 || !S_ISREG(Info.st_mode) || Info.st_size == 0) {
+    ::close(Fd);
+    return nullptr;
+  }
+  size_t Size = static_cast<size_t>(Info.st_size);
+#ifdef __linux__
+  // The IR is read once from front to back: start reading it ahead now.
+  posix_fadvise(Fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  void* Addr = mmap(nullptr, Size, PROT_READ, MAP_PRIVATE, Fd, 0);
+  // The mapping keeps its own reference to the file.
+  ::close(Fd);
+  if (Addr == MAP_FAILED) {
+    return nullptr;
+  }
+  madvise(Addr, Size, MADV_SEQUENTIAL);
+  return std::unique_ptr<MappedFile>(
+      new MappedFile(static_cast<const char*>(Addr), Size));
+#endif
+}
@@ -0,0 +1,150 @@
+//===- SerializedIR.cpp -----------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "SerializedIR.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <streambuf>
+
+using namespace gtirb_layout;
+
+// Field numbers of the top-level gtirb.proto.IR message.
+static constexpr uint64_t ModulesField = 3;
+static constexpr uint64_t CfgField = 7;
+
+// The header that precedes the protobuf message in GTIRB files: "GTIRB",
+// two reserved bytes and the protobuf version.
+static constexpr char Magic[] = "GTIRB";
+static constexpr size_t MagicSize = 8;
+
+namespace {
+
+// Reads a sequence of memory spans as one stream without copying them.
+class SpanInputBuffer : public std::streambuf {
+public:
+  explicit SpanInputBuffer(std::vector<std::pair<const char*, size_t>> S)
+      : Spans(std::move(S)) {}
+
+protected:
+  int_type underflow() override {
+    while (Next < Spans.size()) {
+      auto [Data, Size] = Spans[Next++];
+      if (Size > 0) {
+        char* Begin = const_cast<char*>(Data);
+        setg(Begin, Begin, Begin + Size);
+        return traits_type::to_int_type(*gptr());
+      }
+    }
+    return traits_type::eof();
+  }
+
+private:
+  std::vector<std::pair<const char*, size_t>> Spans;
+  size_t Next = 0;
+};
+
+} // namespace
+
+static bool readVarint(const char*& Pos, const char* End, uint64_t& Value) {
+  Value = 0;
+  for (unsigned Shift = 0; Shift < 64 && Pos < End; Shift += 7) {
+    uint8_t Byte = static_cast<uint8_t>(*Pos++);
+    Value |= uint64_t(Byte & 0x7f) << Shift;
+    if ((Byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Skip the value of a field with the given wire type.
+static bool skipValue(const char*& Pos, const char* End, uint64_t WireType) {
+  uint64_t Length;
+  switch (WireType) {
+  case 0: // varint
+    return readVarint(Pos, End, Length);
+  case 1: // 64-bit
+    Length = 8;
+    break;
+  case 2: // length-delimited
+    if (!readVarint(Pos, End, Length)) {
+      return false;
+    }
+    break;
+  case 5: // 32-bit
+    Length = 4;
+    break;
+  default: // groups are not used by GTIRB
+    return false;
+  }
+  if (Length > static_cast<uint64_t>(End - Pos)) {
+    return false;
+  }
+  Pos += Length;
+  return true;
+}
+
+std::optional<SerializedIR> SerializedIR::index(const char* Data,
+                                                size_t Size) {
+  SerializedIR Result;
+  const char* Pos = Data;
+  const char* End = Data + Size;
+  if (Size >= MagicSize && std::memcmp(Data, Magic, sizeof(Magic) - 1) == 0) {
+    Result.Shared.push_back({Data, MagicSize});
+    Pos += MagicSize;
+  }
+
+  while (Pos < End) {
+    const char* Start = Pos;
+    uint64_t Tag;
+    if (!readVarint(Pos, End, Tag) || !skipValue(Pos, End, Tag & 7)) {
+      return std::nullopt;
+    }
+    Span Field{Start, static_cast<size_t>(Pos - Start)};
+    uint64_t Number = Tag >> 3;
+    if (Number == ModulesField) {
+      Result.Modules.push_back(Field);
+    } else if (Number != CfgField) {
+      // Adjacent fields are kept as a single span.
+      if (!Result.Shared.empty() &&
+          Result.Shared.back().Data + Result.Shared.back().Size == Start) {
+        Result.Shared.back().Size += Field.Size;
+      } else {
+        Result.Shared.push_back(Field);
+      }
+    }
+  }
+  return Result;
+}
+
+gtirb::IR* SerializedIR::loadModule(gtirb::Context& Ctx, size_t Index) const {
+  if (Index >= Modules.size()) {
+    return nullptr;
+  }
+  std::vector<std::pair<const char*, size_t>> Spans;
+  for (const Span& S : Shared) {
+    Spans.emplace_back(S.Data, S.Size);
+  }
+  Spans.emplace_back(Modules[Index].Data, Modules[Index].Size);
+
+  SpanInputBuffer Buffer(std::move(Spans));
+  std::istream In(&Buffer);
+  if (gtirb::ErrorOr<gtirb::IR*> IrOrE = gtirb::IR::load(Ctx, In)) {
+    return *IrOrE;
+  }
+  return nullptr;
+}
@@ -4,6 +4,7 @@
 #include <boost/uuid/uuid_io.hpp>
 #include <fstream>
 #include <gtirb/gtirb.hpp>
+#include <gtirb_layout/MappedFile.hpp>
 #include <gtirb_layout/gtirb_layout.hpp>
 #include <iomanip>
 #include <iostream>
@@ -55,9 +56,15 @@ int main(int argc, char** argv) {
     fs::path irPath = irString;
     if (fs::exists(irPath)) {
       LOG_INFO << "Reading GTIRB file: " << irPath << std::endl;
-      std::ifstream in(irPath.string(), std::ios::in | std::ios::binary);
-      if (gtirb::ErrorOr<gtirb::IR*> iOrE = gtirb::IR::load(ctx, in))
-        ir = *iOrE;
+      if (auto mapped = gtirb_layout::MappedFile::open(irPath.string())) {
+        if (gtirb::ErrorOr<gtirb::IR*> iOrE =
+                gtirb::IR::load(ctx, mapped->stream()))
+          ir = *iOrE;
+      } else {
+        std::ifstream in(irPath.string(), std::ios::in | std::ios::binary);
+        if (gtirb::ErrorOr<gtirb::IR*> iOrE = gtirb::IR::load(ctx, in))
+          ir = *iOrE;
+      }
     } else {
       LOG_ERROR << "GTIRB file not found: " << irPath << std::endl;
       return EXIT_FAILURE;
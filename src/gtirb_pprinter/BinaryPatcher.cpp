@@ -0,0 +1,545 @@
+//===- BinaryPatcher.cpp ----------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "BinaryPatcher.hpp"
+
+#include "AuxDataSchema.hpp"
+#include <boost/filesystem.hpp>
+#include <capstone/capstone.h>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <variant>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+namespace gtirb_bprint {
+
+namespace {
+
+// The parts of the ELF specification used here.
+namespace elf {
+constexpr uint16_t ET_DYN = 3;
+constexpr uint16_t EM_386 = 3;
+constexpr uint16_t EM_X86_64 = 62;
+constexpr uint32_t SHT_SYMTAB = 2;
+constexpr uint32_t SHT_RELA = 4;
+constexpr uint32_t SHT_NOBITS = 8;
+constexpr uint32_t SHT_REL = 9;
+constexpr uint32_t SHT_DYNSYM = 11;
+constexpr uint64_t SHF_ALLOC = 0x2;
+constexpr uint64_t SHN_LORESERVE = 0xff00;
+constexpr uint64_t STT_TLS = 6;
+// R_X86_64_RELATIVE and R_386_RELATIVE.
+constexpr uint32_t R_RELATIVE = 8;
+} // namespace elf
+
+struct ElfSection {
+  std::string Name;
+  uint32_t Type;
+  uint64_t Flags;
+  uint64_t Addr;
+  uint64_t Offset;
+  uint64_t Size;
+  uint32_t Link;
+  uint64_t EntrySize;
+};
+
+// A relocation that the loader applies, by where its entry is in the file.
+struct DynamicRelocation {
+  uint64_t Entry;
+  uint32_t Type;
+  bool Addend;
+};
+
+// Where a symbolic expression is in the bytes of its interval.
+struct Field {
+  uint64_t Size;
+  bool PcRelative;
+  // The address the program counter is relative to.
+  uint64_t Pc;
+};
+
+std::string hex(uint64_t Value) {
+  std::ostringstream S;
+  S << "0x" << std::hex << Value;
+  return S.str();
+}
+
+class Patcher {
+public:
+  Patcher(const gtirb::Module& M, std::vector<uint8_t> F)
+      : Module(M), File(std::move(F)), Patched(File) {}
+
+  bool run(std::string& Error);
+
+  const std::vector<uint8_t>& patched() const { return Patched; }
+  size_t relocations() const { return Relocations; }
+
+private:
+  bool readHeaders();
+  bool readRelocations();
+  bool checkSymbols();
+  bool diff(const gtirb::ByteInterval& BI, const ElfSection& Section,
+            std::vector<bool>& Changed);
+  bool fix(const gtirb::ByteInterval& BI, const ElfSection& Section,
+           const std::vector<bool>& Changed);
+  bool fields(const gtirb::ByteInterval& BI,
+              std::map<uint64_t, Field>& Fields) const;
+  std::optional<int64_t> value(const gtirb::SymbolicExpression& SE,
+                               const Field& F) const;
+
+  uint64_t read(uint64_t Offset, size_t Size) const {
+    uint64_t Value = 0;
+    for (size_t I = 0; I < Size; ++I)
+      Value |= uint64_t(File[Offset + I]) << (8 * I);
+    return Value;
+  }
+  void write(uint64_t Offset, uint64_t Value, size_t Size) {
+    for (size_t I = 0; I < Size; ++I)
+      Patched[Offset + I] = static_cast<uint8_t>(Value >> (8 * I));
+  }
+  bool inFile(uint64_t Offset, uint64_t Size) const {
+    return Offset <= File.size() && Size <= File.size() - Offset;
+  }
+  bool fail(const std::string& Message) {
+    Error = Message;
+    return false;
+  }
+
+  const gtirb::Module& Module;
+  std::vector<uint8_t> File;
+  std::vector<uint8_t> Patched;
+  std::string Error;
+
+  bool Is64 = false;
+  bool PositionIndependent = false;
+  std::vector<ElfSection> Sections;
+  std::map<uint64_t, DynamicRelocation> Dynamic;
+  std::set<uint64_t> Handled;
+  size_t Relocations = 0;
+};
+
+bool Patcher::readHeaders() {
+  if (!inFile(0, 64) || File[0] != 0x7f || File[1] != 'E' || File[2] != 'L' ||
+      File[3] != 'F')
+    return fail("the original binary is not an ELF file");
+  Is64 = File[4] == 2;
+  if ((File[4] != 1 && File[4] != 2) || File[5] != 1)
+    return fail("the original binary is not a little-endian ELF file");
+  PositionIndependent = read(16, 2) == elf::ET_DYN;
+  uint16_t Machine = static_cast<uint16_t>(read(18, 2));
+  if (Machine != (Module.getISA() == gtirb::ISA::IA32 ? elf::EM_386
+                                                       : elf::EM_X86_64))
+    return fail("the original binary is not for the module's ISA");
+
+  uint64_t HeadersOffset = Is64 ? read(0x28, 8) : read(0x20, 4);
+  uint64_t HeaderSize = read(Is64 ? 0x3a : 0x2e, 2);
+  uint64_t Count = read(Is64 ? 0x3c : 0x30, 2);
+  uint64_t NamesIndex = read(Is64 ? 0x3e : 0x32, 2);
+  if (HeaderSize < (Is64 ? 64u : 40u) || NamesIndex >= Count ||
+      !inFile(HeadersOffset, Count * HeaderSize))
+    return fail("the section headers of the original binary are invalid");
+
+  std::vector<uint32_t> Names;
+  for (uint64_t I = 0; I < Count; ++I) {
+    uint64_t H = HeadersOffset + I * HeaderSize;
+    ElfSection S;
+    Names.push_back(static_cast<uint32_t>(read(H, 4)));
+    S.Type = static_cast<uint32_t>(read(H + 4, 4));
+    if (Is64) {
+      S.Flags = read(H + 8, 8);
+      S.Addr = read(H + 16, 8);
+      S.Offset = read(H + 24, 8);
+      S.Size = read(H + 32, 8);
+      S.Link = static_cast<uint32_t>(read(H + 40, 4));
+      S.EntrySize = read(H + 56, 8);
+    } else {
+      S.Flags = read(H + 8, 4);
+      S.Addr = read(H + 12, 4);
+      S.Offset = read(H + 16, 4);
+      S.Size = read(H + 20, 4);
+      S.Link = static_cast<uint32_t>(read(H + 24, 4));
+      S.EntrySize = read(H + 36, 4);
+    }
+    if (S.Type != elf::SHT_NOBITS && !inFile(S.Offset, S.Size))
+      return fail("a section of the original binary is outside of it");
+    Sections.push_back(std::move(S));
+  }
+  const ElfSection& Strings = Sections[NamesIndex];
+  for (size_t I = 0; I < Sections.size(); ++I) {
+    for (uint64_t C = Names[I]; C < Strings.Size && File[Strings.Offset + C];
+         ++C)
+      Sections[I].Name.push_back(static_cast<char>(File[Strings.Offset + C]));
+  }
+  return true;
+}
+
+bool Patcher::readRelocations() {
+  for (const ElfSection& S : Sections) {
+    if ((S.Type != elf::SHT_RELA && S.Type != elf::SHT_REL) ||
+        !(S.Flags & elf::SHF_ALLOC))
+      continue;
+    bool Addend = S.Type == elf::SHT_RELA;
+    uint64_t Word = Is64 ? 8 : 4;
+    uint64_t Size = Addend ? 3 * Word : 2 * Word;
+    if (S.EntrySize != Size)
+      return fail("the relocations in " + S.Name + " are invalid");
+    for (uint64_t Entry = S.Offset; Entry + Size <= S.Offset + S.Size;
+         Entry += Size) {
+      uint64_t Info = read(Entry + Word, Word);
+      uint32_t Type = static_cast<uint32_t>(Is64 ? Info & 0xffffffff
+                                                 : Info & 0xff);
+      Dynamic[read(Entry, Word)] = {Entry, Type, Addend};
+    }
+  }
+  return true;
+}
+
+// The symbols of the binary must stay where they are: other binaries refer
+// to the ones it exports by address, and debuggers and profilers read the
+// others. Only the symbols of the module whose names are in the binary are
+// checked, since the module may have symbols of its own, and a symbol may
+// have been given a different name.
+bool Patcher::checkSymbols() {
+  std::map<std::string, std::set<uint64_t>> Addresses;
+  for (const ElfSection& S : Sections) {
+    if ((S.Type != elf::SHT_SYMTAB && S.Type != elf::SHT_DYNSYM) ||
+        S.Link >= Sections.size())
+      continue;
+    const ElfSection& Strings = Sections[S.Link];
+    uint64_t Size = Is64 ? 24 : 16;
+    for (uint64_t Entry = S.Offset; Entry + Size <= S.Offset + S.Size;
+         Entry += Size) {
+      uint64_t Type = read(Entry + (Is64 ? 4 : 12), 1) & 0xf;
+      uint64_t Index = read(Entry + (Is64 ? 6 : 14), 2);
+      uint64_t Value = Is64 ? read(Entry + 8, 8) : read(Entry + 4, 4);
+      // The value of a TLS symbol is an offset, and that of an absolute
+      // one is not an address in the binary.
+      if (Index == 0 || Index >= elf::SHN_LORESERVE || Type == elf::STT_TLS)
+        continue;
+      std::string Name;
+      for (uint64_t C = read(Entry, 4);
+           C < Strings.Size && File[Strings.Offset + C]; ++C)
+        Name.push_back(static_cast<char>(File[Strings.Offset + C]));
+      if (!Name.empty())
+        Addresses[Name].insert(Value);
+    }
+  }
+  for (const gtirb::Symbol& Symbol : Module.symbols()) {
+    std::optional<gtirb::Addr> Addr = Symbol.getAddress();
+    auto It = Addresses.find(Symbol.getName());
+    if (Addr && It != Addresses.end() && !It->second.count(uint64_t(*Addr)))
+      return fail("the symbol " + Symbol.getName() + " moved");
+  }
+  return true;
+}
+
+// Copy the bytes of an interval that differ from the original into the
+// patched binary.
+bool Patcher::diff(const gtirb::ByteInterval& BI, const ElfSection& Section,
+                   std::vector<bool>& Changed) {
+  uint64_t Addr = uint64_t(*BI.getAddress());
+  uint64_t Offset = Section.Offset + (Addr - Section.Addr);
+  const uint8_t* Bytes = BI.rawBytes<uint8_t>();
+  Changed.assign(BI.getSize(), false);
+  for (uint64_t I = 0; I < BI.getSize(); ++I) {
+    uint8_t Byte = I < BI.getInitializedSize() ? Bytes[I] : 0;
+    if (Section.Type == elf::SHT_NOBITS) {
+      if (Byte != 0)
+        return fail("initialized bytes in " + Section.Name +
+                    ", which takes no room in the binary");
+    } else if (File[Offset + I] != Byte) {
+      Patched[Offset + I] = Byte;
+      Changed[I] = true;
+    }
+  }
+  return true;
+}
+
+// The fields of the symbolic expressions of an interval, for the ones whose
+// field can be told.
+bool Patcher::fields(const gtirb::ByteInterval& BI,
+                     std::map<uint64_t, Field>& Fields) const {
+  uint64_t Addr = uint64_t(*BI.getAddress());
+  uint64_t Pointer = Is64 ? 8 : 4;
+  const auto* Sizes =
+      Module.getAuxData<gtirb::schema::SymbolicExpressionSizes>();
+
+  csh Handle;
+  if (cs_open(CS_ARCH_X86, Is64 ? CS_MODE_64 : CS_MODE_32, &Handle) !=
+      CS_ERR_OK)
+    return false;
+  cs_option(Handle, CS_OPT_DETAIL, CS_OPT_ON);
+  cs_insn* Insn = cs_malloc(Handle);
+  for (const gtirb::CodeBlock& Block : BI.code_blocks()) {
+    auto Range = BI.findSymbolicExpressionsAtOffset(
+        Block.getOffset(), Block.getOffset() + Block.getSize());
+    if (Range.begin() == Range.end())
+      continue;
+    std::vector<uint8_t> Bytes(Block.getSize());
+    for (uint64_t I = 0; I < Block.getSize(); ++I) {
+      uint64_t At = Block.getOffset() + I;
+      Bytes[I] = At < BI.getInitializedSize() ? BI.rawBytes<uint8_t>()[At] : 0;
+    }
+    const uint8_t* Code = Bytes.data();
+    size_t Size = Bytes.size();
+    uint64_t Address = Addr + Block.getOffset();
+    while (cs_disasm_iter(Handle, &Code, &Size, &Address, Insn)) {
+      // Operand fields never start an instruction, which also rules out
+      // the offsets that Capstone fails to report.
+      const cs_x86_encoding& Encoding = Insn->detail->x86.encoding;
+      uint64_t Start = Insn->address - Addr;
+      if (Encoding.disp_offset > 0 && Encoding.disp_size > 0) {
+        bool PcRelative = false;
+        for (uint8_t I = 0; I < Insn->detail->x86.op_count; ++I) {
+          const cs_x86_op& Op = Insn->detail->x86.operands[I];
+          if (Op.type == X86_OP_MEM &&
+              (Op.mem.base == X86_REG_RIP || Op.mem.base == X86_REG_EIP))
+            PcRelative = true;
+        }
+        Fields[Start + Encoding.disp_offset] = {Encoding.disp_size, PcRelative,
+                                                Address};
+      }
+      if (Encoding.imm_offset > 0 && Encoding.imm_size > 0)
+        Fields[Start + Encoding.imm_offset] = {
+            Encoding.imm_size,
+            cs_insn_group(Handle, Insn, CS_GRP_BRANCH_RELATIVE), Address};
+    }
+  }
+  cs_free(Insn, 1);
+  cs_close(&Handle);
+
+  // The size of a data field is recorded, or is that of a pointer.
+  for (const gtirb::DataBlock& Block : BI.data_blocks()) {
+    for (const auto& SEE : BI.findSymbolicExpressionsAtOffset(
+             Block.getOffset(), Block.getOffset() + Block.getSize())) {
+      uint64_t Size = Pointer;
+      if (Sizes) {
+        if (auto It = Sizes->find(gtirb::Offset(BI.getUUID(), SEE.getOffset()));
+            It != Sizes->end())
+          Size = It->second;
+      }
+      Fields[SEE.getOffset()] = {Size, false, 0};
+    }
+  }
+  return true;
+}
+
+// The value of a field, from the addresses of the expression's symbols, or
+// std::nullopt if it depends on more than those.
+std::optional<int64_t> Patcher::value(const gtirb::SymbolicExpression& SE,
+                                      const Field& F) const {
+  if (const auto* SAC = std::get_if<gtirb::SymAddrConst>(&SE)) {
+    const gtirb::SymAttributeSet& A = SAC->Attributes;
+    if (A.isFlagSet(gtirb::SymAttribute::GotRef) ||
+        A.isFlagSet(gtirb::SymAttribute::GotRelPC) ||
+        A.isFlagSet(gtirb::SymAttribute::PltRef) ||
+        A.isFlagSet(gtirb::SymAttribute::Part0) ||
+        A.isFlagSet(gtirb::SymAttribute::Part1) ||
+        A.isFlagSet(gtirb::SymAttribute::Part2) ||
+        A.isFlagSet(gtirb::SymAttribute::Part3))
+      return std::nullopt;
+    std::optional<gtirb::Addr> Addr = SAC->Sym->getAddress();
+    if (!Addr)
+      return std::nullopt;
+    uint64_t Value = uint64_t(*Addr) + static_cast<uint64_t>(SAC->Offset);
+    if (F.PcRelative)
+      Value -= F.Pc;
+    return static_cast<int64_t>(Value);
+  }
+  const auto& SAA = std::get<gtirb::SymAddrAddr>(SE);
+  std::optional<gtirb::Addr> A1 = SAA.Sym1->getAddress();
+  std::optional<gtirb::Addr> A2 = SAA.Sym2->getAddress();
+  if (!A1 || !A2 || SAA.Scale == 0 || F.PcRelative)
+    return std::nullopt;
+  return static_cast<int64_t>(uint64_t(*A1) - uint64_t(*A2)) / SAA.Scale +
+         SAA.Offset;
+}
+
+// Recompute the fields of the symbolic expressions of an interval from the
+// addresses of their symbols, where they differ from the binary.
+bool Patcher::fix(const gtirb::ByteInterval& BI, const ElfSection& Section,
+                  const std::vector<bool>& Changed) {
+  std::map<uint64_t, Field> Fields;
+  if (!this->fields(BI, Fields))
+    return fail("cannot open capstone");
+  uint64_t Addr = uint64_t(*BI.getAddress());
+  uint64_t Offset = Section.Offset + (Addr - Section.Addr);
+  uint64_t Pointer = Is64 ? 8 : 4;
+  if (Section.Type == elf::SHT_NOBITS)
+    return true;
+
+  for (const auto& SEE : BI.symbolic_expressions()) {
+    const gtirb::SymbolicExpression& SE = SEE.getSymbolicExpression();
+    uint64_t At = SEE.getOffset();
+    std::string Where = hex(Addr + At);
+    auto It = Fields.find(At);
+    uint64_t Size = It != Fields.end() ? It->second.Size : 1;
+    bool Touched = false;
+    for (uint64_t I = At; I < At + Size && I < Changed.size(); ++I)
+      Touched = Touched || Changed[I];
+    std::optional<int64_t> Value;
+    if (It != Fields.end() && Size <= 8 && At + Size <= BI.getSize())
+      Value = value(SE, It->second);
+    auto R = Dynamic.find(Addr + At);
+    if (R != Dynamic.end())
+      Handled.insert(Addr + At);
+
+    // Fields that cannot be recomputed are only kept as they were.
+    if (!Value) {
+      if (Touched)
+        return fail("cannot recompute the changed reference at " + Where);
+      continue;
+    }
+    const Field& F = It->second;
+    uint64_t Mask = Size == 8 ? ~uint64_t(0) : (uint64_t(1) << 8 * Size) - 1;
+    uint64_t Expected = static_cast<uint64_t>(*Value) & Mask;
+    uint64_t Current = 0;
+    for (uint64_t I = 0; I < Size; ++I)
+      Current |= uint64_t(Patched[Offset + At + I]) << (8 * I);
+
+    // The loader writes the fields it relocates, so only the addend of a
+    // relative relocation can be changed.
+    if (R != Dynamic.end()) {
+      bool Relative = R->second.Type == elf::R_RELATIVE && !F.PcRelative &&
+                      Size == Pointer &&
+                      std::holds_alternative<gtirb::SymAddrConst>(SE);
+      if (!Relative) {
+        if (Touched)
+          return fail("the loader relocates the changed reference at " +
+                      Where);
+        continue;
+      }
+      uint64_t AddendAt = R->second.Entry + 2 * Pointer;
+      if (R->second.Addend)
+        Current = read(AddendAt, Pointer) & Mask;
+      if (Current != Expected) {
+        if (R->second.Addend)
+          write(AddendAt, Expected, Pointer);
+        write(Offset + At, Expected, Pointer);
+        ++Relocations;
+      }
+      continue;
+    }
+
+    if (Current == Expected)
+      continue;
+    // A new pointer would need a relocation the binary does not have.
+    if (PositionIndependent && !F.PcRelative &&
+        std::holds_alternative<gtirb::SymAddrConst>(SE))
+      return fail("the changed reference at " + Where +
+                  " needs a dynamic relocation");
+    int64_t Limit = Size == 8 ? 0 : int64_t(1) << (8 * Size - 1);
+    if (Size < 8 && (*Value < -Limit || *Value >= 2 * Limit))
+      return fail("the changed reference at " + Where + " is out of range");
+    write(Offset + At, Expected, Size);
+  }
+
+  // Changed bytes that the loader relocates must be references.
+  for (auto R = Dynamic.lower_bound(Addr);
+       R != Dynamic.end() && R->first < Addr + BI.getSize(); ++R) {
+    if (Handled.count(R->first))
+      continue;
+    for (uint64_t I = R->first - Addr;
+         I < R->first - Addr + Pointer && I < Changed.size(); ++I)
+      if (Changed[I])
+        return fail("the loader relocates the changed bytes at " +
+                    hex(R->first));
+  }
+  return true;
+}
+
+bool Patcher::run(std::string& Message) {
+  bool Ok = readHeaders() && readRelocations() && checkSymbols();
+  for (const gtirb::Section& S : Module.sections()) {
+    if (!Ok)
+      break;
+    const ElfSection* Section = nullptr;
+    for (const ElfSection& E : Sections)
+      if (E.Name == S.getName() && (E.Flags & elf::SHF_ALLOC))
+        Section = &E;
+    std::optional<gtirb::Addr> Addr = S.getAddress();
+    std::optional<uint64_t> Size = S.getSize();
+    if (!Section) {
+      Ok = fail("section " + S.getName() + " is not in the original binary");
+    } else if (!Addr || !Size || uint64_t(*Addr) != Section->Addr ||
+               *Size != Section->Size) {
+      Ok = fail("section " + S.getName() + " moved or changed size");
+    }
+    for (const gtirb::ByteInterval& BI : S.byte_intervals()) {
+      if (!Ok)
+        break;
+      std::vector<bool> Changed;
+      Ok = diff(BI, *Section, Changed) && fix(BI, *Section, Changed);
+    }
+  }
+  if (!Ok)
+    Message = Error;
+  return Ok;
+}
+
+} // namespace
+
+bool BinaryPatcher::patch(const gtirb::Module& Module,
+                          const std::string& Output, std::string& Error) {
+  PatchedBytes = 0;
+  PatchedRelocations = 0;
+  if (Module.getFileFormat() != gtirb::FileFormat::ELF ||
+      (Module.getISA() != gtirb::ISA::X64 &&
+       Module.getISA() != gtirb::ISA::IA32)) {
+    Error = "only x86 ELF binaries can be patched";
+    return false;
+  }
+  std::string Path = Original.empty() ? Module.getBinaryPath() : Original;
+  std::ifstream In(Path, std::ios::binary);
+  if (Path.empty() || !In) {
+    Error = "cannot read the original binary '" + Path + "'";
+    return false;
+  }
+  std::vector<uint8_t> File((std::istreambuf_iterator<char>(In)),
+                            std::istreambuf_iterator<char>());
+
+  Patcher P(Module, std::move(File));
+  if (!P.run(Error))
+    return false;
+
+  std::ofstream Out(Output, std::ios::binary | std::ios::trunc);
+  const std::vector<uint8_t>& Patched = P.patched();
+  Out.write(reinterpret_cast<const char*>(Patched.data()),
+            static_cast<std::streamsize>(Patched.size()));
+  Out.close();
+  if (!Out) {
+    std::remove(Output.c_str());
+    Error = "cannot write " + Output;
+    return false;
+  }
+  // The patched binary runs as the original did.
+  boost::system::error_code EC;
+  fs::permissions(Output, fs::status(Path, EC).permissions(), EC);
+
+  std::ifstream Check(Path, std::ios::binary);
+  for (uint8_t Byte : Patched) {
+    if (static_cast<uint8_t>(Check.get()) != Byte)
+      ++PatchedBytes;
+  }
+  PatchedRelocations = P.relocations();
+  return true;
+}
+
+} // namespace gtirb_bprint
@@ -14,8 +14,20 @@
 //===----------------------------------------------------------------------===//
 #include "BinaryPrinter.hpp"
 #include "file_utils.hpp"
+#include <ostream>
 
 namespace gtirb_bprint {
+uint64_t BinaryPrinter::estimateSourceSize(const gtirb::Module& mod) {
+  // Machine-profile assembly takes about this many characters per byte of
+  // code or data.
+  constexpr uint64_t CharsPerByte = 12;
+  uint64_t Size = 0;
+  for (const gtirb::Section& Section : mod.sections())
+    if (std::optional<uint64_t> SectionSize = Section.getSize())
+      Size += *SectionSize;
+  return Size * CharsPerByte;
+}
+
 bool BinaryPrinter::prepareSource(gtirb::Context& ctx, gtirb::Module& mod,
                                   TempFile& tempFile) const {
   if (tempFile.isOpen()) {
@@ -26,16 +38,98 @@ bool BinaryPrinter::prepareSource(gtirb::Context& ctx, gtirb::Module& mod,
   return false;
 }
 
+bool BinaryPrinter::prepareCompressedSource(gtirb::Context& ctx,
+                                            gtirb::Module& mod,
+                                            TempFile& tempFile) const {
+  tempFile.close();
+  auto Buf = gtirb_pprint::CompressedOutputBuffer::open(tempFile.fileName(),
+                                                        SourceCompression);
+  if (!Buf)
+    return false;
+  std::ostream Out(Buf.get());
+  Printer.print(Out, ctx, mod);
+  bool Written = Buf->close() && Out;
+  // Account for the compressed assembly, which was written by name.
+  tempFile.close();
+  return Written;
+}
+
+std::optional<int>
+BinaryPrinter::executeTool(const std::string& tool,
+                           const std::vector<std::string>& args) const {
+  ProcessUsage usage;
+  std::optional<int> ret = execute(tool, args, &usage);
+  if (ret) {
+    std::lock_guard<std::mutex> lock(RunsMutex);
+    Runs.push_back({tool, usage});
+  }
+  return ret;
+}
+
+std::optional<int> BinaryPrinter::executeTool(
+    const std::string& tool, const std::vector<std::string>& args,
+    const std::function<bool(std::ostream&)>& writeInput) const {
+  ProcessUsage usage;
+  std::optional<int> ret = execute(tool, args, writeInput, &usage);
+  if (ret) {
+    std::lock_guard<std::mutex> lock(RunsMutex);
+    Runs.push_back({tool, usage});
+  }
+  return ret;
+}
+
+std::optional<int> BinaryPrinter::executeTool(
+    const std::string& tool, const std::vector<std::string>& args,
+    const std::vector<std::string>& fifos,
+    const std::function<bool(size_t, std::ostream&)>& writeInput) const {
+  ProcessUsage usage;
+  std::optional<int> ret = execute(tool, args, fifos, writeInput, &usage);
+  if (ret) {
+    std::lock_guard<std::mutex> lock(RunsMutex);
+    Runs.push_back({tool, usage});
+  }
+  return ret;
+}
+
+std::optional<int>
+BinaryPrinter::executeCached(const std::string& tool,
+                             const std::vector<std::string>& args,
+                             const std::vector<std::string>& inputs,
+                             const std::string& output) const {
+  if (!Cache)
+    return executeTool(tool, args);
+
+  std::optional<gtirb_pprint::Fingerprint> Key =
+      Cache->key(tool, args, inputs, output);
+  if (Key && Cache->fetch(*Key, output))
+    return 0;
+  std::optional<int> Ret = executeTool(tool, args);
+  if (Key && Ret && *Ret == 0)
+    Cache->store(*Key, output);
+  return Ret;
+}
+
 bool BinaryPrinter::prepareSources(gtirb::Context& ctx, gtirb::IR& ir,
                                    std::vector<TempFile>& tempFiles) const {
-  tempFiles = std::vector<TempFile>(
-      std::distance(ir.modules().begin(), ir.modules().end()));
-  int i = 0;
+  tempFiles.clear();
   for (gtirb::Module& module : ir.modules()) {
-    if (!prepareSource(ctx, module, tempFiles[i]))
+    tempFiles.emplace_back(".s", estimateSourceSize(module));
+    if (!prepareSource(ctx, module, tempFiles.back()))
       return false;
-    ++i;
   }
   return true;
 }
+
+void BinaryPrinter::startLink() {
+  Steps.clear();
+  std::lock_guard<std::mutex> lock(RunsMutex);
+  Runs.clear();
+}
+
+void BinaryPrinter::recordStep(const std::string& name,
+                               std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  Steps.push_back({name, elapsed.count()});
+}
 } // namespace gtirb_bprint
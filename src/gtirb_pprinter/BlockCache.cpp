@@ -0,0 +1,181 @@
+//===- BlockCache.cpp -------------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "BlockCache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using namespace gtirb_pprint;
+
+static constexpr char CacheMagic[8] = {'G', 'T', 'P', 'P', 'B', 'C', '0', '1'};
+
+// The flags stored with each entry.
+static constexpr char InProcedureFlag = 1;
+static constexpr char AdvancesPCFlag = 2;
+
+static uint64_t rotl(uint64_t X, int R) { return (X << R) | (X >> (64 - R)); }
+
+// The MurmurHash3 finalizer.
+static uint64_t fmix(uint64_t K) {
+  K ^= K >> 33;
+  K *= 0xff51afd7ed558ccdULL;
+  K ^= K >> 33;
+  K *= 0xc4ceb9fe1a85ec53ULL;
+  K ^= K >> 33;
+  return K;
+}
+
+void FingerprintBuilder::addWord(uint64_t Word) {
+  // The block mixing of MurmurHash3_x64_128, one word at a time.
+  uint64_t K1 = Word * 0x87c37b91114253d5ULL;
+  K1 = rotl(K1, 31) * 0x4cf5ad432745937fULL;
+  H1 ^= K1;
+  H1 = (rotl(H1, 27) + H2) * 5 + 0x52dce729;
+  uint64_t K2 = Word * 0x4cf5ad432745937fULL;
+  K2 = rotl(K2, 33) * 0x87c37b91114253d5ULL;
+  H2 ^= K2;
+  H2 = (rotl(H2, 31) + H1) * 5 + 0x38495ab5;
+}
+
+void FingerprintBuilder::add(const void* Data, size_t Size) {
+  const char* Bytes = static_cast<const char*>(Data);
+  Length += Size;
+  for (; Size >= 8; Bytes += 8, Size -= 8) {
+    uint64_t Word;
+    std::memcpy(&Word, Bytes, 8);
+    addWord(Word);
+  }
+  if (Size > 0) {
+    uint64_t Word = 0;
+    std::memcpy(&Word, Bytes, Size);
+    addWord(Word ^ (uint64_t(Size) << 56));
+  }
+}
+
+void FingerprintBuilder::add(uint64_t Value) {
+  Length += sizeof(Value);
+  addWord(Value);
+}
+
+Fingerprint FingerprintBuilder::get() const {
+  uint64_t A = H1 ^ Length;
+  uint64_t B = H2 ^ Length;
+  A += B;
+  B += A;
+  A = fmix(A);
+  B = fmix(B);
+  A += B;
+  B += A;
+  return Fingerprint{A, B};
+}
+
+const BlockCache::Entry* BlockCache::find(const Fingerprint& Key) {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  auto It = Entries.find(Key);
+  if (It == Entries.end()) {
+    ++Misses;
+    return nullptr;
+  }
+  ++Hits;
+  It->second.Used = true;
+  return &It->second;
+}
+
+void BlockCache::insert(const Fingerprint& Key, std::string Text,
+                        bool InProcedure, bool AdvancesPC) {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  // Equal fingerprints print the same text, so an entry that another printer
+  // inserted in the meantime is kept, and may still be read.
+  auto [It, Inserted] = Entries.try_emplace(Key);
+  Entry& E = It->second;
+  if (Inserted) {
+    E.Text = std::move(Text);
+    E.InProcedure = InProcedure;
+    E.AdvancesPC = AdvancesPC;
+  }
+  E.Used = true;
+}
+
+bool BlockCache::load(const std::string& Path) {
+  std::ifstream In(Path, std::ios::binary | std::ios::ate);
+  if (!In) {
+    return false;
+  }
+  std::streamoff FileSize = In.tellg();
+  In.seekg(0);
+  char Magic[sizeof(CacheMagic)];
+  if (!In.read(Magic, sizeof(Magic)) ||
+      std::memcmp(Magic, CacheMagic, sizeof(Magic)) != 0) {
+    return false;
+  }
+  while (In.peek() != std::ifstream::traits_type::eof()) {
+    Fingerprint Key;
+    uint64_t Size;
+    char Flags;
+    if (!In.read(reinterpret_cast<char*>(&Key.High), sizeof(Key.High)) ||
+        !In.read(reinterpret_cast<char*>(&Key.Low), sizeof(Key.Low)) ||
+        !In.get(Flags) ||
+        !In.read(reinterpret_cast<char*>(&Size), sizeof(Size))) {
+      return false;
+    }
+    // A damaged size must not make us allocate more than the file holds.
+    if (Size > static_cast<uint64_t>(FileSize - In.tellg())) {
+      return false;
+    }
+    std::string Text(Size, '\0');
+    if (!In.read(&Text[0], static_cast<std::streamsize>(Size))) {
+      return false;
+    }
+    Entry& E = Entries[Key];
+    E.Text = std::move(Text);
+    E.InProcedure = (Flags & InProcedureFlag) != 0;
+    E.AdvancesPC = (Flags & AdvancesPCFlag) != 0;
+  }
+  return true;
+}
+
+bool BlockCache::save(const std::string& Path) const {
+  // Write a new file and move it into place, so that a failed write does not
+  // leave a truncated cache behind.
+  std::string TempPath = Path + ".tmp";
+  {
+    std::ofstream Out(TempPath, std::ios::binary | std::ios::trunc);
+    Out.write(CacheMagic, sizeof(CacheMagic));
+    for (const auto& [Key, E] : Entries) {
+      if (!E.Used) {
+        continue;
+      }
+      uint64_t Size = E.Text.size();
+      Out.write(reinterpret_cast<const char*>(&Key.High), sizeof(Key.High));
+      Out.write(reinterpret_cast<const char*>(&Key.Low), sizeof(Key.Low));
+      Out.put(static_cast<char>((E.InProcedure ? InProcedureFlag : 0) |
+                                (E.AdvancesPC ? AdvancesPCFlag : 0)));
+      Out.write(reinterpret_cast<const char*>(&Size), sizeof(Size));
+      Out.write(E.Text.data(), static_cast<std::streamsize>(Size));
+    }
+    Out.close();
+    if (!Out) {
+      std::remove(TempPath.c_str());
+      return false;
+    }
+  }
+  if (std::rename(TempPath.c_str(), Path.c_str()) == 0) {
+    return true;
+  }
+  // Windows does not replace an existing file.
+  std::remove(Path.c_str());
+  return std::rename(TempPath.c_str(), Path.c_str()) == 0;
+}
@@ -0,0 +1,475 @@
+//===- CoffObjectPrinter.cpp ------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "CoffObjectPrinter.hpp"
+
+#include "AuxDataSchema.hpp"
+#include "ObjectLayout.hpp"
+#include "PePrettyPrinter.hpp"
+#include <boost/algorithm/string/replace.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <optional>
+#include <unordered_set>
+#include <variant>
+
+namespace gtirb_bprint {
+
+namespace {
+
+// The parts of the PE/COFF specification used here.
+namespace coff {
+constexpr uint16_t IMAGE_FILE_MACHINE_AMD64 = 0x8664;
+
+constexpr uint32_t IMAGE_SCN_LNK_INFO = 0x00000200;
+constexpr uint32_t IMAGE_SCN_LNK_REMOVE = 0x00000800;
+constexpr uint32_t IMAGE_SCN_LNK_NRELOC_OVFL = 0x01000000;
+// The characteristics of an image's section that an object's section
+// carries.
+constexpr uint32_t ContentFlags =
+    gtirb_pprint::IMAGE_SCN_CNT_CODE |
+    gtirb_pprint::IMAGE_SCN_CNT_INITIALIZED_DATA |
+    gtirb_pprint::IMAGE_SCN_CNT_UNINITIALIZED_DATA |
+    gtirb_pprint::IMAGE_SCN_MEM_DISCARDABLE |
+    gtirb_pprint::IMAGE_SCN_MEM_NOT_CACHED |
+    gtirb_pprint::IMAGE_SCN_MEM_NOT_PAGED | gtirb_pprint::IMAGE_SCN_MEM_SHARED |
+    gtirb_pprint::IMAGE_SCN_MEM_EXECUTE | gtirb_pprint::IMAGE_SCN_MEM_READ |
+    gtirb_pprint::IMAGE_SCN_MEM_WRITE;
+
+constexpr uint16_t IMAGE_REL_AMD64_ADDR64 = 0x1;
+constexpr uint16_t IMAGE_REL_AMD64_ADDR32 = 0x2;
+constexpr uint16_t IMAGE_REL_AMD64_ADDR32NB = 0x3;
+constexpr uint16_t IMAGE_REL_AMD64_REL32 = 0x4;
+
+constexpr uint8_t IMAGE_SYM_CLASS_EXTERNAL = 2;
+constexpr uint8_t IMAGE_SYM_CLASS_STATIC = 3;
+constexpr uint16_t IMAGE_SYM_DTYPE_FUNCTION = 0x20;
+
+constexpr size_t FileHeaderSize = 20;
+constexpr size_t SectionHeaderSize = 40;
+constexpr size_t SymbolSize = 18;
+} // namespace coff
+
+// What a relocation refers to: a section, or a symbol by name.
+using RelocationTarget = std::variant<size_t, std::string>;
+
+struct Relocation {
+  uint32_t Offset;
+  uint16_t Type;
+  RelocationTarget Target;
+};
+
+// The COFF side of a section of the layout.
+struct OutputSection {
+  std::string Name;
+  uint32_t Characteristics;
+  std::vector<Relocation> Relocations;
+};
+
+class Writer {
+public:
+  Writer(gtirb::Context& C, gtirb::Module& M, ObjectLayout& L)
+      : Context(C), Module(M), Layout(L) {}
+
+  bool run(const std::string& Output, std::string& Error);
+
+private:
+  void findExports();
+  bool describeSections();
+  bool relocate(const ObjectLayout::Reference& Ref);
+  bool write(const std::string& Output);
+
+  RelocationTarget target(const gtirb::Symbol& Symbol, const std::string& Name,
+                          int64_t& Addend);
+  bool isImageBase(const gtirb::Symbol& Symbol) const {
+    return Symbol.getName() == "__ImageBase";
+  }
+  bool fail(const std::string& Message) {
+    Error = Message;
+    return false;
+  }
+
+  gtirb::Context& Context;
+  gtirb::Module& Module;
+  ObjectLayout& Layout;
+  std::string Error;
+
+  std::vector<OutputSection> Sections;
+  // The defined symbols that other objects see, and the code among them,
+  // which is exported by the object.
+  std::unordered_set<const gtirb::Symbol*> Exports;
+  std::map<std::string, const gtirb::Symbol*> Defined;
+  std::set<std::string> Undefined;
+};
+
+void Writer::findExports() {
+  if (gtirb::CodeBlock* Block = Module.getEntryPoint();
+      Block && Block->getAddress()) {
+    auto EntrySymbols = Module.findSymbols(*Block->getAddress());
+    if (EntrySymbols.empty()) {
+      auto* EntryPoint = gtirb::Symbol::Create(
+          Context, *Block->getAddress(), "__EntryPoint");
+      EntryPoint->setReferent<gtirb::CodeBlock>(Block);
+      Module.addSymbol(EntryPoint);
+      Exports.insert(EntryPoint);
+    } else {
+      Exports.insert(&*EntrySymbols.begin());
+    }
+  }
+  if (const auto* Exported =
+          Module.getAuxData<gtirb::schema::PeExportedSymbols>()) {
+    for (const gtirb::UUID& Id : *Exported)
+      if (const auto* Symbol = dyn_cast_or_null<gtirb::Symbol>(
+              gtirb::Node::getByUUID(Context, Id)))
+        Exports.insert(Symbol);
+  }
+  for (const gtirb::Symbol* Symbol : Exports)
+    if (Layout.locate(*Symbol))
+      Defined.emplace(Symbol->getName(), Symbol);
+}
+
+bool Writer::describeSections() {
+  const auto* Properties =
+      Module.getAuxData<gtirb::schema::PeSectionProperties>();
+  for (ObjectLayout::Section& Laid : Layout.sections()) {
+    OutputSection Out{Laid.Source->getName(),
+                      gtirb_pprint::IMAGE_SCN_MEM_READ};
+    if (Properties) {
+      if (auto It = Properties->find(Laid.Source->getUUID());
+          It != Properties->end())
+        Out.Characteristics = static_cast<uint32_t>(It->second) &
+                              coff::ContentFlags;
+    }
+    if (!Laid.ZeroFill)
+      Out.Characteristics &= ~gtirb_pprint::IMAGE_SCN_CNT_UNINITIALIZED_DATA;
+    else if (!(Out.Characteristics &
+               gtirb_pprint::IMAGE_SCN_CNT_UNINITIALIZED_DATA))
+      Laid.Bytes.resize(Laid.Size, 0);
+    if (!(Out.Characteristics &
+          (gtirb_pprint::IMAGE_SCN_CNT_CODE |
+           gtirb_pprint::IMAGE_SCN_CNT_INITIALIZED_DATA |
+           gtirb_pprint::IMAGE_SCN_CNT_UNINITIALIZED_DATA)))
+      Out.Characteristics |= gtirb_pprint::IMAGE_SCN_CNT_INITIALIZED_DATA;
+
+    // IMAGE_SCN_ALIGN_1BYTES to IMAGE_SCN_ALIGN_8192BYTES.
+    uint32_t Log = 0;
+    while ((uint64_t(1) << Log) < Laid.Alignment)
+      ++Log;
+    if (Log > 13)
+      return fail("alignment of " + Out.Name + " too large");
+    Out.Characteristics |= (Log + 1) << 20;
+    Sections.push_back(std::move(Out));
+  }
+  return true;
+}
+
+// What a relocation against a symbol refers to, by the name it has in the
+// object if it is not defined in it. Symbols that are not exported are
+// referred to through their section, as ml64 does.
+RelocationTarget Writer::target(const gtirb::Symbol& Symbol,
+                                const std::string& Name, int64_t& Addend) {
+  std::optional<ObjectLayout::Location> Where;
+  if (!isImageBase(Symbol))
+    Where = Layout.locate(Symbol);
+  if (Where && !Exports.count(&Symbol)) {
+    Addend += static_cast<int64_t>(Where->Offset);
+    return Where->Section;
+  }
+  if (!Where)
+    Undefined.insert(Name);
+  return Name;
+}
+
+bool Writer::relocate(const ObjectLayout::Reference& Ref) {
+  OutputSection& Out = Sections[Ref.Field.Section];
+  uint64_t Field = Ref.Field.Offset;
+  const gtirb::Symbol& Symbol = *Ref.Symbol;
+  if (Field > UINT32_MAX)
+    return fail(Out.Name + " too large");
+
+  // References to imports are to the thunk that jumps to them, or to the
+  // entry of the import address table that holds them.
+  std::string Name = Symbol.getName();
+  if (Ref.Symbol != Ref.Original && Ref.Code && !Ref.Branch &&
+      !Ref.Original->getReferent<gtirb::CodeBlock>())
+    Name = "__imp_" + Name;
+
+  // COFF relocations take their addend from the field.
+  int64_t Addend = Ref.Addend;
+  uint16_t Type;
+  std::optional<ObjectLayout::Location> To;
+  if (!isImageBase(Symbol))
+    To = Layout.locate(Symbol);
+  switch (Ref.Kind) {
+  case ObjectLayout::ReferenceKind::Absolute:
+    if (Ref.Size != 4 && Ref.Size != 8)
+      return fail("unsupported reference to " + Symbol.getName() + " in " +
+                  Out.Name);
+    Type = Ref.Size == 8 ? coff::IMAGE_REL_AMD64_ADDR64
+                         : coff::IMAGE_REL_AMD64_ADDR32;
+    break;
+  case ObjectLayout::ReferenceKind::PcRelative:
+    // References within a section are resolved in place.
+    if (To && To->Section == Ref.Field.Section) {
+      int64_t Value = static_cast<int64_t>(To->Offset) + Addend -
+                      static_cast<int64_t>(Field);
+      if (!ObjectLayout::fits(Value, Ref.Size))
+        return fail("reference to " + Symbol.getName() + " out of range in " +
+                    Out.Name);
+      Layout.store(Ref.Field, Value, Ref.Size);
+      return true;
+    }
+    if (Ref.Size != 4)
+      return fail("unsupported reference to " + Symbol.getName() + " in " +
+                  Out.Name);
+    // REL32 is relative to the end of the field, whatever follows it.
+    Type = coff::IMAGE_REL_AMD64_REL32;
+    Addend += 4;
+    break;
+  case ObjectLayout::ReferenceKind::Difference:
+    if (isImageBase(*Ref.Base) && Ref.Size == 4) {
+      Type = coff::IMAGE_REL_AMD64_ADDR32NB;
+    } else if (std::optional<ObjectLayout::Location> From =
+                   Layout.locate(*Ref.Base);
+               From && From->Section == Ref.Field.Section && Ref.Size == 4) {
+      // S1 - S2 is S1 - P, plus the known distance from S2 to P.
+      Type = coff::IMAGE_REL_AMD64_REL32;
+      Addend += static_cast<int64_t>(Field) + 4 -
+                static_cast<int64_t>(From->Offset);
+    } else {
+      return fail("unsupported symbol difference in " + Out.Name);
+    }
+    break;
+  }
+  RelocationTarget Target = target(Symbol, Name, Addend);
+  if (!ObjectLayout::fits(Addend, Ref.Size))
+    return fail("addend out of range in " + Out.Name);
+  Layout.store(Ref.Field, Addend, Ref.Size);
+  Out.Relocations.push_back(
+      {static_cast<uint32_t>(Field), Type, std::move(Target)});
+  return true;
+}
+
+class StringTable {
+public:
+  // The offset of a name in the table, which starts with its size.
+  uint32_t add(const std::string& S) {
+    auto [It, Inserted] = Offsets.emplace(S, 0);
+    if (Inserted) {
+      It->second = static_cast<uint32_t>(4 + Data.size());
+      Data.insert(Data.end(), S.begin(), S.end());
+      Data.push_back(0);
+    }
+    return It->second;
+  }
+  std::vector<uint8_t> Data;
+
+private:
+  std::map<std::string, uint32_t> Offsets;
+};
+
+bool Writer::write(const std::string& Output) {
+  // The linker directives: the import libraries, as the INCLUDELIB of the
+  // MASM printer, and the exported functions, as its PROC EXPORT.
+  std::string Directives;
+  if (const auto* Libraries = Module.getAuxData<gtirb::schema::Libraries>()) {
+    for (const std::string& Library : *Libraries)
+      Directives += " /DEFAULTLIB:\"" +
+                    boost::ireplace_last_copy(Library, ".dll", ".lib") + "\"";
+  }
+  for (const auto& [Name, Symbol] : Defined)
+    if (Symbol->getReferent<gtirb::CodeBlock>())
+      Directives += " /EXPORT:" + Name;
+  size_t Count = Sections.size() + (Directives.empty() ? 0 : 1);
+  if (Count > 0x7fff)
+    return fail("too many sections");
+
+  // The symbols: one per section, with its auxiliary record, then the
+  // defined ones, and the undefined ones.
+  StringTable Strings;
+  ObjectEncoder Symbols;
+  auto addSymbol = [&](const std::string& Name, uint32_t Value,
+                       int16_t Section, uint16_t Type, uint8_t Class,
+                       uint8_t Aux) {
+    if (Name.size() > 8) {
+      Symbols.u32(0);
+      Symbols.u32(Strings.add(Name));
+    } else {
+      for (size_t I = 0; I < 8; ++I)
+        Symbols.u8(I < Name.size() ? static_cast<uint8_t>(Name[I]) : 0);
+    }
+    Symbols.u32(Value);
+    Symbols.u16(static_cast<uint16_t>(Section));
+    Symbols.u16(Type);
+    Symbols.u8(Class);
+    Symbols.u8(Aux);
+  };
+  std::vector<ObjectLayout::Section>& Laid = Layout.sections();
+  for (size_t I = 0; I < Sections.size(); ++I) {
+    addSymbol(Sections[I].Name, 0, static_cast<int16_t>(I + 1), 0,
+              coff::IMAGE_SYM_CLASS_STATIC, 1);
+    Symbols.u32(static_cast<uint32_t>(Laid[I].Size));
+    Symbols.u16(static_cast<uint16_t>(
+        std::min<size_t>(Sections[I].Relocations.size(), 0xffff)));
+    Symbols.u16(0);
+    Symbols.u32(0);
+    Symbols.u16(static_cast<uint16_t>(I + 1));
+    Symbols.u8(0);
+    Symbols.u8(0);
+    Symbols.u16(0);
+  }
+  std::map<std::string, uint32_t> SymbolIndex;
+  uint32_t Index = static_cast<uint32_t>(2 * Sections.size());
+  for (const auto& [Name, Symbol] : Defined) {
+    ObjectLayout::Location Where = *Layout.locate(*Symbol);
+    SymbolIndex.emplace(Name, Index++);
+    addSymbol(Name, static_cast<uint32_t>(Where.Offset),
+              static_cast<int16_t>(Where.Section + 1),
+              Symbol->getReferent<gtirb::CodeBlock>()
+                  ? coff::IMAGE_SYM_DTYPE_FUNCTION
+                  : 0,
+              coff::IMAGE_SYM_CLASS_EXTERNAL, 0);
+  }
+  for (const std::string& Name : Undefined) {
+    if (!SymbolIndex.emplace(Name, Index).second)
+      continue;
+    ++Index;
+    addSymbol(Name, 0, 0, 0, coff::IMAGE_SYM_CLASS_EXTERNAL, 0);
+  }
+
+  // The file: the header and the section headers, then the contents and the
+  // relocations of each section, the symbols and the string table.
+  ObjectEncoder File;
+  File.Bytes.resize(coff::FileHeaderSize + Count * coff::SectionHeaderSize);
+  ObjectEncoder Headers;
+  auto addSection = [&](const std::string& Name, uint32_t Characteristics,
+                        const std::vector<uint8_t>* Data, uint64_t Size,
+                        const std::vector<Relocation>& Relocations) {
+    std::string Short = Name;
+    if (Name.size() > 8)
+      Short = "/" + std::to_string(Strings.add(Name));
+    for (size_t I = 0; I < 8; ++I)
+      Headers.u8(I < Short.size() ? static_cast<uint8_t>(Short[I]) : 0);
+    Headers.u32(0);
+    Headers.u32(0);
+    Headers.u32(static_cast<uint32_t>(Size));
+    uint32_t RawData = 0;
+    if (Data && !Data->empty()) {
+      File.pad(4);
+      RawData = static_cast<uint32_t>(File.size());
+      File.append(*Data);
+    }
+    uint32_t RelocationData = 0;
+    if (!Relocations.empty()) {
+      File.pad(4);
+      RelocationData = static_cast<uint32_t>(File.size());
+      // More relocations than the header counts are counted by a first one.
+      if (Relocations.size() >= 0xffff) {
+        Characteristics |= coff::IMAGE_SCN_LNK_NRELOC_OVFL;
+        File.u32(static_cast<uint32_t>(Relocations.size() + 1));
+        File.u32(0);
+        File.u16(0);
+      }
+      for (const Relocation& R : Relocations) {
+        File.u32(R.Offset);
+        if (const size_t* Section = std::get_if<size_t>(&R.Target))
+          File.u32(static_cast<uint32_t>(2 * *Section));
+        else
+          File.u32(SymbolIndex.at(std::get<std::string>(R.Target)));
+        File.u16(R.Type);
+      }
+    }
+    Headers.u32(RawData);
+    Headers.u32(RelocationData);
+    Headers.u32(0);
+    Headers.u16(static_cast<uint16_t>(
+        std::min<size_t>(Relocations.size(), 0xffff)));
+    Headers.u16(0);
+    Headers.u32(Characteristics);
+  };
+  for (size_t I = 0; I < Sections.size(); ++I) {
+    bool Uninitialized = Sections[I].Characteristics &
+                         gtirb_pprint::IMAGE_SCN_CNT_UNINITIALIZED_DATA;
+    addSection(Sections[I].Name, Sections[I].Characteristics,
+               Uninitialized ? nullptr : &Laid[I].Bytes, Laid[I].Size,
+               Sections[I].Relocations);
+  }
+  if (!Directives.empty()) {
+    std::vector<uint8_t> Data(Directives.begin(), Directives.end());
+    addSection(".drectve",
+               coff::IMAGE_SCN_LNK_INFO | coff::IMAGE_SCN_LNK_REMOVE |
+                   (1 << 20),
+               &Data, Data.size(), {});
+  }
+  File.pad(4);
+  uint32_t SymbolTable = static_cast<uint32_t>(File.size());
+  File.append(Symbols.Bytes);
+  File.u32(static_cast<uint32_t>(4 + Strings.Data.size()));
+  File.append(Strings.Data);
+
+  ObjectEncoder Header;
+  Header.u16(coff::IMAGE_FILE_MACHINE_AMD64);
+  Header.u16(static_cast<uint16_t>(Count));
+  Header.u32(0);
+  Header.u32(SymbolTable);
+  Header.u32(static_cast<uint32_t>(Symbols.size() / coff::SymbolSize));
+  Header.u16(0);
+  Header.u16(0);
+  Header.append(Headers.Bytes);
+  std::copy(Header.Bytes.begin(), Header.Bytes.end(), File.Bytes.begin());
+
+  if (!File.write(Output))
+    return fail("cannot write " + Output);
+  return true;
+}
+
+bool Writer::run(const std::string& Output, std::string& Message) {
+  findExports();
+  bool Ok = describeSections();
+  for (const ObjectLayout::Reference& Ref : Layout.references()) {
+    if (!Ok)
+      break;
+    Ok = relocate(Ref);
+  }
+  Ok = Ok && write(Output);
+  if (!Ok) {
+    Message = Error;
+    std::remove(Output.c_str());
+  }
+  return Ok;
+}
+
+} // namespace
+
+bool CoffObjectPrinter::supports(const gtirb::Module& Module) {
+  return Module.getFileFormat() == gtirb::FileFormat::PE &&
+         Module.getISA() == gtirb::ISA::X64;
+}
+
+bool CoffObjectPrinter::write(gtirb::Context& Context, gtirb::Module& Module,
+                              const std::string& Output,
+                              std::string& Error) const {
+  if (!supports(Module)) {
+    Error = "only x86-64 PE modules are supported";
+    return false;
+  }
+  ObjectLayout Layout(Context, Module, Printer);
+  if (!Layout.build(Error))
+    return false;
+  return Writer(Context, Module, Layout).run(Output, Error);
+}
+
+} // namespace gtirb_bprint
@@ -0,0 +1,411 @@
+//===- Compression.cpp ------------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "Compression.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#include <vector>
+#ifdef GTIRB_PPRINTER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef GTIRB_PPRINTER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace gtirb_pprint {
+
+static bool endsWith(const std::string& S, const std::string& Suffix) {
+  return S.size() >= Suffix.size() &&
+         S.compare(S.size() - Suffix.size(), Suffix.size(), Suffix) == 0;
+}
+
+Compression compressionForPath(const std::string& Path) {
+  if (endsWith(Path, ".gz")) {
+    return Compression::Gzip;
+  }
+  if (endsWith(Path, ".zst")) {
+    return Compression::Zstd;
+  }
+  return Compression::None;
+}
+
+std::string compressionExtension(Compression Format) {
+  switch (Format) {
+  case Compression::Gzip:
+    return ".gz";
+  case Compression::Zstd:
+    return ".zst";
+  case Compression::None:
+    break;
+  }
+  return "";
+}
+
+bool isCompressionSupported(Compression Format) {
+  switch (Format) {
+  case Compression::None:
+    return true;
+  case Compression::Gzip:
+#ifdef GTIRB_PPRINTER_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+  case Compression::Zstd:
+#ifdef GTIRB_PPRINTER_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+Compression preferredCompression() {
+  if (isCompressionSupported(Compression::Zstd)) {
+    return Compression::Zstd;
+  }
+  if (isCompressionSupported(Compression::Gzip)) {
+    return Compression::Gzip;
+  }
+  return Compression::None;
+}
+
+// Size of the blocks handed between the compression libraries and files.
+static constexpr size_t ChunkSize = 1 << 17;
+
+/// Compresses a stream of data and writes the result to a sink.
+class CompressedOutputBuffer::Encoder {
+public:
+  virtual ~Encoder() = default;
+
+  /// Compress a block of data.
+  virtual bool write(const char* Data, size_t Size, OutputBuffer& Sink) = 0;
+
+  /// Compress any pending data and terminate the compressed stream.
+  virtual bool finish(OutputBuffer& Sink) = 0;
+
+protected:
+  static bool put(OutputBuffer& Sink, const char* Data, size_t Size) {
+    return Size == 0 || static_cast<size_t>(Sink.sputn(
+                            Data, static_cast<std::streamsize>(Size))) == Size;
+  }
+};
+
+namespace {
+
+#ifdef GTIRB_PPRINTER_HAVE_ZLIB
+class GzipEncoder : public CompressedOutputBuffer::Encoder {
+public:
+  GzipEncoder() : Out(ChunkSize) {}
+  ~GzipEncoder() override {
+    if (Initialized) {
+      deflateEnd(&Stream);
+    }
+  }
+
+  bool init() {
+    // 16 + MAX_WBITS selects a gzip header instead of a zlib header.
+    Initialized = deflateInit2(&Stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                               16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    return Initialized;
+  }
+
+  bool write(const char* Data, size_t Size, OutputBuffer& Sink) override {
+    while (Size > 0) {
+      // avail_in is 32 bits wide.
+      uInt Chunk = static_cast<uInt>(std::min<size_t>(Size, 1u << 30));
+      if (!deflateChunk(Data, Chunk, Z_NO_FLUSH, Sink)) {
+        return false;
+      }
+      Data += Chunk;
+      Size -= Chunk;
+    }
+    return true;
+  }
+
+  bool finish(OutputBuffer& Sink) override {
+    return deflateChunk(nullptr, 0, Z_FINISH, Sink);
+  }
+
+private:
+  bool deflateChunk(const char* Data, uInt Size, int Flush,
+                    OutputBuffer& Sink) {
+    Stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(Data));
+    Stream.avail_in = Size;
+    int Ret;
+    do {
+      Stream.next_out = reinterpret_cast<Bytef*>(Out.data());
+      Stream.avail_out = static_cast<uInt>(Out.size());
+      Ret = deflate(&Stream, Flush);
+      if (Ret == Z_STREAM_ERROR) {
+        return false;
+      }
+      if (!put(Sink, Out.data(), Out.size() - Stream.avail_out)) {
+        return false;
+      }
+    } while (Stream.avail_out == 0 ||
+             (Flush == Z_FINISH && Ret != Z_STREAM_END));
+    return true;
+  }
+
+  z_stream Stream{};
+  bool Initialized = false;
+  std::vector<char> Out;
+};
+#endif // GTIRB_PPRINTER_HAVE_ZLIB
+
+#ifdef GTIRB_PPRINTER_HAVE_ZSTD
+class ZstdEncoder : public CompressedOutputBuffer::Encoder {
+public:
+  ZstdEncoder() : Ctx(ZSTD_createCCtx()), Out(ZSTD_CStreamOutSize()) {}
+  ~ZstdEncoder() override { ZSTD_freeCCtx(Ctx); }
+
+  bool init() {
+    if (!Ctx) {
+      return false;
+    }
+    ZSTD_CCtx_setParameter(Ctx, ZSTD_c_compressionLevel, ZSTD_CLEVEL_DEFAULT);
+    ZSTD_CCtx_setParameter(Ctx, ZSTD_c_checksumFlag, 1);
+    // Compress frames on worker threads. This fails harmlessly if libzstd was
+    // built without multithreading support.
+    if (unsigned Threads = std::thread::hardware_concurrency(); Threads > 1) {
+      ZSTD_CCtx_setParameter(Ctx, ZSTD_c_nbWorkers, static_cast<int>(Threads));
+    }
+    return true;
+  }
+
+  bool write(const char* Data, size_t Size, OutputBuffer& Sink) override {
+    ZSTD_inBuffer In{Data, Size, 0};
+    while (In.pos < In.size) {
+      if (!compress(In, ZSTD_e_continue, Sink)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool finish(OutputBuffer& Sink) override {
+    ZSTD_inBuffer In{nullptr, 0, 0};
+    return compress(In, ZSTD_e_end, Sink);
+  }
+
+private:
+  // Run one compression step, or with ZSTD_e_end, all remaining steps.
+  bool compress(ZSTD_inBuffer& In, ZSTD_EndDirective Mode, OutputBuffer& Sink) {
+    size_t Remaining;
+    do {
+      ZSTD_outBuffer OutBuf{Out.data(), Out.size(), 0};
+      Remaining = ZSTD_compressStream2(Ctx, &OutBuf, &In, Mode);
+      if (ZSTD_isError(Remaining) || !put(Sink, Out.data(), OutBuf.pos)) {
+        return false;
+      }
+    } while (Mode == ZSTD_e_end && Remaining != 0);
+    return true;
+  }
+
+  ZSTD_CCtx* Ctx;
+  std::vector<char> Out;
+};
+#endif // GTIRB_PPRINTER_HAVE_ZSTD
+
+} // namespace
+
+static std::unique_ptr<CompressedOutputBuffer::Encoder>
+makeEncoder(Compression Format) {
+  switch (Format) {
+#ifdef GTIRB_PPRINTER_HAVE_ZLIB
+  case Compression::Gzip: {
+    auto E = std::make_unique<GzipEncoder>();
+    if (E->init()) {
+      return E;
+    }
+    break;
+  }
+#endif
+#ifdef GTIRB_PPRINTER_HAVE_ZSTD
+  case Compression::Zstd: {
+    auto E = std::make_unique<ZstdEncoder>();
+    if (E->init()) {
+      return E;
+    }
+    break;
+  }
+#endif
+  default:
+    break;
+  }
+  return nullptr;
+}
+
+CompressedOutputBuffer::CompressedOutputBuffer(
+    std::unique_ptr<FdOutputBuffer> Sink_, std::unique_ptr<Encoder> E,
+    size_t Capacity)
+    : OutputBuffer(Capacity), Sink(std::move(Sink_)),
+      StreamEncoder(std::move(E)) {}
+
+CompressedOutputBuffer::~CompressedOutputBuffer() { close(); }
+
+std::unique_ptr<CompressedOutputBuffer>
+CompressedOutputBuffer::open(const std::string& Path, Compression Format,
+                             size_t Capacity) {
+  std::unique_ptr<Encoder> E = makeEncoder(Format);
+  if (!E) {
+    return nullptr;
+  }
+  std::unique_ptr<FdOutputBuffer> Sink = FdOutputBuffer::open(Path, ChunkSize);
+  if (!Sink) {
+    return nullptr;
+  }
+  return std::unique_ptr<CompressedOutputBuffer>(
+      new CompressedOutputBuffer(std::move(Sink), std::move(E), Capacity));
+}
+
+bool CompressedOutputBuffer::close() {
+  if (!Sink) {
+    return !Failed;
+  }
+  if (!flush() || !StreamEncoder->finish(*Sink)) {
+    Failed = true;
+  }
+  if (!Sink->close()) {
+    Failed = true;
+  }
+  Sink.reset();
+  StreamEncoder.reset();
+  return !Failed;
+}
+
+bool CompressedOutputBuffer::drain(const char* Data, size_t Size) {
+  if (!Sink || !StreamEncoder->write(Data, Size, *Sink)) {
+    Failed = true;
+    return false;
+  }
+  return true;
+}
+
+bool decompressFile(const std::string& Path, Compression Format,
+                    const std::function<bool(const char*, size_t)>& Consumer) {
+  std::ifstream In(Path, std::ios::binary);
+  if (!In) {
+    return false;
+  }
+  std::vector<char> InBuf(ChunkSize);
+  auto Read = [&]() -> size_t {
+    In.read(InBuf.data(), static_cast<std::streamsize>(InBuf.size()));
+    return static_cast<size_t>(In.gcount());
+  };
+
+  switch (Format) {
+  case Compression::None: {
+    while (size_t Size = Read()) {
+      if (!Consumer(InBuf.data(), Size)) {
+        return false;
+      }
+    }
+    return !In.bad();
+  }
+
+  case Compression::Gzip: {
+#ifdef GTIRB_PPRINTER_HAVE_ZLIB
+    z_stream Stream{};
+    // 32 + MAX_WBITS accepts both gzip and zlib headers.
+    if (inflateInit2(&Stream, 32 + MAX_WBITS) != Z_OK) {
+      return false;
+    }
+    std::vector<char> Out(ChunkSize);
+    bool Ok = true;
+    int Ret = Z_OK;
+    while (Ok) {
+      size_t Size = Read();
+      if (Size == 0) {
+        break;
+      }
+      Stream.next_in = reinterpret_cast<Bytef*>(InBuf.data());
+      Stream.avail_in = static_cast<uInt>(Size);
+      bool Full = false;
+      while (Ok && (Stream.avail_in > 0 || (Full && Ret != Z_STREAM_END))) {
+        if (Ret == Z_STREAM_END) {
+          // Concatenated gzip members form a single stream.
+          inflateReset(&Stream);
+        }
+        Stream.next_out = reinterpret_cast<Bytef*>(Out.data());
+        Stream.avail_out = static_cast<uInt>(Out.size());
+        Ret = inflate(&Stream, Z_NO_FLUSH);
+        if (Ret == Z_BUF_ERROR && Stream.avail_in == 0) {
+          // The last block of output was full and exactly used up the input
+          // read so far: inflate needs more input.
+          Ret = Z_OK;
+          break;
+        }
+        if (Ret != Z_OK && Ret != Z_STREAM_END) {
+          Ok = false;
+          break;
+        }
+        // A full output block may leave more output pending in the stream.
+        Full = Stream.avail_out == 0;
+        size_t Produced = Out.size() - Stream.avail_out;
+        if (Produced > 0 && !Consumer(Out.data(), Produced)) {
+          Ok = false;
+        }
+      }
+    }
+    inflateEnd(&Stream);
+    return Ok && Ret == Z_STREAM_END && !In.bad();
+#else
+    return false;
+#endif
+  }
+
+  case Compression::Zstd: {
+#ifdef GTIRB_PPRINTER_HAVE_ZSTD
+    ZSTD_DCtx* Ctx = ZSTD_createDCtx();
+    if (!Ctx) {
+      return false;
+    }
+    std::vector<char> Out(ZSTD_DStreamOutSize());
+    bool Ok = true;
+    // Non-zero while a frame is incomplete.
+    size_t Pending = 0;
+    while (Ok) {
+      size_t Size = Read();
+      if (Size == 0) {
+        break;
+      }
+      ZSTD_inBuffer InZ{InBuf.data(), Size, 0};
+      bool Full = false;
+      while (Ok && (InZ.pos < InZ.size || Full)) {
+        ZSTD_outBuffer OutZ{Out.data(), Out.size(), 0};
+        Pending = ZSTD_decompressStream(Ctx, &OutZ, &InZ);
+        // A full output block may leave more output pending in the stream.
+        Full = OutZ.pos == OutZ.size;
+        if (ZSTD_isError(Pending) ||
+            (OutZ.pos > 0 && !Consumer(Out.data(), OutZ.pos))) {
+          Ok = false;
+        }
+      }
+    }
+    ZSTD_freeDCtx(Ctx);
+    return Ok && Pending == 0 && !In.bad();
+#else
+    return false;
+#endif
+  }
+  }
+  return false;
+}
+
+} // namespace gtirb_pprint
@@ -15,20 +15,75 @@
 #include "ElfBinaryPrinter.hpp"
 
 #include "AuxDataSchema.hpp"
+#include "ElfObjectPrinter.hpp"
+#include "IntegratedAssembler.hpp"
+#include "OutputBuffer.hpp"
 #include "file_utils.hpp"
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <iomanip>
 #include <iostream>
-#include <regex>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+namespace fs = boost::filesystem;
+
 namespace gtirb_bprint {
 
+namespace {
+
+// Writes through to another streambuf and fingerprints what is written.
+// Only whole buffers are fingerprinted before finish(), so the fingerprint
+// does not depend on when the stream is flushed.
+class FingerprintingBuffer : public std::streambuf {
+public:
+  explicit FingerprintingBuffer(std::streambuf& T) : Target(T) {
+    setp(Buffer, Buffer + sizeof(Buffer));
+  }
+
+  // Write out the buffered text and fingerprint all of it.
+  std::optional<gtirb_pprint::Fingerprint> finish() {
+    if (!flushBuffer())
+      return std::nullopt;
+    return Builder.get();
+  }
+
+protected:
+  int_type overflow(int_type C) override {
+    if (!flushBuffer())
+      return traits_type::eof();
+    if (!traits_type::eq_int_type(C, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(C);
+      pbump(1);
+    }
+    return traits_type::not_eof(C);
+  }
+
+private:
+  bool flushBuffer() {
+    std::streamsize Size = pptr() - pbase();
+    Builder.add(pbase(), static_cast<size_t>(Size));
+    setp(Buffer, Buffer + sizeof(Buffer));
+    return Target.sputn(Buffer, Size) == Size;
+  }
+
+  std::streambuf& Target;
+  gtirb_pprint::FingerprintBuilder Builder;
+  char Buffer[1 << 16];
+};
+
+} // namespace
+
 std::optional<std::string>
 ElfBinaryPrinter::getInfixLibraryName(const std::string& library) const {
-  std::regex libsoRegex("^lib(.*)\\.so.*");
-  std::smatch m;
-  if (std::regex_match(library, m, libsoRegex)) {
-    return m.str(1);
+  // The names that match ^lib(.*)\.so.* give the infix before their last
+  // ".so".
+  size_t so = library.rfind(".so");
+  if (library.compare(0, 3, "lib") == 0 && so != std::string::npos &&
+      so >= 3) {
+    return library.substr(3, so - 3);
   }
   return std::nullopt;
 }
@@ -36,24 +91,63 @@ ElfBinaryPrinter::getInfixLibraryName(const std::string& library) const {
 std::optional<std::string>
 ElfBinaryPrinter::findLibrary(const std::string& library,
                               const std::vector<std::string>& paths) const {
-  for (const auto& path : paths) {
-    if (std::optional<std::string> fp = resolveRegularFilePath(path, library))
-      return fp;
+  return Libraries->find(library, paths);
+}
+
+// The tools that -fuse-ld=name runs.
+static std::vector<std::string> linkerTools(const std::string& name) {
+  if (name == "mold")
+    return {"ld.mold", "mold"};
+  return {"ld." + name};
+}
+
+std::optional<std::string> ElfBinaryPrinter::linkerName() const {
+  if (Linker.empty())
+    return std::nullopt;
+  std::vector<std::string> candidates = {Linker};
+  if (Linker == "auto")
+    candidates = {"mold", "lld", "gold"};
+  for (const std::string& name : candidates) {
+    for (const std::string& tool : linkerTools(name))
+      if (findTool(tool))
+        return name;
   }
+  if (Linker != "auto")
+    std::cerr << "WARNING: could not find the linker '" << Linker
+              << "' on the PATH; using the compiler's default linker.\n";
   return std::nullopt;
 }
 
+std::vector<std::string> ElfBinaryPrinter::linkerArgs() const {
+  std::vector<std::string> args;
+  std::optional<std::string> linker = linkerName();
+  if (!linker)
+    return args;
+  args.push_back("-fuse-ld=" + *linker);
+
+  std::string threads = std::to_string(
+      Jobs != 0 ? Jobs : std::max(std::thread::hardware_concurrency(), 1u));
+  if (*linker == "lld") {
+    args.push_back("-Wl,--threads=" + threads);
+  } else if (*linker == "mold") {
+    args.push_back("-Wl,--thread-count=" + threads);
+  } else if (*linker == "gold") {
+    args.push_back("-Wl,--threads");
+    args.push_back("-Wl,--thread-count=" + threads);
+  }
+  return args;
+}
+
 std::vector<std::string>
 ElfBinaryPrinter::buildCompilerArgs(std::string outputFilename,
-                                    const std::vector<TempFile>& asmPaths,
+                                    const std::vector<std::string>& inputPaths,
                                     gtirb::IR& ir) const {
   std::vector<std::string> args;
   // Start constructing the compile arguments, of the form
   // -o <output_filename> fileAXADA.s
   args.emplace_back("-o");
   args.emplace_back(outputFilename);
-  std::transform(asmPaths.begin(), asmPaths.end(), std::back_inserter(args),
-                 [](const TempFile& TF) { return TF.fileName(); });
+  args.insert(args.end(), inputPaths.begin(), inputPaths.end());
   args.insert(args.end(), ExtraCompileArgs.begin(), ExtraCompileArgs.end());
 
   // collect all the library paths
@@ -147,6 +241,9 @@ ElfBinaryPrinter::buildCompilerArgs(std::string outputFilename,
     args.insert(args.end(), Policy.compilerArguments.begin(),
                 Policy.compilerArguments.end());
   }
+  // select the linker and its threads
+  std::vector<std::string> linker = linkerArgs();
+  args.insert(args.end(), linker.begin(), linker.end());
 
   if (debug) {
     std::cout << "Compiler arguments: ";
@@ -157,19 +254,122 @@ ElfBinaryPrinter::buildCompilerArgs(std::string outputFilename,
   return args;
 }
 
+std::vector<std::string>
+ElfBinaryPrinter::assemblerArgs(const gtirb::Module& mod) const {
+  std::vector<std::string> args = ExtraCompileArgs;
+  if (mod.getISA() == gtirb::ISA::IA32)
+    args.push_back("-m32");
+  return args;
+}
+
+bool ElfBinaryPrinter::assembleIntegrated(const std::string& outputFilename,
+                                          gtirb::Context& ctx,
+                                          gtirb::Module& mod) const {
+  std::string triple;
+  switch (mod.getISA()) {
+  case gtirb::ISA::IA32:
+    triple = "i386-pc-linux-gnu";
+    break;
+  case gtirb::ISA::X64:
+    triple = "x86_64-pc-linux-gnu";
+    break;
+  case gtirb::ISA::ARM64:
+    triple = "aarch64-unknown-linux-gnu";
+    break;
+  default:
+    return false;
+  }
+
+  gtirb_pprint::StringOutputBuffer source(estimateSourceSize(mod));
+  if (Printer.print(source, ctx, mod))
+    return false;
+  std::string error;
+  if (gtirb_bprint::assembleInProcess(source.take(), triple, outputFilename,
+                                      error))
+    return true;
+  if (debug)
+    std::cout << "Integrated assembler failed, running " << compiler << ":\n"
+              << error << std::endl;
+  return false;
+}
+
 int ElfBinaryPrinter::assemble(const std::string& outputFilename,
                                gtirb::Context& ctx, gtirb::Module& mod) const {
-  TempFile tempFile;
+  // Extra arguments are for the compiler, which neither the object writer
+  // nor the integrated assembler can honor.
+  if (DirectObjects && ExtraCompileArgs.empty() &&
+      ElfObjectPrinter::supports(mod)) {
+    std::string error;
+    if (ElfObjectPrinter(Printer).write(ctx, mod, outputFilename, error)) {
+      ++DirectWrites;
+      return 0;
+    }
+    if (debug)
+      std::cout << "Could not write the object directly, assembling it:\n"
+                << error << std::endl;
+  }
+  if (IntegratedAssembler && ExtraCompileArgs.empty() &&
+      hasIntegratedAssembler() &&
+      assembleIntegrated(outputFilename, ctx, mod))
+    return 0;
+  if (PipeSources)
+    return assemblePiped(outputFilename, ctx, mod);
+  if (SourceCompression != gtirb_pprint::Compression::None)
+    return assembleCompressed(outputFilename, ctx, mod);
+
+  TempFile tempFile(".s", estimateSourceSize(mod));
   if (!prepareSource(ctx, mod, tempFile)) {
     std::cerr << "ERROR: Could not write assembly into a temporary file.\n";
     return -1;
   }
 
   std::vector<std::string> args{{"-o", outputFilename, "-c"}};
-  args.insert(args.end(), ExtraCompileArgs.begin(), ExtraCompileArgs.end());
-  args.push_back(tempFile.fileName());
+  std::vector<std::string> modArgs = assemblerArgs(mod);
+  args.insert(args.end(), modArgs.begin(), modArgs.end());
+  // The name of a file in memory has no extension to tell its language.
+  args.insert(args.end(), {"-x", "assembler", tempFile.fileName()});
+
+  if (std::optional<int> ret = executeCached(
+          compiler, args, {tempFile.fileName()}, outputFilename)) {
+    if (*ret)
+      std::cerr << "ERROR: assembler returned: " << *ret << "\n";
+    return *ret;
+  }
+
+  std::cerr << "ERROR: could not find the assembler '" << compiler
+            << "' on the PATH.\n";
+  return -1;
+}
+
+int ElfBinaryPrinter::assembleCompressed(const std::string& outputFilename,
+                                         gtirb::Context& ctx,
+                                         gtirb::Module& mod) const {
+  // Assembly compresses to about a fifth of its size or less.
+  constexpr uint64_t CompressionRatio = 5;
+  TempFile tempFile(".s" +
+                        gtirb_pprint::compressionExtension(SourceCompression),
+                    estimateSourceSize(mod) / CompressionRatio);
+  if (!prepareCompressedSource(ctx, mod, tempFile)) {
+    std::cerr << "ERROR: Could not write compressed assembly into a "
+                 "temporary file.\n";
+    return -1;
+  }
+
+  // The assembler reads the decompressed source from its standard input.
+  std::vector<std::string> args{{"-o", outputFilename, "-c"}};
+  std::vector<std::string> modArgs = assemblerArgs(mod);
+  args.insert(args.end(), modArgs.begin(), modArgs.end());
+  args.insert(args.end(), {"-x", "assembler", "-"});
 
-  if (std::optional<int> ret = execute(compiler, args)) {
+  auto writeSource = [&](std::ostream& input) {
+    return gtirb_pprint::decompressFile(
+        tempFile.fileName(), SourceCompression,
+        [&](const char* data, size_t size) {
+          input.write(data, static_cast<std::streamsize>(size));
+          return static_cast<bool>(input);
+        });
+  };
+  if (std::optional<int> ret = executeTool(compiler, args, writeSource)) {
     if (*ret)
       std::cerr << "ERROR: assembler returned: " << *ret << "\n";
     return *ret;
@@ -180,18 +380,254 @@ int ElfBinaryPrinter::assemble(const std::string& outputFilename,
   return -1;
 }
 
+int ElfBinaryPrinter::assemblePiped(const std::string& outputFilename,
+                                    gtirb::Context& ctx,
+                                    gtirb::Module& mod) const {
+  // The assembler reads the source from its standard input as it is printed.
+  std::vector<std::string> args{{"-o", outputFilename, "-c"}};
+  std::vector<std::string> modArgs = assemblerArgs(mod);
+  args.insert(args.end(), modArgs.begin(), modArgs.end());
+  args.insert(args.end(), {"-x", "assembler", "-"});
+
+  auto writeSource = [&](std::ostream& input) {
+    Printer.print(input, ctx, mod);
+    return static_cast<bool>(input);
+  };
+  if (std::optional<int> ret = executeTool(compiler, args, writeSource)) {
+    if (*ret)
+      std::cerr << "ERROR: assembler returned: " << *ret << "\n";
+    return *ret;
+  }
+
+  std::cerr << "ERROR: could not find the assembler '" << compiler
+            << "' on the PATH.\n";
+  return -1;
+}
+
+int ElfBinaryPrinter::linkPiped(const std::string& outputFilename,
+                                gtirb::Context& ctx, gtirb::IR& ir) const {
+  // The compiler driver runs the assembler on its inputs in order, so each
+  // module is printed into a named pipe once the assembler opens it.
+  std::vector<gtirb::Module*> modules;
+  for (gtirb::Module& module : ir.modules())
+    modules.push_back(&module);
+  std::vector<TempFifo> fifos(modules.size());
+  std::vector<std::string> inputPaths;
+  for (const TempFifo& fifo : fifos) {
+    if (!fifo.isOpen()) {
+      std::cerr << "ERROR: Could not create a named pipe for the assembly.\n";
+      return -1;
+    }
+    inputPaths.push_back(fifo.fileName());
+  }
+
+  auto writeSource = [&](size_t i, std::ostream& input) {
+    Printer.print(input, ctx, *modules[i]);
+    return static_cast<bool>(input);
+  };
+  std::vector<std::string> args =
+      buildCompilerArgs(outputFilename, inputPaths, ir);
+  if (std::optional<int> ret =
+          executeTool(compiler, args, inputPaths, writeSource)) {
+    if (*ret)
+      std::cerr << "ERROR: assembler returned: " << *ret << "\n";
+    return *ret;
+  }
+
+  std::cerr << "ERROR: could not find the assembler '" << compiler
+            << "' on the PATH.\n";
+  return -1;
+}
+
+bool ElfBinaryPrinter::assembleUnits(
+    gtirb::Context& ctx, gtirb::Module& mod, std::vector<std::string>& objects,
+    std::vector<std::unique_ptr<TempFile>>& tempObjects) const {
+  // Units in the object directory are small, so that a change only
+  // reassembles a little code; otherwise there is one unit per shard.
+  gtirb_pprint::ModuleSplit Split =
+      ObjectDirectory.empty()
+          ? gtirb_pprint::ModuleSplit::byCount(ctx, mod, Shards)
+          : gtirb_pprint::ModuleSplit::bySize(ctx, mod, UnitSize);
+  std::vector<TempFile> Sources;
+  Sources.reserve(Split.size());
+  for (size_t I = 0; I < Split.size(); ++I)
+    Sources.emplace_back(".s", estimateSourceSize(mod) / Split.size());
+  std::vector<std::unique_ptr<FingerprintingBuffer>> Buffers;
+  std::vector<std::unique_ptr<std::ostream>> Streams;
+  std::vector<std::ostream*> Outputs;
+  for (TempFile& Source : Sources) {
+    if (!Source.isOpen())
+      return false;
+    Buffers.push_back(std::make_unique<FingerprintingBuffer>(
+        *static_cast<std::ofstream&>(Source).rdbuf()));
+    Streams.push_back(std::make_unique<std::ostream>(Buffers.back().get()));
+    Outputs.push_back(Streams.back().get());
+  }
+  Printer.print(Split, Outputs, ctx, mod);
+
+  std::vector<std::string> AssemblerArgs = assemblerArgs(mod);
+
+  // Find where the object of each unit goes, and whether it already exists.
+  std::optional<gtirb_pprint::Fingerprint> CompilerIdentity;
+  if (!ObjectDirectory.empty())
+    CompilerIdentity = ObjectCache::toolIdentity(compiler);
+  size_t First = objects.size();
+  std::vector<bool> Needed(Sources.size(), true);
+  for (size_t I = 0; I < Sources.size(); ++I) {
+    std::optional<gtirb_pprint::Fingerprint> Text = Buffers[I]->finish();
+    Sources[I].close();
+    if (!Text || !*Streams[I] || !static_cast<std::ofstream&>(Sources[I])) {
+      std::cerr << "ERROR: Could not write assembly into a temporary file.\n";
+      return false;
+    }
+    if (ObjectDirectory.empty()) {
+      // The object cache and the assembler replace their outputs, which a
+      // file in memory does not survive.
+      tempObjects.push_back(
+          std::make_unique<TempFile>(".o", TempFile::OnDisk));
+      tempObjects.back()->close();
+      objects.push_back(tempObjects.back()->fileName());
+      continue;
+    }
+
+    // The object only depends on the assembly and on how it is assembled,
+    // including which compiler assembles it.
+    gtirb_pprint::FingerprintBuilder Key;
+    Key.add(Text->High);
+    Key.add(Text->Low);
+    if (CompilerIdentity) {
+      Key.add(CompilerIdentity->High);
+      Key.add(CompilerIdentity->Low);
+    } else {
+      Key.add(compiler);
+    }
+    for (const std::string& Arg : AssemblerArgs)
+      Key.add(Arg);
+    gtirb_pprint::Fingerprint F = Key.get();
+    std::ostringstream Name;
+    Name << std::hex << std::setfill('0') << std::setw(16) << F.High
+         << std::setw(16) << F.Low << ".o";
+    fs::path Object = fs::path(ObjectDirectory) / Name.str();
+    objects.push_back(Object.string());
+    Needed[I] = !fs::exists(Object);
+  }
+
+  // Each assembler runs on one core, so run up to Jobs of them at once.
+  return runJobs(Sources.size(), Jobs, [&](size_t I) {
+    if (!Needed[I])
+      return true;
+    const std::string& Object = objects[First + I];
+    if (debug)
+      std::cout << "Assembling unit " << I << " of " << Sources.size()
+                << " into " << Object << std::endl;
+
+    // In the object directory, assemble next to the final name, so that an
+    // interrupted build does not leave a truncated object under it.
+    std::string Target = ObjectDirectory.empty() ? Object : Object + ".tmp";
+    std::vector<std::string> Args{{"-o", Target, "-c"}};
+    Args.insert(Args.end(), AssemblerArgs.begin(), AssemblerArgs.end());
+    Args.insert(Args.end(), {"-x", "assembler", Sources[I].fileName()});
+    std::optional<int> Ret =
+        ObjectDirectory.empty()
+            ? executeCached(compiler, Args, {Sources[I].fileName()}, Target)
+            : executeTool(compiler, Args);
+    if (!Ret) {
+      std::cerr << "ERROR: could not find the assembler '" << compiler
+                << "' on the PATH.\n";
+      return false;
+    }
+    boost::system::error_code EC;
+    if (*Ret == 0 && Target != Object)
+      fs::rename(Target, Object, EC);
+    if (*Ret != 0 || EC) {
+      std::cerr << "ERROR: assembler returned: " << *Ret << "\n";
+      if (Target != Object)
+        fs::remove(Target, EC);
+      return false;
+    }
+    return true;
+  });
+}
+
+bool ElfBinaryPrinter::assembleModules(
+    gtirb::Context& ctx, gtirb::IR& ir, std::vector<std::string>& objects,
+    std::vector<std::unique_ptr<TempFile>>& tempObjects) const {
+  size_t first = objects.size();
+  std::vector<gtirb::Module*> modules;
+  for (gtirb::Module& module : ir.modules()) {
+    modules.push_back(&module);
+    tempObjects.push_back(
+        std::make_unique<TempFile>(".o", TempFile::OnDisk));
+    tempObjects.back()->close();
+    objects.push_back(tempObjects.back()->fileName());
+  }
+  // Each module is printed and assembled on its own thread, so the slowest
+  // module bounds the time to build the objects.
+  return runJobs(modules.size(), Jobs, [&](size_t i) {
+    const std::string& object = objects[first + i];
+    if (debug)
+      std::cout << "Assembling module " << i << " into " << object
+                << std::endl;
+    return assemble(object, ctx, *modules[i]) == 0;
+  });
+}
+
 int ElfBinaryPrinter::link(const std::string& outputFilename,
                            gtirb::Context& ctx, gtirb::IR& ir) {
   if (debug)
     std::cout << "Generating binary file" << std::endl;
+  startLink();
+  auto start = std::chrono::steady_clock::now();
   std::vector<TempFile> tempFiles;
-  if (!prepareSources(ctx, ir, tempFiles)) {
-    std::cerr << "ERROR: Could not write assembly into a temporary file.\n";
-    return -1;
+  std::vector<std::unique_ptr<TempFile>> tempObjects;
+  std::vector<std::string> inputPaths;
+  auto moduleCount = std::distance(ir.modules().begin(), ir.modules().end());
+  if (!ObjectDirectory.empty() || Shards > 1) {
+    boost::system::error_code EC;
+    if (!ObjectDirectory.empty())
+      fs::create_directories(ObjectDirectory, EC);
+    if (EC) {
+      std::cerr << "ERROR: Could not create the object directory "
+                << ObjectDirectory << ".\n";
+      return -1;
+    }
+    for (gtirb::Module& Module : ir.modules()) {
+      if (!assembleUnits(ctx, Module, inputPaths, tempObjects))
+        return -1;
+    }
+    recordStep("assemble", start);
+  } else if ((Jobs != 1 && moduleCount > 1) || DirectObjects ||
+             (IntegratedAssembler && hasIntegratedAssembler())) {
+    if (!assembleModules(ctx, ir, inputPaths, tempObjects))
+      return -1;
+    recordStep("assemble", start);
+  } else if (PipeSources) {
+    int ret = linkPiped(outputFilename, ctx, ir);
+    recordStep("print, assemble and link", start);
+    return ret;
+  } else {
+    if (!prepareSources(ctx, ir, tempFiles)) {
+      std::cerr << "ERROR: Could not write assembly into a temporary file.\n";
+      return -1;
+    }
+    for (const TempFile& TF : tempFiles)
+      inputPaths.push_back(TF.fileName());
+    recordStep("print", start);
   }
 
-  if (std::optional<int> ret =
-          execute(compiler, buildCompilerArgs(outputFilename, tempFiles, ir))) {
+  // The name of a source in memory has no extension to tell its language.
+  std::vector<std::string> inputArgs = inputPaths;
+  if (!tempFiles.empty()) {
+    inputArgs.insert(inputArgs.begin(), {"-x", "assembler"});
+    inputArgs.insert(inputArgs.end(), {"-x", "none"});
+  }
+  std::vector<std::string> args =
+      buildCompilerArgs(outputFilename, inputArgs, ir);
+  start = std::chrono::steady_clock::now();
+  std::optional<int> ret =
+      executeCached(compiler, args, inputPaths, outputFilename);
+  recordStep(tempFiles.empty() ? "link" : "assemble and link", start);
+  if (ret) {
     if (*ret)
       std::cerr << "ERROR: assembler returned: " << *ret << "\n";
     return *ret;
@@ -0,0 +1,560 @@
+//===- ElfObjectPrinter.cpp -------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "ElfObjectPrinter.hpp"
+
+#include "AuxDataSchema.hpp"
+#include "ObjectLayout.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <variant>
+
+namespace gtirb_bprint {
+
+namespace {
+
+// The parts of the ELF specification used here, so that the writer does not
+// depend on the host's <elf.h>.
+namespace elf {
+constexpr uint32_t SHT_PROGBITS = 1;
+constexpr uint32_t SHT_SYMTAB = 2;
+constexpr uint32_t SHT_STRTAB = 3;
+constexpr uint32_t SHT_RELA = 4;
+constexpr uint32_t SHT_NOTE = 7;
+constexpr uint32_t SHT_NOBITS = 8;
+constexpr uint32_t SHT_INIT_ARRAY = 14;
+constexpr uint32_t SHT_FINI_ARRAY = 15;
+constexpr uint32_t SHT_PREINIT_ARRAY = 16;
+
+constexpr uint64_t SHF_WRITE = 0x1;
+constexpr uint64_t SHF_ALLOC = 0x2;
+constexpr uint64_t SHF_EXECINSTR = 0x4;
+constexpr uint64_t SHF_INFO_LINK = 0x40;
+constexpr uint64_t SHF_TLS = 0x400;
+
+constexpr uint8_t STB_LOCAL = 0;
+constexpr uint8_t STB_GLOBAL = 1;
+constexpr uint8_t STB_WEAK = 2;
+constexpr uint8_t STB_GNU_UNIQUE = 10;
+
+constexpr uint8_t STT_NOTYPE = 0;
+constexpr uint8_t STT_OBJECT = 1;
+constexpr uint8_t STT_FUNC = 2;
+constexpr uint8_t STT_SECTION = 3;
+constexpr uint8_t STT_TLS = 6;
+constexpr uint8_t STT_GNU_IFUNC = 10;
+
+constexpr uint8_t STV_DEFAULT = 0;
+constexpr uint8_t STV_INTERNAL = 1;
+constexpr uint8_t STV_HIDDEN = 2;
+constexpr uint8_t STV_PROTECTED = 3;
+
+constexpr uint32_t R_X86_64_64 = 1;
+constexpr uint32_t R_X86_64_PC32 = 2;
+constexpr uint32_t R_X86_64_PLT32 = 4;
+constexpr uint32_t R_X86_64_GOTPCREL = 9;
+constexpr uint32_t R_X86_64_32 = 10;
+constexpr uint32_t R_X86_64_32S = 11;
+constexpr uint32_t R_X86_64_16 = 12;
+constexpr uint32_t R_X86_64_PC16 = 13;
+constexpr uint32_t R_X86_64_8 = 14;
+constexpr uint32_t R_X86_64_PC8 = 15;
+constexpr uint32_t R_X86_64_PC64 = 24;
+
+constexpr size_t EhdrSize = 64;
+constexpr size_t ShdrSize = 64;
+constexpr size_t SymSize = 24;
+constexpr size_t RelaSize = 24;
+} // namespace elf
+
+// What a relocation refers to: a section, or a symbol by name.
+using RelocationTarget = std::variant<size_t, std::string>;
+
+struct Relocation {
+  uint64_t Offset;
+  uint32_t Type;
+  RelocationTarget Target;
+  int64_t Addend;
+};
+
+// The ELF side of a section of the layout.
+struct OutputSection {
+  std::string Name;
+  uint32_t Type;
+  uint64_t Flags;
+  std::vector<Relocation> Relocations;
+};
+
+struct OutputSymbol {
+  std::string Name;
+  uint8_t Binding;
+  uint8_t Type;
+  uint8_t Visibility;
+  ObjectLayout::Location Where;
+};
+
+class Writer {
+public:
+  Writer(gtirb::Module& M, ObjectLayout& L) : Module(M), Layout(L) {}
+
+  bool run(const std::string& Output, std::string& Error);
+
+private:
+  void describeSections();
+  bool defineSymbols();
+  bool relocate(const ObjectLayout::Reference& Ref);
+  bool write(const std::string& Output);
+
+  bool isGlobal(const gtirb::Symbol& Symbol) const;
+  bool isThreadLocal(const gtirb::Symbol& Symbol) const;
+  RelocationTarget target(const gtirb::Symbol& Symbol, int64_t& Addend,
+                          bool ByName);
+  bool fail(const std::string& Message) {
+    Error = Message;
+    return false;
+  }
+
+  gtirb::Module& Module;
+  ObjectLayout& Layout;
+  std::string Error;
+
+  std::vector<OutputSection> Sections;
+  std::vector<OutputSymbol> Symbols;
+  std::unordered_set<std::string> Defined;
+  // Local symbols that relocations refer to by name.
+  std::set<std::string> NamedLocals;
+  std::map<std::string, uint8_t> Undefined;
+  bool GnuAbi = false;
+};
+
+void Writer::describeSections() {
+  const auto* Properties =
+      Module.getAuxData<gtirb::schema::ElfSectionProperties>();
+  for (ObjectLayout::Section& Laid : Layout.sections()) {
+    OutputSection Out{Laid.Source->getName(), elf::SHT_PROGBITS,
+                      elf::SHF_ALLOC};
+    if (Properties) {
+      if (auto It = Properties->find(Laid.Source->getUUID());
+          It != Properties->end()) {
+        auto [Type, Flags] = It->second;
+        if (Type == elf::SHT_NOTE || Type == elf::SHT_INIT_ARRAY ||
+            Type == elf::SHT_FINI_ARRAY || Type == elf::SHT_PREINIT_ARRAY)
+          Out.Type = static_cast<uint32_t>(Type);
+        // Merging and linking flags need more than the contents.
+        Out.Flags = Flags & (elf::SHF_WRITE | elf::SHF_ALLOC |
+                             elf::SHF_EXECINSTR | elf::SHF_TLS);
+      }
+    }
+    // A section of zeros that takes no room in the object.
+    if (Laid.ZeroFill && Out.Type == elf::SHT_PROGBITS &&
+        (Out.Flags & elf::SHF_EXECINSTR) == 0)
+      Out.Type = elf::SHT_NOBITS;
+    else if (Laid.ZeroFill)
+      Laid.Bytes.resize(Laid.Size, 0);
+    Sections.push_back(std::move(Out));
+  }
+}
+
+bool Writer::isGlobal(const gtirb::Symbol& Symbol) const {
+  if (const auto* Info = Module.getAuxData<gtirb::schema::ElfSymbolInfo>()) {
+    if (auto It = Info->find(Symbol.getUUID()); It != Info->end())
+      return std::get<2>(It->second) != "LOCAL";
+  }
+  return false;
+}
+
+bool Writer::isThreadLocal(const gtirb::Symbol& Symbol) const {
+  if (const auto* Info = Module.getAuxData<gtirb::schema::ElfSymbolInfo>()) {
+    if (auto It = Info->find(Symbol.getUUID()); It != Info->end())
+      return std::get<1>(It->second) == "TLS";
+  }
+  return false;
+}
+
+// What a relocation against a symbol refers to. Local symbols are referred
+// to through their section, as the assembler does, unless \p ByName.
+RelocationTarget Writer::target(const gtirb::Symbol& Symbol, int64_t& Addend,
+                                bool ByName) {
+  std::optional<ObjectLayout::Location> Where = Layout.locate(Symbol);
+  if (Where && !isGlobal(Symbol)) {
+    if (ByName) {
+      NamedLocals.insert(Symbol.getName());
+      return Symbol.getName();
+    }
+    Addend += static_cast<int64_t>(Where->Offset);
+    return Where->Section;
+  }
+  if (!Where) {
+    uint8_t Binding = elf::STB_GLOBAL;
+    if (const auto* Info =
+            Module.getAuxData<gtirb::schema::ElfSymbolInfo>()) {
+      if (auto It = Info->find(Symbol.getUUID());
+          It != Info->end() && std::get<2>(It->second) == "WEAK")
+        Binding = elf::STB_WEAK;
+    }
+    Undefined.emplace(Symbol.getName(), Binding);
+  }
+  return Symbol.getName();
+}
+
+bool Writer::defineSymbols() {
+  static const std::unordered_map<std::string, uint8_t> Types = {
+      {"FUNC", elf::STT_FUNC}, {"OBJECT", elf::STT_OBJECT},
+      {"TLS", elf::STT_TLS},   {"GNU_IFUNC", elf::STT_GNU_IFUNC},
+  };
+  static const std::unordered_map<std::string, uint8_t> Bindings = {
+      {"GLOBAL", elf::STB_GLOBAL},
+      {"WEAK", elf::STB_WEAK},
+      {"UNIQUE", elf::STB_GNU_UNIQUE},
+      {"GNU_UNIQUE", elf::STB_GNU_UNIQUE},
+  };
+  static const std::unordered_map<std::string, uint8_t> Visibilities = {
+      {"HIDDEN", elf::STV_HIDDEN},
+      {"PROTECTED", elf::STV_PROTECTED},
+      {"INTERNAL", elf::STV_INTERNAL},
+  };
+
+  const auto* Info = Module.getAuxData<gtirb::schema::ElfSymbolInfo>();
+  for (const gtirb::Symbol& Symbol : Module.symbols()) {
+    std::optional<ObjectLayout::Location> Where = Layout.locate(Symbol);
+    const std::string& Name = Symbol.getName();
+    // The assembler keeps local labels only for relocations that need them.
+    if (!Where || Name.empty() ||
+        (Name.rfind(".L", 0) == 0 && !NamedLocals.count(Name)))
+      continue;
+    OutputSymbol Out{Name, elf::STB_LOCAL, elf::STT_NOTYPE, elf::STV_DEFAULT,
+                     *Where};
+    if (Info) {
+      if (auto It = Info->find(Symbol.getUUID()); It != Info->end()) {
+        const auto& [Size, Type, Binding, Visibility, Index] = It->second;
+        if (auto T = Types.find(Type); T != Types.end())
+          Out.Type = T->second;
+        if (auto B = Bindings.find(Binding); B != Bindings.end())
+          Out.Binding = B->second;
+        if (auto V = Visibilities.find(Visibility); V != Visibilities.end())
+          Out.Visibility = V->second;
+      }
+    }
+    // These are GNU extensions, which the assembler marks in the header.
+    if (Out.Binding == elf::STB_GNU_UNIQUE)
+      Out.Type = elf::STT_OBJECT;
+    if (Out.Binding == elf::STB_GNU_UNIQUE || Out.Type == elf::STT_GNU_IFUNC)
+      GnuAbi = true;
+    if (Out.Binding != elf::STB_LOCAL && !Defined.insert(Name).second)
+      continue;
+    Symbols.push_back(std::move(Out));
+  }
+  return true;
+}
+
+bool Writer::relocate(const ObjectLayout::Reference& Ref) {
+  OutputSection& Out = Sections[Ref.Field.Section];
+  uint64_t Field = Ref.Field.Offset;
+  const gtirb::Symbol& Symbol = *Ref.Symbol;
+  const gtirb::SymAttributeSet& Attributes = Ref.Attributes;
+  if (Attributes.isFlagSet(gtirb::SymAttribute::GotRef) ||
+      Attributes.isFlagSet(gtirb::SymAttribute::Part0) ||
+      Attributes.isFlagSet(gtirb::SymAttribute::Part1) ||
+      Attributes.isFlagSet(gtirb::SymAttribute::Part2) ||
+      Attributes.isFlagSet(gtirb::SymAttribute::Part3) ||
+      (Ref.Kind != ObjectLayout::ReferenceKind::Difference &&
+       isThreadLocal(Symbol)))
+    return fail("unsupported reference to " + Symbol.getName());
+
+  int64_t Addend = Ref.Addend;
+  std::optional<ObjectLayout::Location> To = Layout.locate(Symbol);
+  uint32_t Type;
+  switch (Ref.Kind) {
+  case ObjectLayout::ReferenceKind::Absolute:
+    Type = Ref.Size == 8   ? elf::R_X86_64_64
+           : Ref.Size == 4 ? (Ref.Signed ? elf::R_X86_64_32S : elf::R_X86_64_32)
+           : Ref.Size == 2 ? elf::R_X86_64_16
+                           : elf::R_X86_64_8;
+    break;
+  case ObjectLayout::ReferenceKind::PcRelative: {
+    bool Got = Attributes.isFlagSet(gtirb::SymAttribute::GotRelPC);
+    // References within a section are resolved in place.
+    if (To && To->Section == Ref.Field.Section && !isGlobal(Symbol) && !Got) {
+      int64_t Value = static_cast<int64_t>(To->Offset) + Addend -
+                      static_cast<int64_t>(Field);
+      if (!ObjectLayout::fits(Value, Ref.Size))
+        return fail("reference to " + Symbol.getName() + " out of range in " +
+                    Out.Name);
+      Layout.store(Ref.Field, Value, Ref.Size);
+      return true;
+    }
+    bool Named = !To || isGlobal(Symbol);
+    Type = Got ? elf::R_X86_64_GOTPCREL
+           : Attributes.isFlagSet(gtirb::SymAttribute::PltRef)
+               ? elf::R_X86_64_PLT32
+           : Ref.Size == 8   ? elf::R_X86_64_PC64
+           : Ref.Size == 2   ? elf::R_X86_64_PC16
+           : Ref.Size == 1   ? elf::R_X86_64_PC8
+           : Ref.Branch && Named ? elf::R_X86_64_PLT32
+                                 : elf::R_X86_64_PC32;
+    break;
+  }
+  case ObjectLayout::ReferenceKind::Difference: {
+    // S1 - S2 is S1 - P, plus the known distance from S2 to P.
+    std::optional<ObjectLayout::Location> From = Layout.locate(*Ref.Base);
+    if (!To || !From || From->Section != Ref.Field.Section ||
+        (Ref.Size != 4 && Ref.Size != 8))
+      return fail("unsupported symbol difference in " + Out.Name);
+    Addend += static_cast<int64_t>(Field) - static_cast<int64_t>(From->Offset);
+    Type = Ref.Size == 8 ? elf::R_X86_64_PC64 : elf::R_X86_64_PC32;
+    break;
+  }
+  }
+  // The linker makes a GOT entry per symbol, so it needs the symbol.
+  RelocationTarget Target =
+      target(Symbol, Addend, Type == elf::R_X86_64_GOTPCREL);
+  Layout.store(Ref.Field, 0, Ref.Size);
+  Out.Relocations.push_back({Field, Type, std::move(Target), Addend});
+  return true;
+}
+
+class StringTable {
+public:
+  uint32_t add(const std::string& S) {
+    if (S.empty())
+      return 0;
+    auto [It, Inserted] = Offsets.emplace(S, 0);
+    if (Inserted) {
+      It->second = static_cast<uint32_t>(Data.size());
+      Data.insert(Data.end(), S.begin(), S.end());
+      Data.push_back(0);
+    }
+    return It->second;
+  }
+  std::vector<uint8_t> Data{0};
+
+private:
+  std::unordered_map<std::string, uint32_t> Offsets;
+};
+
+bool Writer::write(const std::string& Output) {
+  struct Header {
+    uint32_t Name;
+    uint32_t Type;
+    uint64_t Flags;
+    uint64_t Offset;
+    uint64_t Size;
+    uint32_t Link;
+    uint32_t Info;
+    uint64_t Alignment;
+    uint64_t EntrySize;
+  };
+  StringTable SectionNames, Names;
+  std::vector<Header> Headers(1, Header{});
+
+  // The section headers: the null one, the contents, an empty
+  // .note.GNU-stack, the relocations, and the symbol table.
+  size_t FirstContent = Headers.size();
+  for (size_t I = 0; I < Sections.size(); ++I) {
+    const OutputSection& S = Sections[I];
+    const ObjectLayout::Section& Laid = Layout.sections()[I];
+    Headers.push_back({SectionNames.add(S.Name), S.Type, S.Flags, 0, Laid.Size,
+                       0, 0, Laid.Alignment, 0});
+  }
+  Headers.push_back(
+      {SectionNames.add(".note.GNU-stack"), elf::SHT_PROGBITS, 0, 0, 0, 0, 0,
+       1, 0});
+  std::vector<size_t> RelaHeaders;
+  for (const OutputSection& S : Sections) {
+    if (S.Relocations.empty())
+      continue;
+    RelaHeaders.push_back(Headers.size());
+    Headers.push_back({SectionNames.add(".rela" + S.Name), elf::SHT_RELA,
+                       elf::SHF_INFO_LINK, 0, 0, 0, 0, 8, elf::RelaSize});
+  }
+  size_t SymtabIndex = Headers.size();
+  Headers.push_back({SectionNames.add(".symtab"), elf::SHT_SYMTAB, 0, 0, 0,
+                     0, 0, 8, elf::SymSize});
+  size_t StrtabIndex = Headers.size();
+  Headers.push_back(
+      {SectionNames.add(".strtab"), elf::SHT_STRTAB, 0, 0, 0, 0, 0, 1, 0});
+  size_t ShstrtabIndex = Headers.size();
+  Headers.push_back(
+      {SectionNames.add(".shstrtab"), elf::SHT_STRTAB, 0, 0, 0, 0, 0, 1, 0});
+
+  // The symbols: the null one, one per section, the local symbols, and then
+  // the global ones, defined or not.
+  ObjectEncoder Symtab;
+  auto addSymbol = [&](uint32_t Name, uint8_t Info, uint8_t Other,
+                       uint16_t Index, uint64_t Value) {
+    Symtab.u32(Name);
+    Symtab.u8(Info);
+    Symtab.u8(Other);
+    Symtab.u16(Index);
+    Symtab.u64(Value);
+    Symtab.u64(0);
+  };
+  addSymbol(0, 0, 0, 0, 0);
+  for (size_t I = 0; I < Sections.size(); ++I)
+    addSymbol(0, elf::STT_SECTION, 0, static_cast<uint16_t>(FirstContent + I),
+              0);
+  std::unordered_map<std::string, uint32_t> SymbolIndex;
+  uint32_t Count = static_cast<uint32_t>(1 + Sections.size());
+  for (int Pass = 0; Pass < 2; ++Pass) {
+    bool Locals = Pass == 0;
+    for (const OutputSymbol& S : Symbols) {
+      if ((S.Binding == elf::STB_LOCAL) != Locals)
+        continue;
+      if (!Locals || NamedLocals.count(S.Name))
+        SymbolIndex.emplace(S.Name, Count);
+      addSymbol(Names.add(S.Name),
+                static_cast<uint8_t>(S.Binding << 4 | S.Type), S.Visibility,
+                static_cast<uint16_t>(FirstContent + S.Where.Section),
+                S.Where.Offset);
+      ++Count;
+    }
+    if (Locals)
+      Headers[SymtabIndex].Info = Count;
+  }
+  for (const auto& [Name, Binding] : Undefined) {
+    if (SymbolIndex.count(Name))
+      continue;
+    SymbolIndex.emplace(Name, Count++);
+    addSymbol(Names.add(Name), static_cast<uint8_t>(Binding << 4), 0, 0, 0);
+  }
+
+  // The file: the header, then the contents of the sections in the order of
+  // their headers, and the section headers.
+  ObjectEncoder File;
+  File.Bytes.resize(elf::EhdrSize);
+  auto place = [&](size_t Index, const std::vector<uint8_t>& Data,
+                   uint64_t Alignment) {
+    File.pad(static_cast<size_t>(std::max<uint64_t>(Alignment, 1)));
+    Headers[Index].Offset = File.size();
+    Headers[Index].Size = Data.size();
+    File.append(Data);
+  };
+  for (size_t I = 0; I < Sections.size(); ++I) {
+    const ObjectLayout::Section& Laid = Layout.sections()[I];
+    if (Sections[I].Type == elf::SHT_NOBITS) {
+      File.pad(static_cast<size_t>(Laid.Alignment));
+      Headers[FirstContent + I].Offset = File.size();
+    } else {
+      place(FirstContent + I, Laid.Bytes, Laid.Alignment);
+    }
+  }
+  size_t Rela = 0;
+  for (size_t I = 0; I < Sections.size(); ++I) {
+    if (Sections[I].Relocations.empty())
+      continue;
+    ObjectEncoder Entries;
+    for (const Relocation& R : Sections[I].Relocations) {
+      uint64_t Symbol;
+      if (const size_t* Section = std::get_if<size_t>(&R.Target))
+        Symbol = 1 + *Section;
+      else
+        Symbol = SymbolIndex.at(std::get<std::string>(R.Target));
+      Entries.u64(R.Offset);
+      Entries.u64(Symbol << 32 | R.Type);
+      Entries.u64(static_cast<uint64_t>(R.Addend));
+    }
+    size_t Index = RelaHeaders[Rela++];
+    place(Index, Entries.Bytes, 8);
+    Headers[Index].Link = static_cast<uint32_t>(SymtabIndex);
+    Headers[Index].Info = static_cast<uint32_t>(FirstContent + I);
+  }
+  place(SymtabIndex, Symtab.Bytes, 8);
+  Headers[SymtabIndex].Link = static_cast<uint32_t>(StrtabIndex);
+  place(StrtabIndex, Names.Data, 1);
+  place(ShstrtabIndex, SectionNames.Data, 1);
+
+  File.pad(8);
+  uint64_t HeadersOffset = File.size();
+  for (const Header& H : Headers) {
+    File.u32(H.Name);
+    File.u32(H.Type);
+    File.u64(H.Flags);
+    File.u64(0);
+    File.u64(H.Offset);
+    File.u64(H.Size);
+    File.u32(H.Link);
+    File.u32(H.Info);
+    File.u64(H.Alignment);
+    File.u64(H.EntrySize);
+  }
+
+  ObjectEncoder Ehdr;
+  for (uint8_t B : {0x7f, 0x45, 0x4c, 0x46, 2, 1, 1})
+    Ehdr.u8(B);
+  Ehdr.u8(GnuAbi ? 3 : 0); // ELFOSABI_GNU
+  Ehdr.u64(0);
+  Ehdr.u16(1);  // ET_REL
+  Ehdr.u16(62); // EM_X86_64
+  Ehdr.u32(1);
+  Ehdr.u64(0);
+  Ehdr.u64(0);
+  Ehdr.u64(HeadersOffset);
+  Ehdr.u32(0);
+  Ehdr.u16(elf::EhdrSize);
+  Ehdr.u16(0);
+  Ehdr.u16(0);
+  Ehdr.u16(elf::ShdrSize);
+  Ehdr.u16(static_cast<uint16_t>(Headers.size()));
+  Ehdr.u16(static_cast<uint16_t>(ShstrtabIndex));
+  std::copy(Ehdr.Bytes.begin(), Ehdr.Bytes.end(), File.Bytes.begin());
+
+  if (!File.write(Output))
+    return fail("cannot write " + Output);
+  return true;
+}
+
+bool Writer::run(const std::string& Output, std::string& Message) {
+  describeSections();
+  bool Ok = true;
+  for (const ObjectLayout::Reference& Ref : Layout.references()) {
+    if (!(Ok = relocate(Ref)))
+      break;
+  }
+  Ok = Ok && defineSymbols() && write(Output);
+  if (!Ok) {
+    Message = Error;
+    std::remove(Output.c_str());
+  }
+  return Ok;
+}
+
+} // namespace
+
+bool ElfObjectPrinter::supports(const gtirb::Module& Module) {
+  // Without .eh_frame, exceptions could not unwind through the code.
+  const auto* CFI = Module.getAuxData<gtirb::schema::CfiDirectives>();
+  return Module.getFileFormat() == gtirb::FileFormat::ELF &&
+         Module.getISA() == gtirb::ISA::X64 && (!CFI || CFI->empty());
+}
+
+bool ElfObjectPrinter::write(gtirb::Context& Context, gtirb::Module& Module,
+                             const std::string& Output,
+                             std::string& Error) const {
+  if (!supports(Module)) {
+    Error = "only x86-64 ELF modules without call frame information are "
+            "supported";
+    return false;
+  }
+  ObjectLayout Layout(Context, Module, Printer);
+  if (!Layout.build(Error))
+    return false;
+  return Writer(Module, Layout).run(Output, Error);
+}
+
+} // namespace gtirb_bprint
@@ -15,6 +15,8 @@
 #include "ElfPrettyPrinter.hpp"
 
 #include "AuxDataSchema.hpp"
+#include <iomanip>
+#include <sstream>
 #define SHT_NULL 0
 #define SHT_PROGBITS 1
 #define SHT_SYMTAB 2
@@ -127,6 +129,8 @@ void ElfPrettyPrinter::printSectionProperties(std::ostream& os,
 
 void ElfPrettyPrinter::printSectionFooterDirective(
     std::ostream& os, const gtirb::Section& section) {
+  if (compact)
+    return;
   os << syntax.comment() << " end section " << section.getName() << '\n';
 }
 
@@ -148,21 +152,29 @@ void ElfPrettyPrinter::printFooter(std::ostream& /* os */){};
 void ElfPrettyPrinter::printSymbolHeader(std::ostream& os,
                                          const gtirb::Symbol& sym) {
   const auto* SymbolTypes = module.getAuxData<gtirb::schema::ElfSymbolInfo>();
-  if (!SymbolTypes) {
-    return;
-  }
-
-  auto SymTypeIt = SymbolTypes->find(sym.getUUID());
-  if (SymTypeIt == SymbolTypes->end()) {
-    return;
+  std::optional<ElfSymbolInfo> Info;
+  if (SymbolTypes) {
+    if (auto SymTypeIt = SymbolTypes->find(sym.getUUID());
+        SymTypeIt != SymbolTypes->end()) {
+      Info.emplace(SymTypeIt->second);
+    }
   }
 
-  ElfSymbolInfo SymbolInfo{SymTypeIt->second};
-
-  if (SymbolInfo.Binding == "LOCAL") {
+  if (!Info || Info->Binding == "LOCAL") {
+    // The other units of a split module may refer to a local symbol, so it
+    // is defined as a hidden global one, which the linker does not export.
+    // getSymbolName keeps it apart from those of the other modules.
+    if (ExportSymbols && sym.getAddress()) {
+      auto name = getSymbolName(sym);
+      printBar(os, false);
+      os << syntax.global() << ' ' << name << '\n';
+      os << elfSyntax.hidden() << ' ' << name << '\n';
+      printBar(os, false);
+    }
     return;
   }
 
+  const ElfSymbolInfo& SymbolInfo = *Info;
   auto name = getSymbolName(sym);
   printBar(os, false);
   bool unique = false;
@@ -232,6 +244,32 @@ void ElfPrettyPrinter::printSymExprSuffix(std::ostream& OS,
   }
 }
 
+std::string
+ElfPrettyPrinter::getSymbolName(const gtirb::Symbol& symbol) const {
+  std::string Name = PrettyPrinterBase::getSymbolName(symbol);
+  if (!ExportSymbols || !symbol.getAddress())
+    return Name;
+
+  // The local symbols of a split module become hidden global ones (see
+  // printSymbolHeader), which would clash with a local symbol of the same
+  // name in another module linked with this one. Tag them with the module.
+  // In a module without symbol information, the bindings are unknown and
+  // the other modules may refer to any symbol by name, so none is tagged.
+  const auto* SymbolTypes = module.getAuxData<gtirb::schema::ElfSymbolInfo>();
+  if (!SymbolTypes)
+    return Name;
+  if (auto It = SymbolTypes->find(symbol.getUUID());
+      It != SymbolTypes->end() && ElfSymbolInfo(It->second).Binding != "LOCAL")
+    return Name;
+
+  std::ostringstream Tagged;
+  Tagged << Name << ".m" << std::hex << std::setfill('0');
+  auto Id = module.getUUID().begin();
+  for (int I = 0; I < 4; ++I)
+    Tagged << std::setw(2) << static_cast<unsigned>(Id[I]);
+  return Tagged.str();
+}
+
 void ElfPrettyPrinter::printSymbolDefinition(std::ostream& os,
                                              const gtirb::Symbol& sym) {
   printSymbolHeader(os, sym);
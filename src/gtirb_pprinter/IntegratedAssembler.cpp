@@ -0,0 +1,167 @@
+//===- IntegratedAssembler.cpp ----------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "IntegratedAssembler.hpp"
+
+#ifdef GTIRB_PPRINTER_HAVE_LLVM_MC
+#include <llvm/Config/llvm-config.h>
+#include <llvm/MC/MCAsmBackend.h>
+#include <llvm/MC/MCAsmInfo.h>
+#include <llvm/MC/MCCodeEmitter.h>
+#include <llvm/MC/MCContext.h>
+#include <llvm/MC/MCInstrInfo.h>
+#include <llvm/MC/MCObjectFileInfo.h>
+#include <llvm/MC/MCObjectWriter.h>
+#include <llvm/MC/MCParser/MCAsmParser.h>
+#include <llvm/MC/MCParser/MCTargetAsmParser.h>
+#include <llvm/MC/MCRegisterInfo.h>
+#include <llvm/MC/MCStreamer.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/MC/MCTargetOptions.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#endif // GTIRB_PPRINTER_HAVE_LLVM_MC
+
+namespace gtirb_bprint {
+
+#ifdef GTIRB_PPRINTER_HAVE_LLVM_MC
+
+bool hasIntegratedAssembler() { return true; }
+
+bool assembleInProcess(const std::string& Source, const std::string& Triple,
+                       const std::string& Output, std::string& Error) {
+  static std::once_flag Initialized;
+  std::call_once(Initialized, []() {
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmParsers();
+  });
+
+  const llvm::Target* Target =
+      llvm::TargetRegistry::lookupTarget(Triple, Error);
+  if (!Target)
+    return false;
+  llvm::Triple TheTriple(Triple);
+
+  // Collect the messages of the assembler instead of printing them.
+  llvm::SourceMgr SrcMgr;
+  llvm::raw_string_ostream Messages(Error);
+  SrcMgr.setDiagHandler(
+      [](const llvm::SMDiagnostic& Diag, void* Context) {
+        Diag.print(nullptr, *static_cast<llvm::raw_string_ostream*>(Context),
+                   false);
+      },
+      &Messages);
+  SrcMgr.AddNewSourceBuffer(
+      llvm::MemoryBuffer::getMemBuffer(Source, "<assembly>", false),
+      llvm::SMLoc());
+
+  llvm::MCTargetOptions Options;
+  std::unique_ptr<llvm::MCRegisterInfo> MRI(Target->createMCRegInfo(Triple));
+  std::unique_ptr<llvm::MCAsmInfo> MAI(
+      Target->createMCAsmInfo(*MRI, Triple, Options));
+  std::unique_ptr<llvm::MCSubtargetInfo> STI(
+      Target->createMCSubtargetInfo(Triple, "", ""));
+  std::unique_ptr<llvm::MCInstrInfo> MCII(Target->createMCInstrInfo());
+  if (!MRI || !MAI || !STI || !MCII) {
+    Error = "no assembler for " + Triple;
+    return false;
+  }
+  llvm::MCContext Ctx(TheTriple, MAI.get(), MRI.get(), STI.get(), &SrcMgr,
+                      &Options);
+  std::unique_ptr<llvm::MCObjectFileInfo> MOFI(
+      Target->createMCObjectFileInfo(Ctx, /*PIC=*/true));
+  Ctx.setObjectFileInfo(MOFI.get());
+
+  std::error_code EC;
+  auto Out = std::make_unique<llvm::raw_fd_ostream>(Output, EC,
+                                                    llvm::sys::fs::OF_None);
+  if (EC) {
+    Error = "cannot open " + Output + ": " + EC.message();
+    return false;
+  }
+#if LLVM_VERSION_MAJOR >= 15
+  std::unique_ptr<llvm::MCCodeEmitter> Emitter(
+      Target->createMCCodeEmitter(*MCII, Ctx));
+#else
+  std::unique_ptr<llvm::MCCodeEmitter> Emitter(
+      Target->createMCCodeEmitter(*MCII, *MRI, Ctx));
+#endif
+  std::unique_ptr<llvm::MCAsmBackend> Backend(
+      Target->createMCAsmBackend(*STI, *MRI, Options));
+  if (!Emitter || !Backend) {
+    Error = "no object writer for " + Triple;
+    Out->close();
+    std::remove(Output.c_str());
+    return false;
+  }
+  std::unique_ptr<llvm::MCObjectWriter> Writer =
+      Backend->createObjectWriter(*Out);
+#if LLVM_VERSION_MAJOR >= 19
+  std::unique_ptr<llvm::MCStreamer> Streamer(Target->createMCObjectStreamer(
+      TheTriple, Ctx, std::move(Backend), std::move(Writer), std::move(Emitter),
+      *STI));
+#else
+  std::unique_ptr<llvm::MCStreamer> Streamer(Target->createMCObjectStreamer(
+      TheTriple, Ctx, std::move(Backend), std::move(Writer), std::move(Emitter),
+      *STI, /*RelaxAll=*/false, /*IncrementalLinkerCompatible=*/false,
+      /*DWARFMustBeAtTheEnd=*/false));
+#endif
+
+  std::unique_ptr<llvm::MCAsmParser> Parser(
+      llvm::createMCAsmParser(SrcMgr, Ctx, *Streamer, *MAI));
+  std::unique_ptr<llvm::MCTargetAsmParser> TargetParser(
+      Target->createMCAsmParser(*STI, *Parser, *MCII, Options));
+  if (!TargetParser) {
+    Error = "no assembly parser for " + Triple;
+    Out->close();
+    std::remove(Output.c_str());
+    return false;
+  }
+  Parser->setTargetParser(*TargetParser);
+  bool Failed = Parser->Run(/*NoInitialTextSection=*/false);
+
+  // The streamer writes the object when the parser finishes.
+  Out->close();
+  Messages.flush();
+  if (Failed || Out->has_error()) {
+    Out->clear_error();
+    std::remove(Output.c_str());
+    if (Error.empty())
+      Error = "cannot write " + Output;
+    return false;
+  }
+  return true;
+}
+
+#else
+
+bool hasIntegratedAssembler() { return false; }
+
+bool assembleInProcess(const std::string&, const std::string&,
+                       const std::string&, std::string& Error) {
+  Error = "gtirb-pprinter was built without an integrated assembler";
+  return false;
+}
+
+#endif // GTIRB_PPRINTER_HAVE_LLVM_MC
+
+} // namespace gtirb_bprint
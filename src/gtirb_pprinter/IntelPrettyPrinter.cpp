@@ -40,6 +40,9 @@ void IntelPrettyPrinter::printHeader(std::ostream& os) {
   this->printBar(os);
   os << ".intel_syntax noprefix\n";
   this->printBar(os);
+  if (compact) {
+    return;
+  }
   os << '\n';
 
   for (int i = 0; i < 8; i++) {
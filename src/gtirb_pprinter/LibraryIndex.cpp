@@ -0,0 +1,240 @@
+//===- LibraryIndex.cpp -----------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "LibraryIndex.hpp"
+
+#include "file_utils.hpp"
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif // _WIN32
+
+namespace fs = boost::filesystem;
+
+namespace gtirb_bprint {
+
+static constexpr char IndexMagic[8] = {'G', 'T', 'P', 'P', 'L', 'I', '0', '2'};
+
+static constexpr int64_t NanosecondsPerSecond = 1000000000;
+
+// The time of a directory whose listing must be redone before it is used.
+static constexpr int64_t Unvalidated = std::numeric_limits<int64_t>::min();
+
+// The modification time of Path in nanoseconds since the epoch.
+static bool modificationTime(const std::string& Path, int64_t& Time) {
+#ifdef _WIN32
+  boost::system::error_code EC;
+  Time = static_cast<int64_t>(fs::last_write_time(Path, EC)) *
+         NanosecondsPerSecond;
+  return !EC && fs::is_directory(Path, EC);
+#else
+  struct stat St;
+  if (::stat(Path.c_str(), &St) != 0 || !S_ISDIR(St.st_mode))
+    return false;
+#ifdef __APPLE__
+  const struct timespec& MTime = St.st_mtimespec;
+#else
+  const struct timespec& MTime = St.st_mtim;
+#endif // __APPLE__
+  Time = static_cast<int64_t>(MTime.tv_sec) * NanosecondsPerSecond +
+         MTime.tv_nsec;
+  return true;
+#endif // _WIN32
+}
+
+static void writeString(std::ofstream& Out, const std::string& S) {
+  uint64_t Size = S.size();
+  Out.write(reinterpret_cast<const char*>(&Size), sizeof(Size));
+  Out.write(S.data(), static_cast<std::streamsize>(Size));
+}
+
+// Read a string written by writeString from a file of FileSize bytes.
+static bool readString(std::ifstream& In, std::streamoff FileSize,
+                       std::string& S) {
+  uint64_t Size;
+  if (!In.read(reinterpret_cast<char*>(&Size), sizeof(Size)))
+    return false;
+  // A damaged size must not make us allocate more than the file holds.
+  if (Size > static_cast<uint64_t>(FileSize - In.tellg()))
+    return false;
+  S.assign(Size, '\0');
+  return Size == 0 || In.read(&S[0], static_cast<std::streamsize>(Size));
+}
+
+template <typename T> static bool readValue(std::ifstream& In, T& Value) {
+  return static_cast<bool>(
+      In.read(reinterpret_cast<char*>(&Value), sizeof(Value)));
+}
+
+LibraryIndex::Directory* LibraryIndex::directory(const std::string& Path) {
+  auto It = Directories.find(Path);
+  if (CheckedDirectories.count(Path))
+    return It == Directories.end() ? nullptr : &It->second;
+  CheckedDirectories.insert(Path);
+
+  int64_t Time;
+  if (!modificationTime(Path, Time)) {
+    if (It != Directories.end())
+      Directories.erase(It);
+    return nullptr;
+  }
+  if (It != Directories.end() && It->second.Time == Time)
+    return &It->second;
+
+  // Adding or removing a file changes the modification time of its
+  // directory, so the listing is only redone then.
+  Directory& D = Directories[Path];
+  D = Directory();
+  D.Time = Time;
+  boost::system::error_code EC;
+  for (fs::directory_iterator Entry(Path, EC), End; !EC && Entry != End;
+       Entry.increment(EC))
+    D.Names.insert(Entry->path().filename().string());
+  ++Listings;
+  return &D;
+}
+
+std::optional<std::string>
+LibraryIndex::find(const std::string& Library,
+                   const std::vector<std::string>& Paths) {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  for (const std::string& Path : Paths) {
+    Directory* D = directory(Path);
+    if (!D || !D->Names.count(Library))
+      continue;
+    auto& Resolved = D->Resolved;
+    std::string Key = (fs::path(Path) / Library).string();
+    auto It = Resolved.find(Library);
+    if (It != Resolved.end() && !CheckedFiles.count(Key)) {
+      // A resolution loaded from a file must still be a regular file.
+      boost::system::error_code EC;
+      if (!It->second.empty() && !fs::is_regular_file(It->second, EC)) {
+        Resolved.erase(It);
+        It = Resolved.end();
+      }
+    }
+    if (It == Resolved.end())
+      It = Resolved
+               .emplace(Library,
+                        resolveRegularFilePath(Path, Library).value_or(""))
+               .first;
+    CheckedFiles.insert(Key);
+    if (!It->second.empty())
+      return It->second;
+  }
+  return std::nullopt;
+}
+
+bool LibraryIndex::load(const std::string& Path) {
+  std::ifstream In(Path, std::ios::binary | std::ios::ate);
+  if (!In)
+    return false;
+  std::streamoff FileSize = In.tellg();
+  In.seekg(0);
+  char Magic[sizeof(IndexMagic)];
+  if (!In.read(Magic, sizeof(Magic)) ||
+      std::memcmp(Magic, IndexMagic, sizeof(Magic)) != 0) {
+    return false;
+  }
+  int64_t SaveTime;
+  if (!readValue(In, SaveTime))
+    return false;
+  std::unordered_map<std::string, Directory> Loaded;
+  while (In.peek() != std::ifstream::traits_type::eof()) {
+    std::string Name;
+    uint64_t Names, Resolutions;
+    if (!readString(In, FileSize, Name))
+      return false;
+    Directory& D = Loaded[Name];
+    if (!readValue(In, D.Time) || !readValue(In, Names))
+      return false;
+    for (uint64_t I = 0; I < Names; ++I) {
+      std::string File;
+      if (!readString(In, FileSize, File))
+        return false;
+      D.Names.insert(std::move(File));
+    }
+    if (!readValue(In, Resolutions))
+      return false;
+    for (uint64_t I = 0; I < Resolutions; ++I) {
+      std::string File, Target;
+      if (!readString(In, FileSize, File) ||
+          !readString(In, FileSize, Target))
+        return false;
+      D.Resolved.emplace(std::move(File), std::move(Target));
+    }
+    // A directory changed within a second of the save may have changed
+    // again without its time changing, if the file system keeps coarser
+    // times than ours, so its listing is redone.
+    if (D.Time > SaveTime - NanosecondsPerSecond)
+      D.Time = Unvalidated;
+  }
+  Directories = std::move(Loaded);
+  CheckedDirectories.clear();
+  CheckedFiles.clear();
+  Listings = 0;
+  return true;
+}
+
+bool LibraryIndex::save(const std::string& Path) const {
+  // Write a new file and move it into place, so that a failed write does not
+  // leave a truncated index behind.
+  std::string TempPath = Path + ".tmp";
+  {
+    std::ofstream Out(TempPath, std::ios::binary | std::ios::trunc);
+    Out.write(IndexMagic, sizeof(IndexMagic));
+    int64_t SaveTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+    Out.write(reinterpret_cast<const char*>(&SaveTime), sizeof(SaveTime));
+    for (const auto& [Name, D] : Directories) {
+      writeString(Out, Name);
+      uint64_t Names = D.Names.size();
+      Out.write(reinterpret_cast<const char*>(&D.Time), sizeof(D.Time));
+      Out.write(reinterpret_cast<const char*>(&Names), sizeof(Names));
+      for (const std::string& File : D.Names)
+        writeString(Out, File);
+      // Names that lead to no regular file are resolved again.
+      uint64_t Resolutions = 0;
+      for (const auto& Entry : D.Resolved)
+        Resolutions += !Entry.second.empty();
+      Out.write(reinterpret_cast<const char*>(&Resolutions),
+                sizeof(Resolutions));
+      for (const auto& [File, Target] : D.Resolved) {
+        if (Target.empty())
+          continue;
+        writeString(Out, File);
+        writeString(Out, Target);
+      }
+    }
+    Out.close();
+    if (!Out) {
+      std::remove(TempPath.c_str());
+      return false;
+    }
+  }
+  if (std::rename(TempPath.c_str(), Path.c_str()) == 0) {
+    return true;
+  }
+  // Windows does not replace an existing file.
+  std::remove(Path.c_str());
+  return std::rename(TempPath.c_str(), Path.c_str()) == 0;
+}
+
+} // namespace gtirb_bprint
@@ -0,0 +1,183 @@
+//===- ModuleSplit.cpp ------------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "ModuleSplit.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <optional>
+#include <unordered_set>
+#include <variant>
+
+using namespace gtirb_pprint;
+
+static const gtirb::Node* referent(const gtirb::Symbol* Sym) {
+  if (const auto* CB = Sym->getReferent<gtirb::CodeBlock>())
+    return CB;
+  return Sym->getReferent<gtirb::DataBlock>();
+}
+
+// Whether a fallthrough edge of the CFG enters a block.
+static bool fallsInto(const gtirb::CFG& Cfg, const gtirb::CodeBlock& Block) {
+  std::optional<gtirb::CFG::vertex_descriptor> V = getVertex(&Block, Cfg);
+  if (!V)
+    return false;
+  for (auto E : boost::make_iterator_range(in_edges(*V, Cfg))) {
+    const gtirb::EdgeLabel& Label = Cfg[E];
+    if (Label &&
+        std::get<gtirb::EdgeType>(*Label) == gtirb::EdgeType::Fallthrough)
+      return true;
+  }
+  return false;
+}
+
+ModuleSplit ModuleSplit::byCount(gtirb::Context& Context,
+                                 gtirb::Module& Module, size_t Count) {
+  uint64_t Total = 0;
+  for (const gtirb::Section& Section : Module.sections()) {
+    for (const gtirb::Node& Node : Section.blocks()) {
+      if (const auto* Code = dyn_cast<gtirb::CodeBlock>(&Node))
+        Total += Code->getSize();
+      else
+        Total += cast<gtirb::DataBlock>(Node).getSize();
+    }
+  }
+  // Every unit but the last holds at least this much.
+  Count = std::max<size_t>(Count, 1);
+  return bySize(Context, Module,
+                std::max<uint64_t>((Total + Count - 1) / Count, 1));
+}
+
+ModuleSplit ModuleSplit::bySize(gtirb::Context& Context, gtirb::Module& Module,
+                                uint64_t UnitSize) {
+  std::unordered_set<const gtirb::Node*> Entries;
+  if (const auto* FunctionEntries =
+          Module.getAuxData<gtirb::schema::FunctionEntries>()) {
+    for (const auto& [Function, Blocks] : *FunctionEntries)
+      for (const gtirb::UUID& Id : Blocks)
+        if (const gtirb::Node* Block = gtirb::Node::getByUUID(Context, Id))
+          Entries.insert(Block);
+  }
+  const gtirb::CFG* Cfg = nullptr;
+  if (const gtirb::IR* Ir = Module.getIR(); Ir && num_edges(Ir->getCFG()) > 0)
+    Cfg = &Ir->getCFG();
+
+  // Start a unit at every allowed place once the current unit is big enough.
+  ModuleSplit Split;
+  std::unordered_map<const gtirb::Node*, size_t> BlockUnit;
+  uint64_t Size = 0;
+  for (const gtirb::Section& Section : Module.sections()) {
+    auto& Starts = Split.Starts[&Section];
+    std::optional<gtirb::Addr> PreviousEnd;
+    size_t Index = 0;
+    for (const gtirb::Node& Node : Section.blocks()) {
+      const auto* Code = dyn_cast<gtirb::CodeBlock>(&Node);
+      std::optional<gtirb::Addr> Addr;
+      uint64_t BlockSize;
+      if (Code) {
+        Addr = Code->getAddress();
+        BlockSize = Code->getSize();
+      } else {
+        const auto& Data = cast<gtirb::DataBlock>(Node);
+        Addr = Data.getAddress();
+        BlockSize = Data.getSize();
+      }
+
+      // A block overlapping the previous one is printed relative to it.
+      bool CanStart = Index == 0 ||
+                      (Code && Cfg && Entries.count(Code) &&
+                       !fallsInto(*Cfg, *Code) && Addr && PreviousEnd &&
+                       *Addr >= *PreviousEnd);
+      if (Split.Units == 0 || (CanStart && Size >= UnitSize)) {
+        ++Split.Units;
+        Size = 0;
+      }
+      if (Starts.empty() || Starts.back().second != Split.Units - 1)
+        Starts.emplace_back(Index, Split.Units - 1);
+
+      BlockUnit.emplace(&Node, Split.Units - 1);
+      Size += BlockSize;
+      if (Addr)
+        PreviousEnd = std::max(PreviousEnd.value_or(*Addr), *Addr + BlockSize);
+      ++Index;
+    }
+    if (Starts.empty()) {
+      Split.Units = std::max<size_t>(Split.Units, 1);
+      Starts.emplace_back(0, Split.Units - 1);
+    }
+  }
+  if (Split.Units == 0)
+    return Split;
+
+  // Merge the units from the one using a symbol difference to the ones
+  // defining its symbols. Reach[U] is the last unit merged with unit U.
+  std::vector<size_t> Reach(Split.Units);
+  std::iota(Reach.begin(), Reach.end(), 0);
+  for (const gtirb::Section& Section : Module.sections()) {
+    for (const gtirb::Node& Node : Section.blocks()) {
+      const gtirb::ByteInterval* BI;
+      uint64_t Begin, End;
+      if (const auto* Code = dyn_cast<gtirb::CodeBlock>(&Node)) {
+        BI = Code->getByteInterval();
+        Begin = Code->getOffset();
+        End = Begin + Code->getSize();
+      } else {
+        const auto& Data = cast<gtirb::DataBlock>(Node);
+        BI = Data.getByteInterval();
+        Begin = Data.getOffset();
+        End = Begin + Data.getSize();
+      }
+      size_t Unit = BlockUnit.at(&Node);
+      for (const auto& SEE : BI->findSymbolicExpressionsAtOffset(Begin, End)) {
+        const auto* SAA =
+            std::get_if<gtirb::SymAddrAddr>(&SEE.getSymbolicExpression());
+        if (!SAA)
+          continue;
+        for (const gtirb::Symbol* Sym : {SAA->Sym1, SAA->Sym2}) {
+          auto It = BlockUnit.find(referent(Sym));
+          if (It == BlockUnit.end())
+            continue;
+          size_t Low = std::min(Unit, It->second);
+          size_t High = std::max(Unit, It->second);
+          Reach[Low] = std::max(Reach[Low], High);
+        }
+      }
+    }
+  }
+
+  std::vector<size_t> Merged(Split.Units);
+  size_t Units = 0;
+  size_t Reached = 0;
+  for (size_t U = 0; U < Split.Units; ++U) {
+    if (U == 0 || U > Reached)
+      ++Units;
+    Merged[U] = Units - 1;
+    Reached = std::max(Reached, Reach[U]);
+  }
+  Split.Units = Units;
+  for (auto& [Section, Starts] : Split.Starts) {
+    std::vector<std::pair<size_t, size_t>> Kept;
+    for (const auto& [Index, Unit] : Starts) {
+      if (Kept.empty() || Kept.back().second != Merged[Unit])
+        Kept.emplace_back(Index, Merged[Unit]);
+    }
+    Starts = std::move(Kept);
+  }
+  return Split;
+}
+
+const std::vector<std::pair<size_t, size_t>>&
+ModuleSplit::starts(const gtirb::Section& Section) const {
+  return Starts.at(&Section);
+}
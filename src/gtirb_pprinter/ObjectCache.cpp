@@ -0,0 +1,267 @@
+//===- ObjectCache.cpp ------------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "ObjectCache.hpp"
+
+#include "file_utils.hpp"
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <tuple>
+
+namespace fs = boost::filesystem;
+
+namespace gtirb_bprint {
+
+// Evicting stops once the cache is this fraction of its limit, so that some
+// outputs can be stored before the directory is scanned again.
+static constexpr double EvictionTarget = 0.9;
+
+// Fingerprint the content of a file. Reads are a multiple of the word size,
+// so the fingerprint does not depend on how the file is split into reads.
+static bool addFile(gtirb_pprint::FingerprintBuilder& F,
+                    const std::string& Path) {
+  std::ifstream In(Path, std::ios::binary);
+  if (!In)
+    return false;
+  std::vector<char> Buffer(1 << 20);
+  while (In) {
+    In.read(Buffer.data(), static_cast<std::streamsize>(Buffer.size()));
+    F.add(Buffer.data(), static_cast<size_t>(In.gcount()));
+  }
+  return In.eof();
+}
+
+// Replace each occurrence of From in S by To.
+static void replaceAll(std::string& S, const std::string& From,
+                       const std::string& To) {
+  if (From.empty())
+    return;
+  for (size_t Pos = S.find(From); Pos != std::string::npos;
+       Pos = S.find(From, Pos + To.size()))
+    S.replace(Pos, From.size(), To);
+}
+
+ObjectCache::ObjectCache(const std::string& Dir, uint64_t Max)
+    : Directory(Dir), MaxSize(Max) {}
+
+// The file a tool resolves to, by path or on the PATH, along with that
+// file's size and modification time.
+static std::optional<gtirb_pprint::Fingerprint>
+fileIdentity(const std::string& Tool) {
+  std::optional<std::string> ToolPath =
+      fs::path(Tool).is_absolute() ? Tool : findTool(Tool);
+  if (!ToolPath)
+    return std::nullopt;
+  boost::system::error_code EC;
+  fs::path Resolved = fs::canonical(*ToolPath, EC);
+  if (EC)
+    return std::nullopt;
+  uint64_t ToolSize = fs::file_size(Resolved, EC);
+  std::time_t ToolTime = fs::last_write_time(Resolved, EC);
+  if (EC)
+    return std::nullopt;
+  gtirb_pprint::FingerprintBuilder F;
+  F.add(Resolved.string());
+  F.add(ToolSize);
+  F.add(static_cast<uint64_t>(ToolTime));
+  return F.get();
+}
+
+// Whether a tool is a compiler driver, such as gcc or clang, which runs an
+// assembler and a linker of its own.
+static bool isCompilerDriver(const std::string& Tool) {
+  std::string Name = fs::path(Tool).filename().string();
+  for (const char* Driver : {"cc", "c++", "g++", "clang"}) {
+    if (Name.find(Driver) != std::string::npos)
+      return true;
+  }
+  return false;
+}
+
+std::optional<gtirb_pprint::Fingerprint>
+ObjectCache::toolIdentity(const std::string& Tool) {
+  std::optional<gtirb_pprint::Fingerprint> Identity = fileIdentity(Tool);
+  if (!Identity || !isCompilerDriver(Tool))
+    return Identity;
+
+  // Asking the driver for its assembler and linker takes longer than a
+  // build that hits the cache, so it is asked once per driver.
+  static std::mutex Mutex;
+  static std::map<std::pair<uint64_t, uint64_t>, gtirb_pprint::Fingerprint>
+      Drivers;
+  std::lock_guard<std::mutex> Lock(Mutex);
+  auto It = Drivers.find({Identity->High, Identity->Low});
+  if (It != Drivers.end())
+    return It->second;
+
+  gtirb_pprint::FingerprintBuilder F;
+  F.add(Identity->High);
+  F.add(Identity->Low);
+  for (const std::string Program : {"as", "ld"}) {
+    std::optional<std::string> ProgramPath =
+        executeOutput(Tool, {"-print-prog-name=" + Program});
+    if (ProgramPath)
+      ProgramPath->erase(ProgramPath->find_last_not_of(" \t\r\n") + 1);
+    std::optional<gtirb_pprint::Fingerprint> ProgramIdentity;
+    if (ProgramPath && !ProgramPath->empty())
+      ProgramIdentity = fileIdentity(*ProgramPath);
+    F.add(Program);
+    if (ProgramIdentity) {
+      F.add(ProgramIdentity->High);
+      F.add(ProgramIdentity->Low);
+    }
+  }
+  gtirb_pprint::Fingerprint DriverIdentity = F.get();
+  Drivers.emplace(std::make_pair(Identity->High, Identity->Low),
+                  DriverIdentity);
+  return DriverIdentity;
+}
+
+std::optional<gtirb_pprint::Fingerprint>
+ObjectCache::key(const std::string& Tool, const std::vector<std::string>& Args,
+                 const std::vector<std::string>& Inputs,
+                 const std::string& Output) const {
+  gtirb_pprint::FingerprintBuilder F;
+
+  // The tool, by the file it resolves to and that file's size and age, and
+  // for a compiler driver, the assembler and linker it runs.
+  std::optional<gtirb_pprint::Fingerprint> Identity = toolIdentity(Tool);
+  if (!Identity)
+    return std::nullopt;
+  F.add(Identity->High);
+  F.add(Identity->Low);
+
+  // The arguments, without the paths of the inputs and the output, which
+  // are usually temporary files.
+  boost::system::error_code EC;
+  std::vector<std::string> Files = Inputs;
+  for (const std::string& Arg : Args) {
+    if (Arg != Output &&
+        std::find(Files.begin(), Files.end(), Arg) == Files.end() &&
+        fs::is_regular_file(Arg, EC))
+      Files.push_back(Arg);
+  }
+  F.add(Args.size());
+  for (std::string Arg : Args) {
+    for (size_t I = 0; I < Files.size(); ++I)
+      replaceAll(Arg, Files[I], "<input " + std::to_string(I) + ">");
+    replaceAll(Arg, Output, "<output>");
+    F.add(Arg);
+  }
+
+  // The inputs.
+  F.add(Files.size());
+  for (const std::string& File : Files) {
+    if (!addFile(F, File))
+      return std::nullopt;
+  }
+  return F.get();
+}
+
+std::string ObjectCache::path(const gtirb_pprint::Fingerprint& Key) const {
+  std::ostringstream Name;
+  Name << std::hex << std::setfill('0') << std::setw(16) << Key.High
+       << std::setw(16) << Key.Low;
+  std::string Hex = Name.str();
+  // Spread the outputs over subdirectories, as ccache does.
+  return (fs::path(Directory) / Hex.substr(0, 2) / Hex.substr(2)).string();
+}
+
+bool ObjectCache::fetch(const gtirb_pprint::Fingerprint& Key,
+                        const std::string& Output) {
+  fs::path Stored = path(Key);
+  boost::system::error_code EC;
+  if (!fs::exists(Stored, EC)) {
+    ++Misses;
+    return false;
+  }
+  fs::remove(Output, EC);
+  fs::copy_file(Stored, Output, EC);
+  if (EC) {
+    ++Misses;
+    return false;
+  }
+  // Mark the output as recently used.
+  fs::last_write_time(Stored, std::time(nullptr), EC);
+  ++Hits;
+  return true;
+}
+
+bool ObjectCache::store(const gtirb_pprint::Fingerprint& Key,
+                        const std::string& Output) {
+  fs::path Stored = path(Key);
+  boost::system::error_code EC;
+  fs::create_directories(Stored.parent_path(), EC);
+  if (EC)
+    return false;
+  fs::path Partial = fs::unique_path(Stored.string() + ".%%%%%%%%.tmp", EC);
+  if (EC)
+    return false;
+  fs::copy_file(Output, Partial, EC);
+  uint64_t StoredSize = 0;
+  if (!EC)
+    StoredSize = fs::file_size(Partial, EC);
+  if (!EC)
+    fs::rename(Partial, Stored, EC);
+  if (EC) {
+    fs::remove(Partial, EC);
+    return false;
+  }
+
+  // The directory is scanned on the first store, and then only once what
+  // was stored since takes it over its limit.
+  std::lock_guard<std::mutex> Lock(SizeMutex);
+  if (DirectorySize)
+    *DirectorySize += StoredSize;
+  if (!DirectorySize || *DirectorySize > MaxSize)
+    evict();
+  return true;
+}
+
+void ObjectCache::evict() {
+  std::vector<std::tuple<std::time_t, uint64_t, fs::path>> Files;
+  uint64_t Total = 0;
+  boost::system::error_code EC;
+  for (fs::recursive_directory_iterator It(Directory, EC), End;
+       !EC && It != End; It.increment(EC)) {
+    boost::system::error_code FileEC;
+    if (!fs::is_regular_file(It->path(), FileEC))
+      continue;
+    uint64_t FileSize = fs::file_size(It->path(), FileEC);
+    std::time_t Time = fs::last_write_time(It->path(), FileEC);
+    if (FileEC)
+      continue;
+    Files.emplace_back(Time, FileSize, It->path());
+    Total += FileSize;
+  }
+  if (Total > MaxSize) {
+    std::sort(Files.begin(), Files.end());
+    uint64_t Target = static_cast<uint64_t>(MaxSize * EvictionTarget);
+    for (const auto& [Time, FileSize, Path] : Files) {
+      if (Total <= Target)
+        break;
+      if (fs::remove(Path, EC))
+        Total -= FileSize;
+    }
+  }
+  DirectorySize = Total;
+}
+
+} // namespace gtirb_bprint
@@ -0,0 +1,467 @@
+//===- ObjectLayout.cpp -----------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "ObjectLayout.hpp"
+
+#include "AuxDataSchema.hpp"
+#include <capstone/capstone.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <variant>
+
+namespace gtirb_bprint {
+
+ObjectLayout::ObjectLayout(gtirb::Context& C, gtirb::Module& M,
+                           const gtirb_pprint::PrettyPrinter& Printer)
+    : Context(C), Module(M), Policy(Printer.getPolicy(M)) {
+  // The policy the printer would print the module with. When debugging, it
+  // skips nothing.
+  Printer.functionPolicy().apply(Policy.skipFunctions);
+  Printer.symbolPolicy().apply(Policy.skipSymbols);
+  Printer.sectionPolicy().apply(Policy.skipSections);
+  Printer.arraySectionPolicy().apply(Policy.arraySections);
+  if (Printer.getDebug()) {
+    Policy.skipFunctions.clear();
+    Policy.skipSymbols.clear();
+    Policy.skipSections.clear();
+  }
+}
+
+bool ObjectLayout::fits(int64_t Value, uint64_t Size) {
+  if (Size >= 8)
+    return true;
+  int64_t Limit = int64_t(1) << (Size * 8 - 1);
+  return Value >= -Limit && Value < 2 * Limit;
+}
+
+ObjectLayout::BlockView ObjectLayout::view(const gtirb::Node& Node) {
+  if (const auto* Code = dyn_cast<gtirb::CodeBlock>(&Node))
+    return {&Node,           Code->getByteInterval(), Code->getOffset(),
+            Code->getSize(), Code->getAddress(),      true};
+  const auto& Data = cast<gtirb::DataBlock>(Node);
+  return {&Node,           Data.getByteInterval(), Data.getOffset(),
+          Data.getSize(),  Data.getAddress(),      false};
+}
+
+bool ObjectLayout::skipSection(const gtirb::Section& Section) const {
+  return Section.blocks().empty() ||
+         Policy.skipSections.count(Section.getName()) > 0;
+}
+
+// Whether an address is in a skipped function. As for the printer, any name
+// of a function's entry skips it.
+bool ObjectLayout::inSkippedFunction(gtirb::Addr Addr) const {
+  auto It = FunctionEntries.upper_bound(Addr);
+  if (It == FunctionEntries.begin())
+    return false;
+  --It;
+  for (const gtirb::Symbol& Symbol : Module.findSymbols(*It))
+    if (Policy.skipFunctions.count(Symbol.getName()) > 0)
+      return true;
+  return false;
+}
+
+bool ObjectLayout::skipBlock(const BlockView& Block) const {
+  if (Policy.skipSections.count(
+          Block.Interval->getSection()->getName()) > 0)
+    return true;
+  return Block.Code && Block.Address && inSkippedFunction(*Block.Address);
+}
+
+bool ObjectLayout::skipSymbol(const gtirb::Symbol& Symbol) const {
+  if (Policy.skipSymbols.count(Symbol.getName()) > 0)
+    return true;
+  if (const auto* Code = Symbol.getReferent<gtirb::CodeBlock>())
+    return skipBlock(view(*Code));
+  if (const auto* Data = Symbol.getReferent<gtirb::DataBlock>())
+    return skipBlock(view(*Data));
+  if (Symbol.hasReferent())
+    return false;
+  std::optional<gtirb::Addr> Addr = Symbol.getAddress();
+  return Addr && inSkippedFunction(*Addr);
+}
+
+// The alignment the printer gives a block, see getAlignmentImpl.
+uint64_t ObjectLayout::alignment(const BlockView& Block,
+                                 bool ArraySection) const {
+  bool FirstInBI = Block.Offset == 0;
+  bool FirstInSection =
+      &Block.Interval->getSection()->byte_intervals().front() ==
+      Block.Interval;
+  if (const auto* Alignments = Module.getAuxData<gtirb::schema::Alignment>()) {
+    if (auto It = Alignments->find(Block.Node->getUUID());
+        It != Alignments->end())
+      return It->second;
+    if (FirstInBI) {
+      if (auto It = Alignments->find(Block.Interval->getUUID());
+          It != Alignments->end())
+        return It->second;
+      if (FirstInSection) {
+        if (auto It =
+                Alignments->find(Block.Interval->getSection()->getUUID());
+            It != Alignments->end())
+          return It->second;
+      }
+    }
+  }
+  if (ArraySection)
+    return 8;
+  if (FirstInBI && FirstInSection && Block.Address) {
+    for (uint64_t A : {16, 8, 4, 2})
+      if (uint64_t(*Block.Address) % A == 0)
+        return A;
+  }
+  return 1;
+}
+
+const gtirb::Symbol*
+ObjectLayout::forwarded(const gtirb::Symbol& Symbol) const {
+  const auto* Forwarding =
+      Module.getAuxData<gtirb::schema::SymbolForwarding>();
+  if (!Forwarding)
+    return nullptr;
+  auto It = Forwarding->find(Symbol.getUUID());
+  if (It == Forwarding->end())
+    return nullptr;
+  return dyn_cast_or_null<gtirb::Symbol>(
+      gtirb::Node::getByUUID(Context, It->second));
+}
+
+std::optional<uint64_t>
+ObjectLayout::address(const gtirb::Symbol& Symbol) const {
+  if (std::optional<gtirb::Addr> Addr = Symbol.getAddress())
+    return uint64_t(*Addr);
+  // The PE printer refers to the image base by name, without an address.
+  if (Symbol.getName() == "__ImageBase" || Symbol.getName() == "___ImageBase")
+    return uint64_t(Module.getPreferredAddr());
+  return std::nullopt;
+}
+
+uint8_t ObjectLayout::byte(const gtirb::ByteInterval& BI,
+                           uint64_t Offset) const {
+  if (Offset >= BI.getInitializedSize())
+    return 0;
+  return BI.rawBytes<uint8_t>()[Offset];
+}
+
+int64_t ObjectLayout::readSigned(const gtirb::ByteInterval& BI,
+                                 uint64_t Offset, uint64_t Size) const {
+  uint64_t Value = 0;
+  for (uint64_t I = 0; I < Size; ++I)
+    Value |= uint64_t(byte(BI, Offset + I)) << (8 * I);
+  if (Size < 8 && (Value >> (Size * 8 - 1)) & 1)
+    Value |= ~uint64_t(0) << (Size * 8);
+  return static_cast<int64_t>(Value);
+}
+
+void ObjectLayout::store(const Location& Where, int64_t Value,
+                         uint64_t Size) {
+  std::vector<uint8_t>& Bytes = Sections[Where.Section].Bytes;
+  for (uint64_t I = 0; I < Size; ++I)
+    Bytes[Where.Offset + I] =
+        static_cast<uint8_t>(static_cast<uint64_t>(Value) >> (8 * I));
+}
+
+std::optional<ObjectLayout::Location>
+ObjectLayout::locate(const gtirb::Symbol& Symbol) const {
+  const gtirb::Node* Referent = Symbol.getReferent<gtirb::CodeBlock>();
+  if (!Referent)
+    Referent = Symbol.getReferent<gtirb::DataBlock>();
+  if (!Referent || skipSymbol(Symbol))
+    return std::nullopt;
+  auto It = Blocks.find(Referent);
+  if (It == Blocks.end())
+    return std::nullopt;
+  Location Where = It->second.Where;
+  if (Symbol.getAtEnd())
+    Where.Offset += It->second.Size;
+  return Where;
+}
+
+bool ObjectLayout::place() {
+  for (const gtirb::Section& Source : Module.sections()) {
+    if (skipSection(Source))
+      continue;
+
+    Section Out{&Source};
+    bool ArraySection = Policy.arraySections.count(Source.getName()) > 0;
+    Out.ZeroFill = true;
+    for (const gtirb::ByteInterval& BI : Source.byte_intervals())
+      if (BI.getInitializedSize() > 0)
+        Out.ZeroFill = false;
+    size_t Index = Sections.size();
+
+    // Blocks are laid out one after the other, as the printer prints them.
+    // A block overlapping the previous one keeps its distance to it.
+    std::optional<uint64_t> OriginalEnd;
+    uint64_t End = 0;
+    for (const gtirb::Node& Node : Source.blocks()) {
+      BlockView Block = view(Node);
+      if (!Block.Address)
+        return fail("block without an address in " + Source.getName());
+      uint64_t Addr = uint64_t(*Block.Address);
+      if (skipBlock(Block))
+        continue;
+
+      Placed Where{{Index, 0}, Block.Size};
+      uint64_t Begin = 0;
+      if (OriginalEnd && Addr < *OriginalEnd) {
+        Where.Where.Offset = End - (*OriginalEnd - Addr);
+        Begin = std::min(*OriginalEnd - Addr, Block.Size);
+      } else {
+        uint64_t Align =
+            std::max<uint64_t>(alignment(Block, ArraySection), 1);
+        Out.Alignment = std::max(Out.Alignment, Align);
+        uint64_t Padded = (End + Align - 1) / Align * Align;
+        if (!Out.ZeroFill)
+          Out.Bytes.resize(Padded, Block.Code ? 0x90 : 0);
+        End = Padded;
+        Where.Where.Offset = End;
+
+        // An entry of an array section referring to a skipped symbol is left
+        // out, since the compiler adds it again; its label is kept.
+        if (ArraySection) {
+          if (auto SE = Block.Interval->getSymbolicExpression(Block.Offset)) {
+            if (const auto* SAC = std::get_if<gtirb::SymAddrConst>(&*SE);
+                SAC && skipSymbol(*SAC->Sym)) {
+              Where.Size = 0;
+              Blocks.emplace(&Node, Where);
+              continue;
+            }
+          }
+        }
+      }
+
+      if (!Out.ZeroFill) {
+        for (uint64_t I = Begin; I < Block.Size; ++I)
+          Out.Bytes.push_back(byte(*Block.Interval, Block.Offset + I));
+      }
+      End += Block.Size - Begin;
+      OriginalEnd = std::max(OriginalEnd.value_or(0), Addr + Block.Size);
+      Blocks.emplace(&Node, Where);
+      Order.emplace_back(Block, Where);
+    }
+    Out.Size = End;
+    Sections.push_back(std::move(Out));
+  }
+  return true;
+}
+
+bool ObjectLayout::refer(const BlockView& Block, const Placed& Where) {
+  const gtirb::ByteInterval& BI = *Block.Interval;
+  const std::string& Name = Sections[Where.Where.Section].Source->getName();
+  auto Range = BI.findSymbolicExpressionsAtOffset(Block.Offset,
+                                                  Block.Offset + Block.Size);
+  if (Range.begin() == Range.end())
+    return true;
+  if (Sections[Where.Where.Section].ZeroFill)
+    return fail("symbolic expression in " + Name);
+  if (!BI.getAddress())
+    return fail("byte interval without an address in " + Name);
+  uint64_t BIAddr = uint64_t(*BI.getAddress());
+
+  // The instructions of a code block, as the ends of the ranges of offsets
+  // they cover, since references relative to the program counter are
+  // relative to the end of the instruction.
+  std::map<uint64_t, uint64_t> Instructions;
+  if (Block.Code) {
+    csh Handle;
+    cs_mode Mode =
+        Module.getISA() == gtirb::ISA::IA32 ? CS_MODE_32 : CS_MODE_64;
+    if (cs_open(CS_ARCH_X86, Mode, &Handle) != CS_ERR_OK)
+      return fail("cannot open capstone");
+    std::vector<uint8_t> Bytes(Block.Size);
+    for (uint64_t I = 0; I < Block.Size; ++I)
+      Bytes[I] = byte(BI, Block.Offset + I);
+    const uint8_t* Code = Bytes.data();
+    size_t Size = Bytes.size();
+    uint64_t Address = BIAddr + Block.Offset;
+    cs_insn* Insn = cs_malloc(Handle);
+    while (cs_disasm_iter(Handle, &Code, &Size, &Address, Insn))
+      Instructions.emplace(Address - BIAddr, Insn->address - BIAddr);
+    cs_free(Insn, 1);
+    cs_close(&Handle);
+  }
+
+  const auto* Sizes =
+      Module.getAuxData<gtirb::schema::SymbolicExpressionSizes>();
+  for (const auto& SEE : Range) {
+    uint64_t Field = SEE.getOffset();
+    // Overlapping blocks share fields, which are referred to once.
+    if (!Referred.emplace(&BI, Field).second)
+      continue;
+    Location At{Where.Where.Section,
+                Where.Where.Offset + (Field - Block.Offset)};
+    const gtirb::SymbolicExpression& SE = SEE.getSymbolicExpression();
+
+    // The end of the instruction, or of the block for data.
+    uint64_t End = Block.Offset + Block.Size;
+    uint64_t InsnStart = Block.Offset;
+    if (Block.Code) {
+      auto It = Instructions.upper_bound(Field);
+      if (It == Instructions.end() || It->second > Field)
+        return fail("symbolic expression outside of instructions in " + Name);
+      End = It->first;
+      InsnStart = It->second;
+    }
+    uint64_t Room = End - Field;
+    uint64_t Pc = BIAddr + End;
+
+    // The size of a data field is recorded, or is that of a pointer.
+    std::optional<uint64_t> DataSize;
+    if (!Block.Code) {
+      DataSize = std::min<uint64_t>(
+          Module.getISA() == gtirb::ISA::IA32 ? 4 : 8, Room);
+      if (Sizes) {
+        if (auto It = Sizes->find(gtirb::Offset(BI.getUUID(), Field));
+            It != Sizes->end())
+          DataSize = It->second;
+      }
+    }
+
+    Reference Ref{At, 0, ReferenceKind::Absolute, nullptr, nullptr};
+    Ref.Code = Block.Code;
+    if (const auto* SAC = std::get_if<gtirb::SymAddrConst>(&SE)) {
+      // A reference to a forwarded symbol is to the symbol it is forwarded
+      // to, and one to a skipped symbol is to address 0, as printed.
+      Ref.Original = SAC->Sym;
+      Ref.Symbol = forwarded(*SAC->Sym);
+      bool Skipped = Ref.Symbol
+                         ? Policy.skipSymbols.count(Ref.Symbol->getName()) > 0
+                         : skipSymbol(*SAC->Sym);
+      if (!Ref.Symbol)
+        Ref.Symbol = SAC->Sym;
+      Ref.Addend = SAC->Offset;
+      Ref.Attributes = SAC->Attributes;
+      Ref.Branch =
+          (Field == InsnStart + 1 &&
+           (byte(BI, InsnStart) == 0xe8 || byte(BI, InsnStart) == 0xe9)) ||
+          (Field >= InsnStart + 2 && byte(BI, Field - 2) == 0x0f &&
+           (byte(BI, Field - 1) & 0xf0) == 0x80);
+
+      std::optional<uint64_t> Address = address(*SAC->Sym);
+      if (SAC->Attributes.isFlagSet(gtirb::SymAttribute::PltRef) ||
+          SAC->Attributes.isFlagSet(gtirb::SymAttribute::GotRelPC)) {
+        // These do not resolve to the symbol, so the bytes cannot tell;
+        // they are displacements.
+        Ref.Kind = ReferenceKind::PcRelative;
+        Ref.Size = 4;
+      } else if (DataSize) {
+        Ref.Size = *DataSize;
+      } else if (Address) {
+        // The bytes of the field hold the reference as the original link
+        // resolved it, which tells its size and kind.
+        uint64_t Value = *Address + static_cast<uint64_t>(Ref.Addend);
+        for (uint64_t S : {4, 1, 8, 2}) {
+          if (S > Room)
+            continue;
+          int64_t Bytes = readSigned(BI, Field, S);
+          if (Bytes == static_cast<int64_t>(Value - Pc) &&
+              fits(static_cast<int64_t>(Value - Pc), S)) {
+            Ref.Kind = ReferenceKind::PcRelative;
+            Ref.Size = S;
+            break;
+          }
+          if (S >= 4 &&
+              (static_cast<uint64_t>(Bytes) == Value ||
+               (S == 4 && static_cast<uint32_t>(Bytes) == Value))) {
+            Ref.Size = S;
+            Ref.Signed = S == 4 && Bytes == static_cast<int64_t>(Value);
+            break;
+          }
+        }
+      } else if (Ref.Branch && Room == 4) {
+        Ref.Kind = ReferenceKind::PcRelative;
+        Ref.Size = 4;
+      }
+      if (Ref.Size == 0 || Ref.Size > Room)
+        return fail("cannot tell how " + Name + " refers to " +
+                    Ref.Symbol->getName());
+      if (Skipped) {
+        store(At, 0, Ref.Size);
+        continue;
+      }
+      if (Ref.Kind == ReferenceKind::PcRelative)
+        Ref.Addend -= static_cast<int64_t>(End - Field);
+    } else if (const auto* SAA = std::get_if<gtirb::SymAddrAddr>(&SE)) {
+      if (SAA->Scale != 1)
+        return fail("scaled symbol difference in " + Name);
+      Ref.Kind = ReferenceKind::Difference;
+      Ref.Symbol = Ref.Original = SAA->Sym1;
+      Ref.Base = SAA->Sym2;
+      Ref.Addend = SAA->Offset;
+      Ref.Attributes = SAA->Attributes;
+      if (DataSize) {
+        Ref.Size = *DataSize;
+      } else {
+        std::optional<uint64_t> T1 = address(*SAA->Sym1);
+        std::optional<uint64_t> T2 = address(*SAA->Sym2);
+        for (uint64_t S : {4, 1, 8, 2}) {
+          if (S <= Room && T1 && T2 &&
+              readSigned(BI, Field, S) ==
+                  static_cast<int64_t>(*T1 - *T2 + SAA->Offset)) {
+            Ref.Size = S;
+            break;
+          }
+        }
+      }
+      if (Ref.Size == 0 || Ref.Size > Room)
+        return fail("cannot tell the size of a symbol difference in " + Name);
+
+      // The difference between two places of a section is known.
+      std::optional<Location> From = locate(*SAA->Sym2);
+      std::optional<Location> To = locate(*SAA->Sym1);
+      if (From && To && From->Section == To->Section) {
+        store(At,
+              static_cast<int64_t>(To->Offset - From->Offset) + SAA->Offset,
+              Ref.Size);
+        continue;
+      }
+    }
+    References.push_back(std::move(Ref));
+  }
+  return true;
+}
+
+bool ObjectLayout::build(std::string& Message) {
+  if (const auto* Entries =
+          Module.getAuxData<gtirb::schema::FunctionEntries>()) {
+    for (const auto& [Function, EntryBlocks] : *Entries)
+      for (const gtirb::UUID& Id : EntryBlocks)
+        if (const auto* Block = dyn_cast_or_null<gtirb::CodeBlock>(
+                gtirb::Node::getByUUID(Context, Id)))
+          if (std::optional<gtirb::Addr> Addr = Block->getAddress())
+            FunctionEntries.insert(*Addr);
+  }
+  bool Ok = place();
+  for (const auto& [Block, Where] : Order) {
+    if (!Ok)
+      break;
+    Ok = refer(Block, Where);
+  }
+  if (!Ok)
+    Message = Error;
+  return Ok;
+}
+
+bool ObjectEncoder::write(const std::string& Path) const {
+  std::ofstream Out(Path, std::ios::binary | std::ios::trunc);
+  Out.write(reinterpret_cast<const char*>(Bytes.data()),
+            static_cast<std::streamsize>(Bytes.size()));
+  Out.close();
+  return static_cast<bool>(Out);
+}
+
+} // namespace gtirb_bprint
@@ -0,0 +1,601 @@
+//===- OutputBuffer.cpp -----------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "OutputBuffer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <limits>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#if defined(_MSC_VER)
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#ifdef GTIRB_PPRINTER_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace gtirb_pprint {
+
+// Write a block to a file descriptor, retrying after interruptions and short
+// writes.
+static bool writeAll(int Fd, const char* Data, size_t Size) {
+  while (Size > 0) {
+#if defined(_MSC_VER)
+    int Written =
+        ::_write(Fd, Data, static_cast<unsigned int>(std::min<size_t>(
+                               Size, std::numeric_limits<int>::max())));
+#else
+    ssize_t Written = ::write(Fd, Data, Size);
+#endif
+    if (Written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    Data += Written;
+    Size -= static_cast<size_t>(Written);
+  }
+  return true;
+}
+
+static bool closeFd(int Fd) {
+#if defined(_MSC_VER)
+  return ::_close(Fd) == 0;
+#else
+  return ::close(Fd) == 0;
+#endif
+}
+
+static int createFile(const std::string& Path) {
+#if defined(_MSC_VER)
+  // Text mode, so that line endings match what std::ofstream produced.
+  return ::_open(Path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_TEXT,
+                 _S_IREAD | _S_IWRITE);
+#else
+  return ::open(Path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+#endif
+}
+
+OutputBuffer::OutputBuffer(size_t Capacity)
+    : Buffer(std::max<size_t>(Capacity, 1)) {
+  setp(Buffer.data(), Buffer.data() + Buffer.size());
+}
+
+bool OutputBuffer::reserve(size_t Capacity) {
+  Capacity = std::max<size_t>(Capacity, 1);
+  if (size() > Capacity && !flush()) {
+    return false;
+  }
+  size_t Used = size();
+  Buffer.resize(Capacity);
+  setp(Buffer.data(), Buffer.data() + Buffer.size());
+  advance(Used);
+  return true;
+}
+
+bool OutputBuffer::flush() {
+  char* Data = pbase();
+  size_t Used = size();
+  setp(pbase(), epptr());
+  return Used == 0 || drain(Data, Used);
+}
+
+bool OutputBuffer::drainv(const char* Buffered, size_t BufferedSize,
+                          const char* Data, size_t Size) {
+  return (BufferedSize == 0 || drain(Buffered, BufferedSize)) &&
+         drain(Data, Size);
+}
+
+OutputBuffer::int_type OutputBuffer::overflow(int_type Ch) {
+  if (!flush()) {
+    return traits_type::eof();
+  }
+  if (!traits_type::eq_int_type(Ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(Ch);
+    pbump(1);
+  }
+  return traits_type::not_eof(Ch);
+}
+
+std::streamsize OutputBuffer::xsputn(const char* S, std::streamsize N) {
+  size_t Size = static_cast<size_t>(N);
+  auto Free = [this]() { return static_cast<size_t>(epptr() - pptr()); };
+  if (Size > Free()) {
+    if (Size < capacity() && !flush()) {
+      return 0;
+    }
+    // The block is too large to be worth copying, or the sink moved output
+    // to a smaller area: write the buffered content and the new block
+    // together.
+    if (Size > Free()) {
+      char* Data = pbase();
+      size_t Used = size();
+      setp(pbase(), epptr());
+      return drainv(Data, Used, S, Size) ? N : 0;
+    }
+  }
+  std::memcpy(pptr(), S, Size);
+  advance(Size);
+  return N;
+}
+
+void OutputBuffer::advance(size_t Count) {
+  // pbump takes an int, so buffers larger than 2 GiB are crossed in steps.
+  while (Count > 0) {
+    size_t Step = std::min<size_t>(Count, std::numeric_limits<int>::max());
+    pbump(static_cast<int>(Step));
+    Count -= Step;
+  }
+}
+
+// Flushing is explicit; see flush().
+int OutputBuffer::sync() { return 0; }
+
+FdOutputBuffer::FdOutputBuffer(int Fd_, bool OwnsFd_, size_t Capacity)
+    : OutputBuffer(Capacity), Fd(Fd_), OwnsFd(OwnsFd_) {}
+
+FdOutputBuffer::~FdOutputBuffer() { close(); }
+
+std::unique_ptr<FdOutputBuffer> FdOutputBuffer::open(const std::string& Path,
+                                                     size_t Capacity) {
+  int Fd = createFile(Path);
+  if (Fd < 0) {
+    return nullptr;
+  }
+  return std::make_unique<FdOutputBuffer>(Fd, true, Capacity);
+}
+
+bool FdOutputBuffer::close() {
+  if (Fd < 0) {
+    return !Failed;
+  }
+  if (!flush()) {
+    Failed = true;
+  }
+  if (OwnsFd && !closeFd(Fd)) {
+    Failed = true;
+  }
+  Fd = -1;
+  return !Failed;
+}
+
+bool FdOutputBuffer::drain(const char* Data, size_t Size) {
+  if (Fd < 0 || !writeAll(Fd, Data, Size)) {
+    Failed = true;
+    return false;
+  }
+  return true;
+}
+
+bool FdOutputBuffer::drainv(const char* Buffered, size_t BufferedSize,
+                            const char* Data, size_t Size) {
+#if defined(_MSC_VER)
+  return OutputBuffer::drainv(Buffered, BufferedSize, Data, Size);
+#else
+  struct iovec Vec[2] = {{const_cast<char*>(Buffered), BufferedSize},
+                         {const_cast<char*>(Data), Size}};
+  struct iovec* It = BufferedSize > 0 ? Vec : Vec + 1;
+  int Count = BufferedSize > 0 ? 2 : 1;
+  if (Fd < 0) {
+    Failed = true;
+    return false;
+  }
+  while (Count > 0) {
+    ssize_t Written = ::writev(Fd, It, Count);
+    if (Written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      Failed = true;
+      return false;
+    }
+    // Skip over whatever was written, which may end in the middle of a block.
+    size_t Remaining = static_cast<size_t>(Written);
+    while (Count > 0 && Remaining >= It->iov_len) {
+      Remaining -= It->iov_len;
+      ++It;
+      --Count;
+    }
+    if (Count > 0) {
+      It->iov_base = static_cast<char*>(It->iov_base) + Remaining;
+      It->iov_len -= Remaining;
+    }
+  }
+  return true;
+#endif
+}
+
+StringOutputBuffer::StringOutputBuffer(size_t CapacityHint)
+    : OutputBuffer(1), Text(std::max<size_t>(CapacityHint, 1), '\0') {
+  // The string itself is the output area; the base class's buffer is unused.
+  setArea(&Text[0], Text.size());
+}
+
+bool StringOutputBuffer::reserve(size_t Capacity) {
+  if (Capacity > Text.size()) {
+    grow(Capacity);
+  }
+  return true;
+}
+
+std::string StringOutputBuffer::take() {
+  flush();
+  Text.resize(Committed);
+  std::string Result = std::move(Text);
+  Text.assign(1, '\0');
+  Committed = 0;
+  setArea(&Text[0], Text.size());
+  return Result;
+}
+
+void StringOutputBuffer::grow(size_t MinSize) {
+  size_t Used = size();
+  Text.resize(std::max(MinSize, Text.size() * 2));
+  setArea(&Text[Committed], Text.size() - Committed);
+  advance(Used);
+}
+
+bool StringOutputBuffer::drain(const char* Data, size_t Size) {
+  if (Data != Text.data() + Committed) {
+    // A block that bypassed the output area.
+    if (Text.size() - Committed < Size) {
+      grow(Committed + Size);
+    }
+    std::memcpy(&Text[Committed], Data, Size);
+  }
+  Committed += Size;
+  if (Committed == Text.size()) {
+    grow(Text.size() + 1);
+  } else {
+    setArea(&Text[Committed], Text.size() - Committed);
+  }
+  return true;
+}
+
+CallbackOutputBuffer::CallbackOutputBuffer(
+    std::function<bool(const char*, size_t)> Callback_, size_t Capacity)
+    : OutputBuffer(Capacity), Callback(std::move(Callback_)) {}
+
+CallbackOutputBuffer::~CallbackOutputBuffer() { close(); }
+
+bool CallbackOutputBuffer::close() {
+  if (!flush()) {
+    Failed = true;
+  }
+  return !Failed;
+}
+
+bool CallbackOutputBuffer::drain(const char* Data, size_t Size) {
+  if (Failed || !Callback(Data, Size)) {
+    Failed = true;
+    return false;
+  }
+  return true;
+}
+
+/// Performs the writes submitted by an AsyncFileOutputBuffer. Each slot of the
+/// ring has at most one write in flight.
+class AsyncFileOutputBuffer::Writer {
+public:
+  virtual ~Writer() = default;
+
+  /// Start writing a full slot at the end of the file.
+  virtual void submit(size_t Slot, const char* Data, size_t Size) = 0;
+
+  /// Wait until the write from a slot has completed.
+  virtual void wait(size_t Slot) = 0;
+
+  /// Wait until all writes have completed.
+  virtual void finish() = 0;
+
+  virtual bool usesIoUring() const { return false; }
+
+  bool failed() const { return Failed; }
+
+protected:
+  // Set by the thread of a ThreadWriter while the buffer reads it.
+  std::atomic<bool> Failed{false};
+};
+
+namespace {
+
+class ThreadWriter : public AsyncFileOutputBuffer::Writer {
+public:
+  ThreadWriter(int Fd_, size_t SlotCount)
+      : Fd(Fd_), Busy(SlotCount, false), Worker([this]() { run(); }) {}
+
+  ~ThreadWriter() override { finish(); }
+
+  void submit(size_t Slot, const char* Data, size_t Size) override {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    Busy[Slot] = true;
+    Queue.push_back({Slot, Data, Size});
+    Changed.notify_all();
+  }
+
+  void wait(size_t Slot) override {
+    std::unique_lock<std::mutex> Lock(Mutex);
+    Changed.wait(Lock, [&]() { return !Busy[Slot]; });
+  }
+
+  void finish() override {
+    {
+      std::lock_guard<std::mutex> Lock(Mutex);
+      Stopping = true;
+      Changed.notify_all();
+    }
+    if (Worker.joinable()) {
+      Worker.join();
+    }
+  }
+
+private:
+  struct Request {
+    size_t Slot;
+    const char* Data;
+    size_t Size;
+  };
+
+  void run() {
+    std::unique_lock<std::mutex> Lock(Mutex);
+    while (true) {
+      Changed.wait(Lock, [&]() { return Stopping || !Queue.empty(); });
+      if (Queue.empty()) {
+        return;
+      }
+      Request R = Queue.front();
+      Queue.pop_front();
+
+      Lock.unlock();
+      // Once a write has failed, drop the rest of the output.
+      bool Ok = !Failed && writeAll(Fd, R.Data, R.Size);
+      Lock.lock();
+
+      Failed = Failed || !Ok;
+      Busy[R.Slot] = false;
+      Changed.notify_all();
+    }
+  }
+
+  int Fd;
+  std::vector<bool> Busy;
+  std::deque<Request> Queue;
+  bool Stopping = false;
+  std::mutex Mutex;
+  std::condition_variable Changed;
+  std::thread Worker;
+};
+
+#ifdef GTIRB_PPRINTER_HAVE_LIBURING
+class UringWriter : public AsyncFileOutputBuffer::Writer {
+public:
+  /// Set up an io_uring instance, or return nullptr if the kernel does not
+  /// provide one (or forbids it).
+  static std::unique_ptr<UringWriter> create(int Fd, size_t SlotCount) {
+    std::unique_ptr<UringWriter> W(new UringWriter(Fd, SlotCount));
+    if (io_uring_queue_init(static_cast<unsigned>(SlotCount), &W->Ring, 0) <
+        0) {
+      return nullptr;
+    }
+    W->Initialized = true;
+    return W;
+  }
+
+  ~UringWriter() override {
+    if (Initialized) {
+      finish();
+      io_uring_queue_exit(&Ring);
+    }
+  }
+
+  void submit(size_t Slot, const char* Data, size_t Size) override {
+    Pending& P = Slots[Slot];
+    P.Vec.iov_base = const_cast<char*>(Data);
+    P.Vec.iov_len = Size;
+    P.Offset = Offset;
+    P.Busy = true;
+    Offset += Size;
+    ++InFlight;
+    queue(P);
+  }
+
+  void wait(size_t Slot) override {
+    while (Slots[Slot].Busy && reap()) {
+    }
+  }
+
+  void finish() override {
+    while (InFlight > 0 && reap()) {
+    }
+  }
+
+  bool usesIoUring() const override { return true; }
+
+private:
+  struct Pending {
+    struct iovec Vec;
+    uint64_t Offset = 0;
+    bool Busy = false;
+  };
+
+  UringWriter(int Fd_, size_t SlotCount) : Fd(Fd_), Slots(SlotCount) {}
+
+  void complete(Pending& P, bool Ok) {
+    Failed = Failed || !Ok;
+    P.Busy = false;
+    --InFlight;
+  }
+
+  void queue(Pending& P) {
+    // At most one write per slot is in flight, and the ring has one entry
+    // per slot, so a submission entry is always available.
+    io_uring_sqe* Sqe = io_uring_get_sqe(&Ring);
+    if (!Sqe) {
+      complete(P, false);
+      return;
+    }
+    io_uring_prep_writev(Sqe, Fd, &P.Vec, 1, P.Offset);
+    io_uring_sqe_set_data(Sqe, &P);
+    if (io_uring_submit(&Ring) < 0) {
+      complete(P, false);
+    }
+  }
+
+  // Wait for one completion. Returns false if no completion can be expected.
+  bool reap() {
+    io_uring_cqe* Cqe = nullptr;
+    int Ret = io_uring_wait_cqe(&Ring, &Cqe);
+    if (Ret == -EINTR) {
+      return true;
+    }
+    if (Ret < 0) {
+      Failed = true;
+      return false;
+    }
+    Pending& P = *static_cast<Pending*>(io_uring_cqe_get_data(Cqe));
+    int Res = Cqe->res;
+    io_uring_cqe_seen(&Ring, Cqe);
+
+    if (Res == -EINTR || Res == -EAGAIN) {
+      queue(P);
+    } else if (Res < 0) {
+      complete(P, false);
+    } else if (static_cast<size_t>(Res) < P.Vec.iov_len) {
+      // Short write: submit the rest.
+      P.Vec.iov_base = static_cast<char*>(P.Vec.iov_base) + Res;
+      P.Vec.iov_len -= static_cast<size_t>(Res);
+      P.Offset += static_cast<uint64_t>(Res);
+      queue(P);
+    } else {
+      complete(P, true);
+    }
+    return true;
+  }
+
+  int Fd;
+  io_uring Ring;
+  bool Initialized = false;
+  uint64_t Offset = 0;
+  size_t InFlight = 0;
+  std::vector<Pending> Slots;
+};
+#endif // GTIRB_PPRINTER_HAVE_LIBURING
+
+} // namespace
+
+AsyncFileOutputBuffer::AsyncFileOutputBuffer(int Fd_, std::unique_ptr<Writer> W,
+                                             size_t SlotSize, size_t SlotCount)
+    : OutputBuffer(SlotSize), Fd(Fd_), AsyncWriter(std::move(W)) {
+  // The base class's own buffer is the first slot of the ring.
+  Slots.push_back(pbase());
+  SlotStorage.resize(SlotCount - 1);
+  for (auto& Storage : SlotStorage) {
+    Storage.resize(capacity());
+    Slots.push_back(Storage.data());
+  }
+}
+
+AsyncFileOutputBuffer::~AsyncFileOutputBuffer() { close(); }
+
+std::unique_ptr<AsyncFileOutputBuffer>
+AsyncFileOutputBuffer::open(const std::string& Path, size_t SlotSize,
+                            size_t SlotCount) {
+  SlotCount = std::max<size_t>(SlotCount, 2);
+  int Fd = createFile(Path);
+  if (Fd < 0) {
+    return nullptr;
+  }
+
+  std::unique_ptr<Writer> W;
+#ifdef GTIRB_PPRINTER_HAVE_LIBURING
+  // io_uring writes at explicit offsets, which requires a regular file.
+  struct stat St;
+  if (fstat(Fd, &St) == 0 && S_ISREG(St.st_mode)) {
+    W = UringWriter::create(Fd, SlotCount);
+  }
+#endif
+  if (!W) {
+    W = std::make_unique<ThreadWriter>(Fd, SlotCount);
+  }
+  return std::unique_ptr<AsyncFileOutputBuffer>(
+      new AsyncFileOutputBuffer(Fd, std::move(W), SlotSize, SlotCount));
+}
+
+bool AsyncFileOutputBuffer::reserve(size_t /* Capacity */) { return false; }
+
+bool AsyncFileOutputBuffer::usesIoUring() const {
+  return AsyncWriter && AsyncWriter->usesIoUring();
+}
+
+bool AsyncFileOutputBuffer::close() {
+  if (Fd < 0) {
+    return !Failed;
+  }
+  if (!flush()) {
+    Failed = true;
+  }
+  AsyncWriter->finish();
+  Failed = Failed || AsyncWriter->failed();
+  AsyncWriter.reset();
+  if (!closeFd(Fd)) {
+    Failed = true;
+  }
+  Fd = -1;
+  return !Failed;
+}
+
+bool AsyncFileOutputBuffer::drain(const char* Data, size_t Size) {
+  if (Fd < 0) {
+    Failed = true;
+    return false;
+  }
+  AsyncWriter->submit(Current, Data, Size);
+
+  // Continue in the next slot of the ring once its previous write is done.
+  Current = (Current + 1) % Slots.size();
+  AsyncWriter->wait(Current);
+  setArea(Slots[Current], capacity());
+  return !AsyncWriter->failed();
+}
+
+bool AsyncFileOutputBuffer::drainv(const char* Buffered, size_t BufferedSize,
+                                   const char* Data, size_t Size) {
+  if (BufferedSize > 0 && !drain(Buffered, BufferedSize)) {
+    return false;
+  }
+  // The caller's block may not outlive this call, so copy it into the ring.
+  while (Size > 0) {
+    size_t Chunk = std::min(Size, capacity());
+    std::memcpy(Slots[Current], Data, Chunk);
+    if (!drain(Slots[Current], Chunk)) {
+      return false;
+    }
+    Data += Chunk;
+    Size -= Chunk;
+  }
+  return true;
+}
+
+} // namespace gtirb_pprint
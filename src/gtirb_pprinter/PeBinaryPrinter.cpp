@@ -14,6 +14,7 @@
 //===----------------------------------------------------------------------===//
 #include "PeBinaryPrinter.hpp"
 #include "AuxDataSchema.hpp"
+#include "CoffObjectPrinter.hpp"
 #include "driver/Logger.h"
 #include "file_utils.hpp"
 #include <iostream>
@@ -218,7 +219,7 @@ bool PeBinaryPrinter::prepareImportLibs(
       args.push_back(std::string("/DEF:") + tf.fileName());
       args.push_back(std::string("/OUT:") + libName);
       args.push_back(std::string("/MACHINE:" + Machine));
-      if (std::optional<int> ret = execute(libTool, args)) {
+      if (std::optional<int> ret = executeTool(libTool, args)) {
         if (*ret) {
           std::cerr << "ERROR: lib returned: " << *ret << "\n";
           return false;
@@ -313,7 +314,22 @@ PeBinaryPrinter::PeBinaryPrinter(
 int PeBinaryPrinter::assemble(const std::string& outputFilename,
                               gtirb::Context& context,
                               gtirb::Module& mod) const {
-  std::vector<TempFile> tempFiles(1);
+  // Extra arguments are for the assembler, which the object writer cannot
+  // honor.
+  if (DirectObjects && ExtraCompileArgs.empty() &&
+      CoffObjectPrinter::supports(mod)) {
+    std::string error;
+    if (CoffObjectPrinter(Printer).write(context, mod, outputFilename,
+                                         error)) {
+      ++DirectWrites;
+      return 0;
+    }
+    LOG_INFO << "Could not write the object directly, assembling it:\n"
+             << error << "\n";
+  }
+
+  std::vector<TempFile> tempFiles;
+  tempFiles.emplace_back(".s", estimateSourceSize(mod));
   if (!prepareSource(context, mod, tempFiles[0])) {
     std::cerr << "ERROR: Could not write assembly into a temporary file.\n";
     return -1;
@@ -325,7 +341,8 @@ int PeBinaryPrinter::assemble(const std::string& outputFilename,
                             {"/c", "/Fo", outputFilename}, args);
 
   // Invoke the assembler.
-  if (std::optional<int> ret = execute(compiler, args)) {
+  if (std::optional<int> ret = executeCached(
+          compiler, args, {tempFiles[0].fileName()}, outputFilename)) {
     if (*ret)
       std::cerr << "ERROR: assembler returned: " << *ret << "\n";
     return *ret;
@@ -346,12 +363,24 @@ int PeBinaryPrinter::link(const std::string& outputFilename,
     }
   }
 
-  // Prepare all of the files we're going to generate assembly into.
+  // Prepare all of the files we're going to generate assembly into. ml64
+  // links objects given in their place, so the objects of modules are
+  // written directly when possible.
+  startLink();
+  auto start = std::chrono::steady_clock::now();
   std::vector<TempFile> tempFiles;
-  if (!prepareSources(ctx, ir, tempFiles)) {
+  if (DirectObjects) {
+    for (gtirb::Module& Module : ir.modules()) {
+      tempFiles.emplace_back(".obj", TempFile::OnDisk);
+      tempFiles.back().close();
+      if (assemble(tempFiles.back().fileName(), ctx, Module))
+        return -1;
+    }
+  } else if (!prepareSources(ctx, ir, tempFiles)) {
     std::cerr << "ERROR: Could not write assembly into a temporary file.\n";
     return -1;
   }
+  recordStep(DirectObjects ? "assemble" : "print", start);
 
   // Prepare import definition files and generate import libraries for the
   // linker
@@ -381,8 +410,22 @@ int PeBinaryPrinter::link(const std::string& outputFilename,
   // Collect linker arguments
   prepareLinkerArguments(ir, resourceFiles, defFileName, args);
 
+  // The assembly or the objects, the import libraries and the DEF and
+  // resource files determine the binary.
+  std::vector<std::string> inputs;
+  for (const TempFile& tempFile : tempFiles)
+    inputs.push_back(tempFile.fileName());
+  inputs.insert(inputs.end(), importLibs.begin(), importLibs.end());
+  if (!defFileName.empty())
+    inputs.push_back(defFileName);
+  inputs.insert(inputs.end(), resourceFiles.begin(), resourceFiles.end());
+
   // Invoke the assembler.
-  if (std::optional<int> ret = execute(compiler, args)) {
+  start = std::chrono::steady_clock::now();
+  std::optional<int> ret =
+      executeCached(compiler, args, inputs, outputFilename);
+  recordStep(DirectObjects ? "link" : "assemble and link", start);
+  if (ret) {
     if (*ret)
       std::cerr << "ERROR: assembler returned: " << *ret << "\n";
     return *ret;
@@ -15,7 +15,9 @@
 #include "PrettyPrinter.hpp"
 
 #include "AuxDataSchema.hpp"
+#include "OutputBuffer.hpp"
 #include "string_utils.hpp"
+#include <algorithm>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/range/algorithm/find_if.hpp>
@@ -24,6 +26,10 @@
 #include <gtirb/gtirb.hpp>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <sstream>
+#include <type_traits>
+#include <typeinfo>
 #include <utility>
 #include <variant>
 
@@ -186,20 +192,94 @@ const PrintingPolicy& PrettyPrinter::getPolicy(gtirb::Module& Module) const {
 std::error_condition PrettyPrinter::print(std::ostream& stream,
                                           gtirb::Context& context,
                                           gtirb::Module& module) const {
+  createPrinter(context, module)->print(stream);
+  return std::error_condition{};
+}
+
+std::error_condition PrettyPrinter::print(
+    const std::vector<std::pair<std::string, std::ostream*>>& streams,
+    gtirb::Context& context, gtirb::Module& module) const {
+  std::vector<std::unique_ptr<PrettyPrinterBase>> Printers;
+  std::vector<std::pair<PrettyPrinterBase*, std::ostream*>> Outputs;
+  for (const auto& [Syntax, Stream] : streams) {
+    PrettyPrinter SyntaxPrinter(*this);
+    if (SyntaxPrinter.m_format.empty()) {
+      SyntaxPrinter.m_format = getModuleFileFormat(module);
+      SyntaxPrinter.m_isa = getModuleISA(module);
+    }
+    SyntaxPrinter.m_syntax = Syntax;
+    auto Target = std::make_tuple(SyntaxPrinter.m_format, SyntaxPrinter.m_isa,
+                                  SyntaxPrinter.m_syntax);
+    if (getFactories().count(Target) == 0 ||
+        (PolicyName != "default" &&
+         !SyntaxPrinter.namedPolicyExists(PolicyName))) {
+      return std::make_error_condition(std::errc::invalid_argument);
+    }
+    Printers.push_back(SyntaxPrinter.createPrinter(context, module));
+    Outputs.emplace_back(Printers.back().get(), Stream);
+  }
+  PrettyPrinterBase::printAll(Outputs);
+  return std::error_condition{};
+}
+
+std::error_condition
+PrettyPrinter::print(const ModuleSplit& split,
+                     const std::vector<std::ostream*>& streams,
+                     gtirb::Context& context, gtirb::Module& module) const {
+  if (streams.size() != split.size())
+    return std::make_error_condition(std::errc::invalid_argument);
+  createPrinter(context, module)->printUnits(split, streams);
+  return std::error_condition{};
+}
+
+std::unique_ptr<PrettyPrinterBase>
+PrettyPrinter::createPrinter(gtirb::Context& Context,
+                             gtirb::Module& Module) const {
   // Find pretty printer factory.
-  PrettyPrinterFactory& Factory = getFactory(module);
+  PrettyPrinterFactory& Factory = getFactory(Module);
 
   // Configure printing policy.
-  PrintingPolicy policy(getPolicy(module));
+  PrintingPolicy policy(getPolicy(Module));
   policy.debug = m_debug;
+  policy.profile = m_profile;
   FunctionPolicy.apply(policy.skipFunctions);
   SymbolPolicy.apply(policy.skipSymbols);
   SectionPolicy.apply(policy.skipSections);
   ArraySectionPolicy.apply(policy.arraySections);
 
-  // Create the pretty printer and print the IR.
-  Factory.create(context, module, policy)->print(stream);
+  std::unique_ptr<PrettyPrinterBase> Printer =
+      Factory.create(Context, Module, policy);
+  Printer->setBlockCache(m_blockCache.get());
+  return Printer;
+}
 
+std::error_condition PrettyPrinter::print(OutputBuffer& buffer,
+                                          gtirb::Context& context,
+                                          gtirb::Module& module) const {
+  std::ostream stream(&buffer);
+  if (std::error_condition err = print(stream, context, module))
+    return err;
+  if (!buffer.flush() || !stream)
+    return std::make_error_condition(std::errc::io_error);
+  return std::error_condition{};
+}
+
+std::error_condition PrettyPrinter::print(std::ostream& stream,
+                                          PreparedModule& module) const {
+  std::unique_ptr<PrettyPrinterBase> Printer =
+      createPrinter(module.context(), module.module());
+  module.attach(*Printer);
+  Printer->print(stream);
+  return std::error_condition{};
+}
+
+std::error_condition PrettyPrinter::print(OutputBuffer& buffer,
+                                          PreparedModule& module) const {
+  std::ostream stream(&buffer);
+  if (std::error_condition err = print(stream, module))
+    return err;
+  if (!buffer.flush() || !stream)
+    return std::make_error_condition(std::errc::io_error);
   return std::error_condition{};
 }
 
@@ -242,8 +322,36 @@ PrettyPrinterBase::PrettyPrinterBase(gtirb::Context& context_,
                                      const Syntax& syntax_,
                                      const PrintingPolicy& policy_)
     : syntax(syntax_), policy(policy_),
-      debug(policy.debug == DebugMessages ? true : false), context(context_),
-      module(module_), functionEntry(), functionLastBlock() {
+      debug(policy.debug == DebugMessages ? true : false),
+      compact(policy.profile == Machine), context(context_),
+      module(module_) {}
+
+PrettyPrinterBase::~PrettyPrinterBase() { cs_close(&this->csHandle); }
+
+struct PrettyPrinterBase::ModuleIndex {
+  std::set<gtirb::Addr> FunctionEntry;
+  std::set<gtirb::Addr> FunctionLastBlock;
+
+  // A number for each symbol whose name is ambiguous, distinguishing it from
+  // the other symbols with the same name.
+  std::optional<std::unordered_map<const gtirb::Symbol*, size_t>> Disambig;
+  // The number of symbols in the module when Disambig was computed.
+  size_t DisambigSymbols = 0;
+
+  // The symbols of the block being printed. Printers driven by printAll()
+  // visit each block one after another, so they find its symbols once.
+  const gtirb::Node* SymbolsBlock = nullptr;
+  std::vector<const gtirb::Symbol*> Symbols;
+
+  // The names of the symbols at the blocks of each skipped function name.
+  std::unordered_map<std::string, std::vector<std::string>> FunctionAliases;
+};
+
+PrettyPrinterBase::ModuleIndex& PrettyPrinterBase::moduleIndex() const {
+  if (Index) {
+    return *Index;
+  }
+  Index = std::make_shared<ModuleIndex>();
 
   if (const auto* functionEntries =
           module.getAuxData<gtirb::schema::FunctionEntries>()) {
@@ -253,7 +361,7 @@ PrettyPrinterBase::PrettyPrinterBase(gtirb::Context& context_,
             nodeFromUUID<gtirb::CodeBlock>(context, entryBlockUUID);
         assert(block && "UUID references non-existent block.");
         if (block)
-          functionEntry.insert(*block->getAddress());
+          Index->FunctionEntry.insert(*block->getAddress());
       }
     }
   }
@@ -269,33 +377,120 @@ PrettyPrinterBase::PrettyPrinterBase(gtirb::Context& context_,
         if (block && block->getAddress() > lastAddr)
           lastAddr = *block->getAddress();
       }
-      functionLastBlock.insert(lastAddr);
+      Index->FunctionLastBlock.insert(lastAddr);
+    }
+  }
+  return *Index;
+}
+
+size_t
+PrettyPrinterBase::disambiguationIndex(const gtirb::Symbol& Symbol) const {
+  ModuleIndex& I = moduleIndex();
+  if (I.Disambig) {
+    auto It = I.Disambig->find(&Symbol);
+    if (It != I.Disambig->end())
+      return It->second;
+    // The symbol was added or renamed since the numbers were assigned:
+    // number the symbols of the module again.
+    I.Disambig.reset();
+  }
+  {
+    // Number the symbols sharing a name by address, then by UUID, so that
+    // the numbers do not depend on where the symbols are allocated.
+    std::unordered_map<std::string, std::vector<const gtirb::Symbol*>> Groups;
+    for (const auto& Sym : module.symbols()) {
+      if (isAmbiguousSymbol(Sym.getName()))
+        Groups[Sym.getName()].push_back(&Sym);
+    }
+    I.Disambig.emplace();
+    I.DisambigSymbols = static_cast<size_t>(
+        std::distance(module.symbols_begin(), module.symbols_end()));
+    for (auto& [Name, Syms] : Groups) {
+      std::sort(Syms.begin(), Syms.end(),
+                [](const gtirb::Symbol* A, const gtirb::Symbol* B) {
+                  return std::make_pair(A->getAddress(), A->getUUID()) <
+                         std::make_pair(B->getAddress(), B->getUUID());
+                });
+      // Skip the numbers that would repeat the name of another symbol, in
+      // either profile, such as a symbol named foo_d0 next to two foos.
+      size_t N = 0;
+      for (const gtirb::Symbol* Sym : Syms) {
+        while (!module.findSymbols(Name + "_d" + std::to_string(N)).empty() ||
+               !module.findSymbols(Name + "_disambig_" + std::to_string(N))
+                    .empty())
+          ++N;
+        I.Disambig->emplace(Sym, N++);
+      }
     }
   }
+  auto It = I.Disambig->find(&Symbol);
+  assert(It != I.Disambig->end() && "symbol name is not ambiguous");
+  return It != I.Disambig->end() ? It->second : 0;
+}
 
+void PrettyPrinterBase::skipFunctionAliases() {
   // FIXME: Make getContainerFunctionName return multiple labels, remove this.
   // Alias all labels at skipped function blocks; getContainerFunctionName gives
   // only one label, which may not be in the list of skipped functions. Find the
   // additional names and a separate pass from adding them to avoid updating the
   // container while iterating over it.
+  ModuleIndex& I = moduleIndex();
   std::vector<std::string> AdditionalSkips;
   for (const std::string& Name : policy.skipFunctions) {
-    for (const gtirb::Symbol& Symbol : module.findSymbols(Name)) {
-      if (const auto* Block = Symbol.getReferent<gtirb::CodeBlock>()) {
-        if (Block->getAddress()) {
-          for (const auto& Other : module.findSymbols(*Block->getAddress())) {
-            AdditionalSkips.emplace_back(Other.getName());
+    auto [It, Inserted] = I.FunctionAliases.try_emplace(Name);
+    if (Inserted) {
+      for (const gtirb::Symbol& Symbol : module.findSymbols(Name)) {
+        if (const auto* Block = Symbol.getReferent<gtirb::CodeBlock>()) {
+          if (Block->getAddress()) {
+            for (const auto& Other :
+                 module.findSymbols(*Block->getAddress())) {
+              It->second.emplace_back(Other.getName());
+            }
           }
         }
       }
     }
+    AdditionalSkips.insert(AdditionalSkips.end(), It->second.begin(),
+                           It->second.end());
   }
   for (const std::string& Name : AdditionalSkips) {
     policy.skipFunctions.insert(Name);
   }
 }
 
-PrettyPrinterBase::~PrettyPrinterBase() { cs_close(&this->csHandle); }
+void PreparedModule::attach(PrettyPrinterBase& Printer) {
+  assert(&Printer.module == &Mod && "printer is for another module");
+  if (!Index) {
+    Printer.moduleIndex();
+    Index = Printer.Index;
+  }
+  // The module may have changed since the last print: a block may have been
+  // replaced by another at the same address, or symbols added or removed.
+  // Renamed symbols are caught when they are missing from the numbering.
+  Index->SymbolsBlock = nullptr;
+  Index->Symbols.clear();
+  Index->FunctionAliases.clear();
+  if (Index->Disambig &&
+      Index->DisambigSymbols !=
+          static_cast<size_t>(
+              std::distance(Mod.symbols_begin(), Mod.symbols_end()))) {
+    Index->Disambig.reset();
+  }
+  Printer.Index = Index;
+}
+
+const std::vector<const gtirb::Symbol*>&
+PrettyPrinterBase::blockSymbols(const gtirb::Node& Block) const {
+  ModuleIndex& I = moduleIndex();
+  if (I.SymbolsBlock != &Block) {
+    I.Symbols.clear();
+    for (const auto& Sym : module.findSymbols(Block)) {
+      I.Symbols.push_back(&Sym);
+    }
+    I.SymbolsBlock = &Block;
+  }
+  return I.Symbols;
+}
 
 const gtirb::SymAddrConst* PrettyPrinterBase::getSymbolicImmediate(
     const gtirb::SymbolicExpression* symex) {
@@ -308,6 +503,7 @@ const gtirb::SymAddrConst* PrettyPrinterBase::getSymbolicImmediate(
 }
 
 std::ostream& PrettyPrinterBase::print(std::ostream& os) {
+  skipFunctionAliases();
   printHeader(os);
 
   // print every section
@@ -317,18 +513,7 @@ std::ostream& PrettyPrinterBase::print(std::ostream& os) {
 
   // print integral symbols
   for (const auto& sym : module.symbols()) {
-    if (auto addr = sym.getAddress();
-        addr && !sym.hasReferent() && !shouldSkip(sym)) {
-      os << syntax.comment() << " WARNING: integral symbol " << sym.getName()
-         << " may not have been correctly relocated\n";
-      printIntegralSymbol(os, sym);
-    }
-    if (!sym.getAddress() &&
-        (!sym.hasReferent() ||
-         sym.getReferent<gtirb::ProxyBlock>() != nullptr) &&
-        !shouldSkip(sym)) {
-      printUndefinedSymbol(os, sym);
-    }
+    printTrailingSymbol(os, sym);
   }
 
   // print footer
@@ -336,6 +521,135 @@ std::ostream& PrettyPrinterBase::print(std::ostream& os) {
   return os;
 }
 
+void PrettyPrinterBase::printAll(
+    const std::vector<std::pair<PrettyPrinterBase*, std::ostream*>>&
+        printers) {
+  if (printers.empty()) {
+    return;
+  }
+
+  // Share the syntax-independent information between the printers.
+  const PrettyPrinterBase& First = *printers.front().first;
+  First.moduleIndex();
+  for (const auto& [Printer, OS] : printers) {
+    assert(&Printer->module == &First.module &&
+           "printers must print the same module");
+    Printer->Index = First.Index;
+    Printer->skipFunctionAliases();
+  }
+
+  for (const auto& [Printer, OS] : printers) {
+    Printer->printHeader(*OS);
+  }
+
+  std::vector<std::pair<PrettyPrinterBase*, std::ostream*>> Active;
+  for (const auto& Section : First.module.sections()) {
+    // Each printer's policy decides whether it prints the section.
+    Active.clear();
+    for (const auto& [Printer, OS] : printers) {
+      if (!Printer->shouldSkip(Section)) {
+        Printer->programCounter = gtirb::Addr{0};
+        Printer->printSectionHeader(*OS, Section);
+        Active.emplace_back(Printer, OS);
+      }
+    }
+    if (Active.empty()) {
+      continue;
+    }
+    for (const auto& Block : Section.blocks()) {
+      for (const auto& [Printer, OS] : Active) {
+        Printer->printSectionBlock(*OS, Block);
+      }
+    }
+    for (const auto& [Printer, OS] : Active) {
+      Printer->printSectionFooter(*OS, Section);
+    }
+  }
+
+  for (const auto& Sym : First.module.symbols()) {
+    for (const auto& [Printer, OS] : printers) {
+      Printer->printTrailingSymbol(*OS, Sym);
+    }
+  }
+
+  for (const auto& [Printer, OS] : printers) {
+    Printer->printFooter(*OS);
+  }
+}
+
+void PrettyPrinterBase::printUnits(const ModuleSplit& Split,
+                                   const std::vector<std::ostream*>& Streams) {
+  assert(Streams.size() == Split.size() && "one stream per unit expected");
+  if (Streams.empty()) {
+    return;
+  }
+  ExportSymbols = true;
+  skipFunctionAliases();
+  for (std::ostream* OS : Streams) {
+    printHeader(*OS);
+  }
+
+  for (const auto& Section : module.sections()) {
+    if (shouldSkip(Section)) {
+      continue;
+    }
+    const auto& Starts = Split.starts(Section);
+    auto Next = Starts.begin();
+    std::ostream* OS = nullptr;
+    auto startUnit = [&]() {
+      if (OS) {
+        printSectionFooter(*OS, Section);
+      }
+      OS = Streams[Next->second];
+      ++Next;
+      programCounter = gtirb::Addr{0};
+      printSectionHeader(*OS, Section);
+    };
+    size_t Index = 0;
+    for (const auto& Block : Section.blocks()) {
+      if (Next != Starts.end() && Next->first == Index) {
+        startUnit();
+      }
+      printSectionBlock(*OS, Block);
+      ++Index;
+    }
+    if (!OS) {
+      startUnit();
+    }
+    printSectionFooter(*OS, Section);
+  }
+
+  // Every unit declares the undefined symbols, since a weak one would
+  // otherwise be a strong reference in the units that do not.
+  for (const auto& Sym : module.symbols()) {
+    for (std::ostream* OS : Streams) {
+      printTrailingSymbol(*OS, Sym, OS == Streams.back());
+    }
+  }
+
+  for (std::ostream* OS : Streams) {
+    printFooter(*OS);
+  }
+  ExportSymbols = false;
+}
+
+void PrettyPrinterBase::printTrailingSymbol(std::ostream& os,
+                                            const gtirb::Symbol& sym,
+                                            bool Integral) {
+  if (auto addr = sym.getAddress();
+      Integral && addr && !sym.hasReferent() && !shouldSkip(sym)) {
+    os << syntax.comment() << " WARNING: integral symbol " << sym.getName()
+       << " may not have been correctly relocated\n";
+    printIntegralSymbol(os, sym);
+  }
+  if (!sym.getAddress() &&
+      (!sym.hasReferent() ||
+       sym.getReferent<gtirb::ProxyBlock>() != nullptr) &&
+      !shouldSkip(sym)) {
+    printUndefinedSymbol(os, sym);
+  }
+}
+
 void PrettyPrinterBase::printOverlapWarning(std::ostream& os,
                                             const gtirb::Addr addr) {
   std::cerr << "WARNING: found overlapping element at address " << std::hex
@@ -388,7 +702,8 @@ void PrettyPrinterBase::setDecodeMode(std::ostream& /*os*/,
 void PrettyPrinterBase::printSectionHeader(std::ostream& os,
                                            const gtirb::Section& section) {
   std::string sectionName = section.getName();
-  os << '\n';
+  if (!compact)
+    os << '\n';
   printBar(os);
   if (sectionName == syntax.textSection()) {
     os << syntax.text() << '\n';
@@ -399,10 +714,11 @@ void PrettyPrinterBase::printSectionHeader(std::ostream& os,
   } else {
     printSectionHeaderDirective(os, section);
     printSectionProperties(os, section);
-    os << std::endl;
+    os << '\n';
   }
   printBar(os);
-  os << '\n';
+  if (!compact)
+    os << '\n';
 }
 
 void PrettyPrinterBase::printSectionFooter(std::ostream& os,
@@ -413,6 +729,9 @@ void PrettyPrinterBase::printSectionFooter(std::ostream& os,
 }
 
 void PrettyPrinterBase::printBar(std::ostream& os, bool heavy) {
+  if (compact) {
+    return;
+  }
   if (heavy) {
     os << syntax.comment() << "===================================\n";
   } else {
@@ -559,13 +878,14 @@ void PrettyPrinterBase::printInstruction(std::ostream& os,
   ////////////////////////////////////////////////////////////////////
   // special cases
 
+  const char* indent = compact ? "" : "  ";
   if (inst.id == X86_INS_NOP || inst.id == ARM64_INS_NOP) {
-    os << "  " << syntax.nop();
+    os << indent << syntax.nop();
     for (uint64_t i = 1; i < inst.size; ++i) {
       ea += 1;
       os << '\n';
       printEA(os, ea);
-      os << "  " << syntax.nop();
+      os << indent << syntax.nop();
     }
     os << '\n';
     return;
@@ -581,7 +901,7 @@ void PrettyPrinterBase::printInstruction(std::ostream& os,
   ////////////////////////////////////////////////////////////////////
 
   std::string opcode = ascii_str_tolower(inst.mnemonic);
-  os << "  " << opcode << ' ';
+  os << indent << opcode << ' ';
   // Make sure the initial m_accum_comment is empty.
   m_accum_comment.clear();
   printOperandList(os, block, inst);
@@ -593,7 +913,8 @@ void PrettyPrinterBase::printInstruction(std::ostream& os,
 }
 
 void PrettyPrinterBase::printEA(std::ostream& os, gtirb::Addr ea) {
-  os << syntax.tab();
+  if (!compact)
+    os << syntax.tab();
   if (this->debug) {
     os << std::hex << static_cast<uint64_t>(ea) << ": " << std::dec;
   }
@@ -692,6 +1013,40 @@ void PrettyPrinterBase::printBlockImpl(std::ostream& os, BlockType& block) {
     return;
   }
 
+  // A block overlapping the previous one is printed relative to the program
+  // counter, which is not part of its fingerprint.
+  gtirb::Addr addr = *block.getAddress();
+  if (!RenderCache || addr < programCounter) {
+    printBlockText(os, block);
+    return;
+  }
+
+  Fingerprint Key = blockFingerprint(block);
+  if (const BlockCache::Entry* Cached = RenderCache->find(Key)) {
+    os.write(Cached->Text.data(),
+             static_cast<std::streamsize>(Cached->Text.size()));
+    if (Cached->AdvancesPC) {
+      programCounter = addr + block.getSize();
+    }
+    if (!Cached->InProcedure) {
+      CFIStartProc = std::nullopt;
+    } else if (!CFIStartProc) {
+      CFIStartProc = addr;
+    }
+    return;
+  }
+
+  std::ostringstream Text;
+  gtirb::Addr PCBefore = programCounter;
+  printBlockText(Text, block);
+  std::string Rendered = Text.str();
+  os.write(Rendered.data(), static_cast<std::streamsize>(Rendered.size()));
+  RenderCache->insert(Key, std::move(Rendered), CFIStartProc.has_value(),
+                      programCounter != PCBefore);
+}
+
+template <typename BlockType>
+void PrettyPrinterBase::printBlockText(std::ostream& os, BlockType& block) {
   // Print symbols associated with block.
   gtirb::Addr addr = *block.getAddress();
   uint64_t offset;
@@ -703,9 +1058,9 @@ void PrettyPrinterBase::printBlockImpl(std::ostream& os, BlockType& block) {
 
     offset = programCounter - addr;
     printOverlapWarning(os, addr);
-    for (const auto& sym : module.findSymbols(block)) {
-      if (!sym.getAtEnd() && !shouldSkip(sym)) {
-        printSymbolDefinitionRelativeToPC(os, sym, programCounter);
+    for (const gtirb::Symbol* sym : blockSymbols(block)) {
+      if (!sym->getAtEnd() && !shouldSkip(*sym)) {
+        printSymbolDefinitionRelativeToPC(os, *sym, programCounter);
       }
     }
   } else {
@@ -717,9 +1072,9 @@ void PrettyPrinterBase::printBlockImpl(std::ostream& os, BlockType& block) {
       printAlignment(os, *Align);
     }
 
-    for (const auto& sym : module.findSymbols(block)) {
-      if (!sym.getAtEnd() && !shouldSkip(sym)) {
-        printSymbolDefinition(os, sym);
+    for (const gtirb::Symbol* sym : blockSymbols(block)) {
+      if (!sym->getAtEnd() && !shouldSkip(*sym)) {
+        printSymbolDefinition(os, *sym);
       }
     }
   }
@@ -748,11 +1103,162 @@ void PrettyPrinterBase::printBlockImpl(std::ostream& os, BlockType& block) {
   programCounter = std::max(programCounter, addr + block.getSize());
 
   // Print any symbols that should go at the end of this block.
-  for (const auto& sym : module.findSymbols(block)) {
-    if (sym.getAtEnd() && !shouldSkip(sym)) {
-      printSymbolDefinition(os, sym);
+  for (const gtirb::Symbol* sym : blockSymbols(block)) {
+    if (sym->getAtEnd() && !shouldSkip(*sym)) {
+      printSymbolDefinition(os, *sym);
+    }
+  }
+}
+
+const Fingerprint& PrettyPrinterBase::configFingerprint() {
+  if (ConfigFingerprint) {
+    return *ConfigFingerprint;
+  }
+
+  // Everything that affects the text of every block: the printer and its
+  // target, the policy, and the module-wide tables consulted per symbol.
+  FingerprintBuilder F;
+  F.add(std::string(typeid(*this).name()));
+  F.add(static_cast<uint64_t>(module.getFileFormat()));
+  F.add(static_cast<uint64_t>(module.getISA()));
+  F.add(static_cast<uint64_t>(module.getPreferredAddr()));
+  F.add(static_cast<uint64_t>(debug));
+  F.add(static_cast<uint64_t>(compact));
+  for (const auto* Names : {&policy.skipFunctions, &policy.skipSymbols,
+                            &policy.skipSections, &policy.arraySections}) {
+    std::vector<std::string> Sorted(Names->begin(), Names->end());
+    std::sort(Sorted.begin(), Sorted.end());
+    F.add(Sorted.size());
+    for (const std::string& Name : Sorted) {
+      F.add(Name);
     }
   }
+  auto addUUIDs = [&F](const std::vector<gtirb::UUID>* UUIDs) {
+    F.add(UUIDs ? UUIDs->size() : 0);
+    if (UUIDs) {
+      for (const gtirb::UUID& Id : *UUIDs) {
+        F.add(&*Id.begin(), Id.size());
+      }
+    }
+  };
+  addUUIDs(module.getAuxData<gtirb::schema::PeImportedSymbols>());
+  addUUIDs(module.getAuxData<gtirb::schema::PeExportedSymbols>());
+  ConfigFingerprint = F.get();
+  return *ConfigFingerprint;
+}
+
+template <typename BlockType>
+Fingerprint PrettyPrinterBase::blockFingerprint(BlockType& Block) {
+  FingerprintBuilder F;
+  const Fingerprint& Config = configFingerprint();
+  F.add(Config.High);
+  F.add(Config.Low);
+  F.add(static_cast<uint64_t>(CFIStartProc.has_value()));
+  F.add(static_cast<uint64_t>(ExportSymbols));
+
+  // The block and its bytes.
+  constexpr bool IsCode = std::is_same_v<BlockType, const gtirb::CodeBlock>;
+  gtirb::Addr Addr = *Block.getAddress();
+  const gtirb::ByteInterval* BI = Block.getByteInterval();
+  uint64_t Begin = Block.getOffset();
+  uint64_t End = Begin + Block.getSize();
+  uint64_t Initialized = std::min(End, BI->getInitializedSize());
+  F.add(static_cast<uint64_t>(IsCode));
+  F.add(static_cast<uint64_t>(Addr));
+  F.add(Block.getSize());
+  F.add(BI->getSection()->getName());
+  F.add(Initialized > Begin ? Initialized - Begin : 0);
+  if (Initialized > Begin) {
+    F.add(BI->rawBytes<char>() + Begin, Initialized - Begin);
+  }
+  if constexpr (IsCode) {
+    F.add(static_cast<uint64_t>(Block.getDecodeMode()));
+  }
+
+  // Its place in its function.
+  F.add(static_cast<uint64_t>(isFunctionEntry(Addr)));
+  F.add(static_cast<uint64_t>(isFunctionLastBlock(Addr)));
+  F.add(getContainerFunctionName(Addr).value_or(""));
+  F.add(getFunctionName(Addr));
+  std::optional<uint64_t> Align = getAlignment(Block);
+  F.add(Align ? *Align + 1 : 0);
+
+  // The symbols defined at the block.
+  const auto* SymbolInfo = module.getAuxData<gtirb::schema::ElfSymbolInfo>();
+  for (const gtirb::Symbol* Sym : blockSymbols(Block)) {
+    F.add(&*Sym->getUUID().begin(), Sym->getUUID().size());
+    F.add(getSymbolName(*Sym));
+    F.add(getForwardedSymbolName(Sym).value_or(""));
+    F.add(static_cast<uint64_t>(Sym->getAtEnd()));
+    F.add(static_cast<uint64_t>(shouldSkip(*Sym)));
+    if (SymbolInfo) {
+      if (auto It = SymbolInfo->find(Sym->getUUID()); It != SymbolInfo->end()) {
+        const auto& [Size, Type, Binding, Visibility, Index] = It->second;
+        F.add(Size);
+        F.add(Type);
+        F.add(Binding);
+        F.add(Visibility);
+        F.add(Index);
+      }
+    }
+  }
+
+  // The symbolic expressions in the block, as this printer prints them.
+  std::string SavedComment = std::move(m_accum_comment);
+  for (const auto& SEE : BI->findSymbolicExpressionsAtOffset(Begin, End)) {
+    m_accum_comment.clear();
+    std::ostringstream Expr;
+    std::visit(
+        [&](const auto& E) {
+          using ExprType = std::decay_t<decltype(E)>;
+          if constexpr (std::is_same_v<ExprType, gtirb::SymAddrConst> ||
+                        std::is_same_v<ExprType, gtirb::SymAddrAddr>) {
+            printSymbolicExpression(Expr, &E, true);
+            Expr << '\n';
+            printSymbolicExpression(Expr, &E, false);
+          }
+        },
+        SEE.getSymbolicExpression());
+    F.add(SEE.getOffset());
+    F.add(Expr.str());
+    F.add(m_accum_comment);
+    if constexpr (!IsCode) {
+      F.add(getSymbolicExpressionSize(SEE));
+    }
+  }
+  m_accum_comment = std::move(SavedComment);
+
+  // The AuxData attached to the block.
+  gtirb::Offset First(Block.getUUID(), 0);
+  gtirb::Offset Last(Block.getUUID(), std::numeric_limits<uint64_t>::max());
+  if (const auto* Comments = module.getAuxData<gtirb::schema::Comments>()) {
+    for (auto It = Comments->lower_bound(First);
+         It != Comments->end() && !(Last < It->first); ++It) {
+      F.add(It->first.Displacement);
+      F.add(It->second);
+    }
+  }
+  if (const auto* CFI = module.getAuxData<gtirb::schema::CfiDirectives>()) {
+    for (auto It = CFI->lower_bound(First);
+         It != CFI->end() && !(Last < It->first); ++It) {
+      F.add(It->first.Displacement);
+      for (const auto& [Directive, Operands, SymbolId] : It->second) {
+        F.add(Directive);
+        F.add(Operands.data(), Operands.size() * sizeof(int64_t));
+        if (const auto* Sym = nodeFromUUID<gtirb::Symbol>(context, SymbolId)) {
+          F.add(getSymbolName(*Sym));
+        }
+      }
+    }
+  }
+  if constexpr (!IsCode) {
+    if (const auto* Encodings = module.getAuxData<gtirb::schema::Encodings>()) {
+      if (auto It = Encodings->find(Block.getUUID()); It != Encodings->end()) {
+        F.add(It->second);
+      }
+    }
+  }
+  return F.get();
 }
 
 void PrettyPrinterBase::printBlock(std::ostream& os,
@@ -933,7 +1439,7 @@ void PrettyPrinterBase::printCFIDirectives(std::ostream& os,
       printSymbolReference(os, symbol);
     }
 
-    os << std::endl;
+    os << '\n';
 
     if (Directive == ".cfi_endproc") {
       CFIStartProc = std::nullopt;
@@ -1151,15 +1657,16 @@ bool PrettyPrinterBase::shouldSkip(const gtirb::DataBlock& block) const {
 }
 
 bool PrettyPrinterBase::isFunctionEntry(const gtirb::Addr x) const {
-  return functionEntry.count(x) > 0;
+  return moduleIndex().FunctionEntry.count(x) > 0;
 }
 
 bool PrettyPrinterBase::isFunctionLastBlock(const gtirb::Addr x) const {
-  return functionLastBlock.count(x) > 0;
+  return moduleIndex().FunctionLastBlock.count(x) > 0;
 }
 
 std::optional<std::string>
 PrettyPrinterBase::getContainerFunctionName(const gtirb::Addr x) const {
+  const std::set<gtirb::Addr>& functionEntry = moduleIndex().FunctionEntry;
   auto it = functionEntry.upper_bound(x);
   if (it == functionEntry.begin())
     return std::nullopt;
@@ -1285,8 +1792,8 @@ std::string
 PrettyPrinterBase::getSymbolName(const gtirb::Symbol& symbol) const {
   if (isAmbiguousSymbol(symbol.getName())) {
     std::stringstream ss;
-    ss << symbol.getName() << "_disambig_"
-       << reinterpret_cast<uint64_t>(&symbol);
+    ss << symbol.getName() << (compact ? "_d" : "_disambig_")
+       << disambiguationIndex(symbol);
     assert(module.findSymbols(ss.str()).empty());
     return syntax.formatSymbolName(ss.str());
   } else {
@@ -1325,18 +1832,23 @@ void PrettyPrinterBase::printSection(std::ostream& os,
   printSectionHeader(os, section);
 
   for (const auto& Block : section.blocks()) {
-    if (auto* CB = dyn_cast<gtirb::CodeBlock>(&Block)) {
-      printBlock(os, *CB);
-    } else if (auto* DB = dyn_cast<gtirb::DataBlock>(&Block)) {
-      printBlock(os, *DB);
-    } else {
-      assert(!"non block in block iterator!");
-    }
+    printSectionBlock(os, Block);
   }
 
   printSectionFooter(os, section);
 }
 
+void PrettyPrinterBase::printSectionBlock(std::ostream& os,
+                                          const gtirb::Node& Block) {
+  if (auto* CB = dyn_cast<gtirb::CodeBlock>(&Block)) {
+    printBlock(os, *CB);
+  } else if (auto* DB = dyn_cast<gtirb::DataBlock>(&Block)) {
+    printBlock(os, *DB);
+  } else {
+    assert(!"non block in block iterator!");
+  }
+}
+
 uint64_t PrettyPrinterBase::getSymbolicExpressionSize(
     const gtirb::ByteInterval::ConstSymbolicExpressionElement& SEE) const {
   // Check if it is present in aux data.
@@ -0,0 +1,204 @@
+//===- c_api.cpp ------------------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "c_api.h"
+
+#include "OutputBuffer.hpp"
+#include "PrettyPrinter.hpp"
+#include <algorithm>
+#include <fstream>
+#include <gtirb/gtirb.hpp>
+#include <gtirb_layout/MappedFile.hpp>
+#include <gtirb_layout/gtirb_layout.hpp>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+
+struct gtirb_pprint_ir {
+  gtirb::Context Ctx;
+  gtirb::IR* Ir = nullptr;
+};
+
+struct gtirb_pprint_string {
+  std::string Text;
+};
+
+// C callers cannot register the AuxData types and printers themselves. A C++
+// host that registered the printers is assumed to have registered the AuxData
+// types as well.
+static void registerOnce() {
+  static std::once_flag Registered;
+  std::call_once(Registered, []() {
+    if (gtirb_pprint::getRegisteredTargets().empty()) {
+      gtirb_layout::registerAuxDataTypes();
+      gtirb_pprint::registerAuxDataTypes();
+      gtirb_pprint::registerPrettyPrinters();
+    }
+  });
+}
+
+static gtirb_pprint_status loadIR(std::istream& In, gtirb_pprint_ir** Result) {
+  registerOnce();
+  auto Handle = std::make_unique<gtirb_pprint_ir>();
+  if (gtirb::ErrorOr<gtirb::IR*> IrOrE = gtirb::IR::load(Handle->Ctx, In)) {
+    Handle->Ir = *IrOrE;
+  }
+  if (!Handle->Ir) {
+    return GTIRB_PPRINT_LOAD_FAILED;
+  }
+
+  // Prepare the modules the same way the gtirb-pprinter driver does.
+  if (gtirb_layout::layoutRequired(*Handle->Ir)) {
+    for (auto& M : Handle->Ir->modules()) {
+      gtirb_layout::layoutModule(Handle->Ctx, M);
+    }
+  } else {
+    for (auto& M : Handle->Ir->modules()) {
+      if (std::any_of(M.symbols_begin(), M.symbols_end(),
+                      [](const gtirb::Symbol& Sym) {
+                        return !Sym.hasReferent() && Sym.getAddress();
+                      })) {
+        gtirb_layout::fixIntegralSymbols(Handle->Ctx, M);
+      }
+    }
+  }
+
+  *Result = Handle.release();
+  return GTIRB_PPRINT_OK;
+}
+
+static gtirb_pprint_status printModule(gtirb_pprint_ir* Handle, size_t Index,
+                                       const char* Syntax,
+                                       gtirb_pprint::OutputBuffer& Buffer) {
+  if (!Handle || Index >= gtirb_pprint_ir_module_count(Handle)) {
+    return GTIRB_PPRINT_INVALID_ARGUMENT;
+  }
+  gtirb::Module& M = *std::next(Handle->Ir->modules_begin(), Index);
+
+  std::string Format = gtirb_pprint::getModuleFileFormat(M);
+  std::string Isa = gtirb_pprint::getModuleISA(M);
+  std::string SyntaxName =
+      Syntax ? Syntax
+             : gtirb_pprint::getDefaultSyntax(Format, Isa).value_or("");
+  auto Target = std::make_tuple(Format, Isa, SyntaxName);
+  if (gtirb_pprint::getRegisteredTargets().count(Target) == 0) {
+    return GTIRB_PPRINT_UNSUPPORTED_TARGET;
+  }
+
+  gtirb_pprint::PrettyPrinter Printer;
+  Printer.setTarget(Target);
+  if (Printer.print(Buffer, Handle->Ctx, M)) {
+    return GTIRB_PPRINT_OUTPUT_FAILED;
+  }
+  return GTIRB_PPRINT_OK;
+}
+
+// No exception may cross into C code, so the entry points that can throw
+// report exceptions as failures instead.
+extern "C" {
+
+gtirb_pprint_status gtirb_pprint_ir_load_file(const char* path,
+                                              gtirb_pprint_ir** ir) {
+  if (!path || !ir) {
+    return GTIRB_PPRINT_INVALID_ARGUMENT;
+  }
+  try {
+    if (auto Mapped = gtirb_layout::MappedFile::open(path)) {
+      return loadIR(Mapped->stream(), ir);
+    }
+    std::ifstream In(path, std::ios::in | std::ios::binary);
+    if (!In) {
+      return GTIRB_PPRINT_LOAD_FAILED;
+    }
+    return loadIR(In, ir);
+  } catch (...) {
+    return GTIRB_PPRINT_LOAD_FAILED;
+  }
+}
+
+gtirb_pprint_status gtirb_pprint_ir_load_memory(const void* data, size_t size,
+                                                gtirb_pprint_ir** ir) {
+  if ((!data && size > 0) || !ir) {
+    return GTIRB_PPRINT_INVALID_ARGUMENT;
+  }
+  try {
+    gtirb_layout::MemoryInputBuffer Buffer(static_cast<const char*>(data),
+                                          size);
+    std::istream In(&Buffer);
+    return loadIR(In, ir);
+  } catch (...) {
+    return GTIRB_PPRINT_LOAD_FAILED;
+  }
+}
+
+void gtirb_pprint_ir_free(gtirb_pprint_ir* ir) { delete ir; }
+
+size_t gtirb_pprint_ir_module_count(const gtirb_pprint_ir* ir) {
+  if (!ir) {
+    return 0;
+  }
+  return static_cast<size_t>(
+      std::distance(ir->Ir->modules_begin(), ir->Ir->modules_end()));
+}
+
+gtirb_pprint_status gtirb_pprint_print_module(gtirb_pprint_ir* ir,
+                                              size_t module,
+                                              const char* syntax,
+                                              gtirb_pprint_write_fn write,
+                                              void* user_data) {
+  if (!write) {
+    return GTIRB_PPRINT_INVALID_ARGUMENT;
+  }
+  try {
+    gtirb_pprint::CallbackOutputBuffer Buffer(
+        [&](const char* Data, size_t Size) {
+          return write(user_data, Data, Size) != 0;
+        });
+    return printModule(ir, module, syntax, Buffer);
+  } catch (...) {
+    return GTIRB_PPRINT_OUTPUT_FAILED;
+  }
+}
+
+gtirb_pprint_status
+gtirb_pprint_print_module_to_string(gtirb_pprint_ir* ir, size_t module,
+                                    const char* syntax,
+                                    gtirb_pprint_string** result) {
+  if (!result) {
+    return GTIRB_PPRINT_INVALID_ARGUMENT;
+  }
+  try {
+    gtirb_pprint::StringOutputBuffer Buffer;
+    gtirb_pprint_status Status = printModule(ir, module, syntax, Buffer);
+    if (Status == GTIRB_PPRINT_OK) {
+      *result = new gtirb_pprint_string{Buffer.take()};
+    }
+    return Status;
+  } catch (...) {
+    return GTIRB_PPRINT_OUTPUT_FAILED;
+  }
+}
+
+const char* gtirb_pprint_string_data(const gtirb_pprint_string* str) {
+  return str ? str->Text.c_str() : nullptr;
+}
+
+size_t gtirb_pprint_string_size(const gtirb_pprint_string* str) {
+  return str ? str->Text.size() : 0;
+}
+
+void gtirb_pprint_string_free(gtirb_pprint_string* str) { delete str; }
+
+} // extern "C"
@@ -4,16 +4,25 @@
 #include <boost/uuid/uuid_io.hpp>
 #include <fcntl.h>
 #include <fstream>
+#include <functional>
+#include <gtirb_layout/MappedFile.hpp>
+#include <gtirb_layout/SerializedIR.hpp>
 #include <gtirb_layout/gtirb_layout.hpp>
+#include <gtirb_pprinter/BinaryPatcher.hpp>
+#include <gtirb_pprinter/Compression.hpp>
 #include <gtirb_pprinter/ElfBinaryPrinter.hpp>
+#include <gtirb_pprinter/IntegratedAssembler.hpp>
+#include <gtirb_pprinter/OutputBuffer.hpp>
 #include <gtirb_pprinter/PeBinaryPrinter.hpp>
 #include <gtirb_pprinter/PrettyPrinter.hpp>
+#include <gtirb_pprinter/file_utils.hpp>
 #include <gtirb_pprinter/version.h>
 #if defined(_MSC_VER)
 #include <io.h>
 #endif
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 #if defined(__unix__)
 #include <unistd.h>
 #endif
@@ -21,6 +30,14 @@
 namespace fs = boost::filesystem;
 namespace po = boost::program_options;
 
+static int getStreamFd(FILE* stream) {
+#if defined(_MSC_VER)
+  return _fileno(stream);
+#else
+  return fileno(stream);
+#endif
+}
+
 static bool isStreamATerminal(FILE* stream) {
 #if defined(_MSC_VER)
   return _isatty(_fileno(stream));
@@ -55,15 +72,101 @@ static fs::path getAsmFileName(const fs::path& InitialPath, int Index) {
   if (Index == 0)
     return InitialPath;
 
+  // Keep a compression suffix after the extension: foo.s.gz -> foo1.s.gz.
+  fs::path Base = InitialPath.filename();
+  std::string Suffix;
+  if (gtirb_pprint::compressionForPath(Base.generic_string()) !=
+      gtirb_pprint::Compression::None) {
+    Suffix = Base.extension().generic_string();
+    Base = Base.stem();
+  }
+
   // Add the number to the end of the stem of the filename.
-  std::string Filename = InitialPath.stem().generic_string();
+  std::string Filename = Base.stem().generic_string();
   Filename.append(std::to_string(Index));
-  Filename.append(InitialPath.extension().generic_string());
+  Filename.append(Base.extension().generic_string());
+  Filename.append(Suffix);
   fs::path FinalPath = InitialPath.parent_path();
   FinalPath /= Filename;
   return FinalPath;
 }
 
+static std::vector<std::string> splitList(const std::string& List) {
+  std::vector<std::string> Items;
+  std::string::size_type Start = 0;
+  while (true) {
+    std::string::size_type End = List.find(',', Start);
+    Items.push_back(List.substr(Start, End - Start));
+    if (End == std::string::npos)
+      return Items;
+    Start = End + 1;
+  }
+}
+
+// The assembly file for each syntax: either one name per syntax, or names
+// derived from a single name by inserting the syntax before the extension.
+// Returns an empty vector if the number of names does not match.
+static std::vector<fs::path>
+getSyntaxAsmPaths(const std::string& AsmOption,
+                  const std::vector<std::string>& Syntaxes) {
+  if (Syntaxes.size() <= 1)
+    return {fs::path(AsmOption)};
+
+  std::vector<std::string> Names = splitList(AsmOption);
+  std::vector<fs::path> Paths(Names.begin(), Names.end());
+  if (Paths.size() == Syntaxes.size())
+    return Paths;
+  if (Paths.size() != 1)
+    return {};
+
+  // foo.s -> foo.intel.s, foo.s.gz -> foo.intel.s.gz
+  fs::path Base = Paths.front();
+  std::string Suffix;
+  if (gtirb_pprint::compressionForPath(Base.generic_string()) !=
+      gtirb_pprint::Compression::None) {
+    Suffix = Base.extension().generic_string();
+    Base = Base.parent_path() / Base.stem();
+  }
+  Paths.clear();
+  for (const std::string& Syntax : Syntaxes) {
+    fs::path Path = Base.parent_path();
+    Path /= Base.stem().generic_string() + "." + Syntax +
+            Base.extension().generic_string() + Suffix;
+    Paths.push_back(Path);
+  }
+  return Paths;
+}
+
+static std::unique_ptr<gtirb_pprint::OutputBuffer>
+openAsmFile(const fs::path& Path, bool AsyncIO) {
+  gtirb_pprint::Compression Compression =
+      gtirb_pprint::compressionForPath(Path.generic_string());
+  if (Compression != gtirb_pprint::Compression::None)
+    return gtirb_pprint::CompressedOutputBuffer::open(Path.generic_string(),
+                                                      Compression);
+  if (AsyncIO)
+    return gtirb_pprint::AsyncFileOutputBuffer::open(Path.generic_string());
+  return gtirb_pprint::FdOutputBuffer::open(Path.generic_string());
+}
+
+// Lay out a module, or if it does not need a new layout, give its integral
+// symbols referents.
+static void prepareModule(gtirb::Context& Ctx, gtirb::Module& M, bool Layout) {
+  if (Layout) {
+    LOG_INFO << "Applying new layout to module " << M.getUUID() << "..."
+             << std::endl;
+    gtirb_layout::layoutModule(Ctx, M);
+  } else if (std::any_of(M.symbols_begin(), M.symbols_end(),
+                         [](const gtirb::Symbol& Sym) {
+                           return !Sym.hasReferent() && Sym.getAddress();
+                         })) {
+    LOG_INFO << "Module " << M.getUUID()
+             << " has integral symbols; attempting to assign referents..."
+             << std::endl;
+    gtirb_layout::fixIntegralSymbols(Ctx, M);
+  }
+}
+
 static std::unique_ptr<gtirb_bprint::BinaryPrinter>
 getBinaryPrinter(const std::string& format,
                  const gtirb_pprint::PrettyPrinter& pp,
@@ -79,6 +182,116 @@ getBinaryPrinter(const std::string& format,
   return nullptr;
 }
 
+// Quote a string for JSON.
+static std::string jsonString(const std::string& S) {
+  std::ostringstream Out;
+  Out << '"';
+  for (char C : S) {
+    if (C == '"' || C == '\\')
+      Out << '\\' << C;
+    else if (static_cast<unsigned char>(C) < 0x20)
+      Out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+          << static_cast<int>(C) << std::dec << std::setfill(' ');
+    else
+      Out << C;
+  }
+  Out << '"';
+  return Out.str();
+}
+
+// The steps and tool runs of the builds of --binaries and --binary, each
+// with the name of its phase, which --build-profile writes to a single file.
+struct BuildProfile {
+  std::vector<std::string> Phases;
+  std::vector<std::pair<std::string, gtirb_bprint::BinaryPrinter::BuildStep>>
+      Steps;
+  std::vector<std::pair<std::string, gtirb_bprint::BinaryPrinter::ToolRun>>
+      Runs;
+};
+
+// Log the time spent in each step of a build, the resources used by each
+// tool it ran and the objects written without one, and add the steps and
+// the runs to Profile under Phase.
+static void reportBuild(const gtirb_bprint::BinaryPrinter& Printer,
+                        const std::string& Phase, BuildProfile& Profile) {
+  Profile.Phases.push_back(Phase);
+  for (const auto& Step : Printer.buildSteps()) {
+    LOG_INFO << std::setw(24) << std::left << ("Time to " + Step.Name + ": ")
+             << std::fixed << std::setprecision(3) << Step.Seconds << "s\n";
+    Profile.Steps.emplace_back(Phase, Step);
+  }
+
+  // The totals of each tool, in the order the tools first exited.
+  std::vector<gtirb_bprint::BinaryPrinter::ToolRun> Runs = Printer.toolRuns();
+  std::vector<std::pair<gtirb_bprint::BinaryPrinter::ToolRun, size_t>> Totals;
+  for (const auto& Run : Runs) {
+    auto It = std::find_if(Totals.begin(), Totals.end(), [&](const auto& T) {
+      return T.first.Tool == Run.Tool;
+    });
+    if (It == Totals.end()) {
+      Totals.push_back({{Run.Tool, {}}, 0});
+      It = std::prev(Totals.end());
+    }
+    gtirb_bprint::ProcessUsage& Total = It->first.Usage;
+    Total.WallSeconds += Run.Usage.WallSeconds;
+    Total.UserSeconds += Run.Usage.UserSeconds;
+    Total.SystemSeconds += Run.Usage.SystemSeconds;
+    Total.PeakRssBytes = std::max(Total.PeakRssBytes, Run.Usage.PeakRssBytes);
+    ++It->second;
+    Profile.Runs.emplace_back(Phase, Run);
+  }
+  for (const auto& [Total, Count] : Totals)
+    LOG_INFO << Total.Tool << ": " << Count << " runs, " << std::fixed
+             << std::setprecision(3) << Total.Usage.WallSeconds << "s wall, "
+             << Total.Usage.UserSeconds << "s user, "
+             << Total.Usage.SystemSeconds << "s system, "
+             << Total.Usage.PeakRssBytes / (1024 * 1024)
+             << " MiB peak resident\n";
+  if (size_t Written = Printer.directWrites())
+    LOG_INFO << "Wrote " << Written << " objects directly from the IR\n";
+}
+
+// Write the builds reported to Profile to ProfilePath as JSON, unless it is
+// empty or no build was reported.
+static bool writeBuildProfile(const BuildProfile& Profile,
+                              const std::string& ProfilePath) {
+  if (ProfilePath.empty() || Profile.Phases.empty())
+    return true;
+  std::ofstream Out(ProfilePath);
+  Out << std::fixed << std::setprecision(6) << "{\n  \"phases\": [";
+  const char* Separator = "";
+  for (const std::string& Phase : Profile.Phases) {
+    Out << Separator << jsonString(Phase);
+    Separator = ", ";
+  }
+  Out << "],\n  \"steps\": [";
+  Separator = "\n";
+  for (const auto& [Phase, Step] : Profile.Steps) {
+    Out << Separator << "    {\"phase\": " << jsonString(Phase)
+        << ", \"name\": " << jsonString(Step.Name)
+        << ", \"seconds\": " << Step.Seconds << "}";
+    Separator = ",\n";
+  }
+  Out << "\n  ],\n  \"tools\": [";
+  Separator = "\n";
+  for (const auto& [Phase, Run] : Profile.Runs) {
+    Out << Separator << "    {\"phase\": " << jsonString(Phase)
+        << ", \"tool\": " << jsonString(Run.Tool)
+        << ", \"wall_seconds\": " << Run.Usage.WallSeconds
+        << ", \"user_seconds\": " << Run.Usage.UserSeconds
+        << ", \"system_seconds\": " << Run.Usage.SystemSeconds
+        << ", \"peak_rss_bytes\": " << Run.Usage.PeakRssBytes << "}";
+    Separator = ",\n";
+  }
+  Out << "\n  ]\n}\n";
+  Out.close();
+  if (!Out) {
+    LOG_ERROR << "Could not write the build profile " << ProfilePath << ".\n";
+    return false;
+  }
+  return true;
+}
+
 int main(int argc, char** argv) {
   gtirb_layout::registerAuxDataTypes();
   gtirb_pprint::registerAuxDataTypes();
@@ -93,7 +306,11 @@ int main(int argc, char** argv) {
       "The name of the assembly output file. If none is given, gtirb-pprinter "
       "prints to the standard output. If the IR has more "
       "than one module, files of the form FILE, FILE_2 ... "
-      "FILE_n with the content of each of the modules");
+      "FILE_n with the content of each of the modules. If FILE ends in .gz "
+      "or .zst, the assembly is compressed while it is printed.");
+  desc.add_options()("async-io",
+                     "Write assembly files asynchronously, overlapping "
+                     "formatting with file writes.");
   desc.add_options()("binary,b", po::value<std::string>(),
                      "The name of the binary output file.");
   desc.add_options()(
@@ -101,6 +318,85 @@ int main(int argc, char** argv) {
       "The name of the assembled output. If the IR has more than one module, "
       "files of the form FILE, FILE_2, ..., FILE_n are produced with the "
       "assembled content of each of the modules.");
+  desc.add_options()(
+      "stream-modules",
+      "With --asm or --binaries, load, print and release one module at a "
+      "time, so that only one module of the IR is in memory at once. Each "
+      "module is laid out only if it needs a new layout itself.");
+  desc.add_options()(
+      "block-cache", po::value<std::string>(),
+      "Keep the assembly printed for each block in FILE, and reuse it for "
+      "the blocks that are unchanged the next time the IR is printed.");
+  desc.add_options()(
+      "object-dir", po::value<std::string>(),
+      "With --binary, assemble each module in units of about --unit-size "
+      "bytes and keep their objects in DIR, so that linking again only "
+      "assembles the units that changed. ELF only.");
+  desc.add_options()(
+      "unit-size", po::value<uint64_t>()->default_value(256 * 1024),
+      "The size in bytes of the code and data of each unit of --object-dir. "
+      "With 0, every function that can be assembled on its own is.");
+  desc.add_options()(
+      "shards", po::value<size_t>()->default_value(1),
+      "With --binary, split each module in up to N units of about the same "
+      "size, assemble them at once and link their objects. ELF only.");
+  desc.add_options()(
+      "jobs,j", po::value<unsigned>()->default_value(0),
+      "The number of assemblers run at once by --binary, which assembles "
+      "the modules of the IR, and the units of --shards and --object-dir, "
+      "in parallel, and the number of threads of --linker. With 0, one per "
+      "processor.");
+  desc.add_options()(
+      "linker", po::value<std::string>(),
+      "Link --binary with the linker NAME: bfd, gold, lld or mold, or auto "
+      "for the first of mold, lld and gold that is installed. ELF only.");
+  desc.add_options()(
+      "build-profile", po::value<std::string>(),
+      "Write the time spent printing, assembling and linking by --binaries "
+      "and by --binary, and the wall time, CPU time and peak memory of each "
+      "tool they ran, to FILE as JSON, each with the option it is for.");
+  desc.add_options()(
+      "object-cache", po::value<std::string>(),
+      "Keep the objects and binaries built by --binary and --binaries in "
+      "DIR, and reuse them instead of running the assembler and linker "
+      "again on the same input.");
+  desc.add_options()(
+      "object-cache-size", po::value<uint64_t>()->default_value(5120),
+      "The size in MiB that --object-cache is kept under, by removing the "
+      "least recently used files.");
+  desc.add_options()(
+      "library-index", po::value<std::string>(),
+      "Keep the listings of the library paths that --binary searches for "
+      "libraries in FILE, and only list again the ones that changed. ELF "
+      "only.");
+  desc.add_options()("compress-temp-sources",
+                     "Keep the temporary assembly of --binaries compressed "
+                     "and decompress it into the assembler's input.");
+  desc.add_options()(
+      "temp-dir", po::value<std::string>(),
+      "Put the temporary files of --binary and --binaries that are not kept "
+      "in memory in DIR instead of the system's temporary directory.");
+  desc.add_options()(
+      "temp-memory", po::value<uint64_t>()->default_value(512),
+      "The size in MiB of the temporary files of --binary and --binaries "
+      "kept in memory instead of on disk, on Linux.");
+  desc.add_options()("integrated-assembler",
+                     "Assemble the modules of --binary and --binaries in "
+                     "process instead of running gcc, when possible. ELF "
+                     "only; requires a build with LLVM.");
+  desc.add_options()("direct-objects",
+                     "Write the objects of --binary and --binaries straight "
+                     "from the IR instead of printing and assembling them, "
+                     "when possible. x86-64 ELF and PE only.");
+  desc.add_options()("patch",
+                     "Write --binary by patching the original binary of the "
+                     "module instead of rebuilding it, when the changes to "
+                     "the IR keep its layout and no policy, skip option or "
+                     "compiler argument is given. x86 ELF only.");
+  desc.add_options()("pipe-sources",
+                     "Stream the assembly of --binary and --binaries into "
+                     "the assembler while printing it, instead of going "
+                     "through temporary files.");
   desc.add_options()("compiler-args,c",
                      po::value<std::vector<std::string>>()->multitoken(),
                      "Additional arguments to pass to the compiler. Only used "
@@ -116,11 +412,20 @@ int main(int argc, char** argv) {
                      "The format of the target binary object.");
   desc.add_options()("isa,i", po::value<std::string>(),
                      "The ISA of the target binary object.");
-  desc.add_options()("syntax,s", po::value<std::string>(),
-                     "The syntax of the assembly file to generate.");
+  desc.add_options()(
+      "syntax,s", po::value<std::string>(),
+      "The syntax of the assembly file to generate. A comma-separated list "
+      "(e.g. intel,att) prints every syntax in a single pass; --asm then "
+      "takes one comma-separated file name per syntax, or a single name "
+      "into which the syntax is inserted (foo.s -> foo.intel.s, foo.att.s).");
   desc.add_options()("layout,l", "Layout code and data in memory to "
                                  "avoid overlap");
   desc.add_options()("debug,d", "Turn on debugging (will break assembly)");
+  desc.add_options()(
+      "emission-profile", po::value<std::string>(),
+      "How the assembly is laid out: 'human' (the default for --asm and the "
+      "standard output) or 'machine', which drops banners, comments and "
+      "indentation (the default for --binary and --binaries).");
   desc.add_options()(
       "policy,p", po::value<std::string>(),
       "The default set of objects to skip when printing assembly. To modify "
@@ -205,18 +510,73 @@ int main(int argc, char** argv) {
 
   ContextForgetter ctx;
   gtirb::IR* ir = nullptr;
+  const bool printToStdout = (vm.count("asm") == 0) &&
+                             (vm.count("binary") == 0) &&
+                             (vm.count("binaries") == 0);
+  int moduleIndex = vm["module"].as<int>();
+  const bool streamModules = !printToStdout && vm.count("stream-modules");
+  if (streamModules && vm.count("binary") != 0) {
+    LOG_ERROR << "--stream-modules cannot be combined with --binary.\n";
+    return EXIT_FAILURE;
+  }
+  if (vm.count("patch") != 0 && vm.count("binary") == 0) {
+    LOG_ERROR << "--patch requires --binary.\n";
+    return EXIT_FAILURE;
+  }
+  if (vm.count("linker") != 0) {
+    const std::string& linker = vm["linker"].as<std::string>();
+    if (linker != "auto" && linker != "bfd" && linker != "gold" &&
+        linker != "lld" && linker != "mold") {
+      LOG_ERROR << "'" << linker << "' is an unsupported linker.\n";
+      return EXIT_FAILURE;
+    }
+  }
+  std::unique_ptr<gtirb_layout::MappedFile> mapped;
+  std::optional<gtirb_layout::SerializedIR> serialized;
+  // With --stream-modules, the Context of the one module currently loaded.
+  std::unique_ptr<gtirb::Context> moduleCtx;
 
   if (vm.count("ir") != 0) {
     fs::path irPath = vm["ir"].as<std::string>();
     LOG_INFO << std::setw(24) << std::left << "Reading GTIRB file: " << irPath
              << std::endl;
-    std::ifstream in(irPath.string(), std::ios::in | std::ios::binary);
-    if (in) {
-      if (gtirb::ErrorOr<gtirb::IR*> iOrE = gtirb::IR::load(ctx, in))
+    // Parse straight out of the page cache when the file can be mapped.
+    if ((mapped = gtirb_layout::MappedFile::open(irPath.string()))) {
+      // When a single module is printed to the standard output, the other
+      // modules are neither deserialized nor laid out.
+      if (printToStdout || streamModules)
+        serialized =
+            gtirb_layout::SerializedIR::index(mapped->data(), mapped->size());
+      if (serialized && streamModules) {
+        if (serialized->moduleCount() > 0) {
+          moduleCtx = std::make_unique<gtirb::Context>();
+          ir = serialized->loadModule(*moduleCtx, 0);
+        }
+      } else if (serialized) {
+        if (moduleIndex < 0 ||
+            static_cast<size_t>(moduleIndex) >= serialized->moduleCount()) {
+          LOG_ERROR << "The IR has " << serialized->moduleCount()
+                    << " modules, module with index " << moduleIndex
+                    << " cannot be printed.\n";
+          return EXIT_FAILURE;
+        }
+        ir = serialized->loadModule(ctx, moduleIndex);
+        // The selected module is the only one in the loaded IR.
+        moduleIndex = 0;
+      } else if (gtirb::ErrorOr<gtirb::IR*> iOrE =
+                     gtirb::IR::load(ctx, mapped->stream())) {
         ir = *iOrE;
+      }
     } else {
-      LOG_ERROR << "GTIRB file could not be opened: \"" << irPath << "\".\n";
-      return EXIT_FAILURE;
+      std::ifstream in(irPath.string(), std::ios::in | std::ios::binary);
+      if (in) {
+        if (gtirb::ErrorOr<gtirb::IR*> iOrE = gtirb::IR::load(ctx, in))
+          ir = *iOrE;
+      } else {
+        LOG_ERROR << "GTIRB file could not be opened: \"" << irPath
+                  << "\".\n";
+        return EXIT_FAILURE;
+      }
     }
   } else {
     if (!setStdStreamToBinary(stdin)) {
@@ -227,6 +587,9 @@ int main(int argc, char** argv) {
       ir = *iOrE;
     }
   }
+  if (streamModules && !moduleCtx) {
+    LOG_INFO << "The IR cannot be streamed; loading every module at once.\n";
+  }
   if (!ir) {
     LOG_ERROR << "Failed to load the GTIRB data from the file.\n";
     return EXIT_FAILURE;
@@ -237,25 +600,10 @@ int main(int argc, char** argv) {
   }
 
   // Layout IR in memory without overlap.
-  if (vm.count("layout") || gtirb_layout::layoutRequired(*ir)) {
-    for (auto& M : ir->modules()) {
-      LOG_INFO << "Applying new layout to module " << M.getUUID() << "..."
-               << std::endl;
-      gtirb_layout::layoutModule(ctx, M);
-    }
-  } else {
-    for (auto& M : ir->modules()) {
-      if (std::any_of(M.symbols_begin(), M.symbols_end(),
-                      [](const gtirb::Symbol& Sym) {
-                        return !Sym.hasReferent() && Sym.getAddress();
-                      })) {
-        LOG_INFO << "Module " << M.getUUID()
-                 << " has integral symbols; attempting to assign referents..."
-                 << std::endl;
-        gtirb_layout::fixIntegralSymbols(ctx, M);
-      }
-    }
-  }
+  bool layout = vm.count("layout") || gtirb_layout::layoutRequired(*ir);
+  for (auto& M : ir->modules())
+    prepareModule(moduleCtx ? *moduleCtx : static_cast<gtirb::Context&>(ctx),
+                  M, layout);
 
   // Perform the Pretty Printing step.
   gtirb_pprint::PrettyPrinter pp;
@@ -267,10 +615,19 @@ int main(int argc, char** argv) {
   const std::string& isa =
       vm.count("isa") ? vm["isa"].as<std::string>()
                       : gtirb_pprint::getModuleISA(*ir->modules().begin());
-  const std::string& syntax =
+  const std::vector<std::string> syntaxes =
       vm.count("syntax")
-          ? vm["syntax"].as<std::string>()
-          : gtirb_pprint::getDefaultSyntax(format, isa).value_or("");
+          ? splitList(vm["syntax"].as<std::string>())
+          : std::vector<std::string>{
+                gtirb_pprint::getDefaultSyntax(format, isa).value_or("")};
+  std::string syntax = syntaxes.front();
+  for (const std::string& S : syntaxes) {
+    if (gtirb_pprint::getRegisteredTargets().count(
+            std::make_tuple(format, isa, S)) == 0) {
+      syntax = S;
+      break;
+    }
+  }
   auto target = std::make_tuple(format, isa, syntax);
   if (gtirb_pprint::getRegisteredTargets().count(target) == 0) {
     LOG_ERROR << "Unsupported combination: format \"" << format << "\" ISA \""
@@ -288,7 +645,22 @@ int main(int argc, char** argv) {
                 << std::setw(width) << s << '\n';
     return EXIT_FAILURE;
   }
-  pp.setTarget(std::move(target));
+  pp.setTarget(std::make_tuple(format, isa, syntaxes.front()));
+
+  std::optional<gtirb_pprint::EmissionProfile> Profile;
+  if (vm.count("emission-profile") != 0) {
+    const std::string& Name = vm["emission-profile"].as<std::string>();
+    if (Name == "human") {
+      Profile = gtirb_pprint::HumanReadable;
+    } else if (Name == "machine") {
+      Profile = gtirb_pprint::Machine;
+    } else {
+      LOG_ERROR << "Unknown emission profile '" << Name
+                << "'. Available profiles: human, machine.\n";
+      return EXIT_FAILURE;
+    }
+    pp.setEmissionProfile(*Profile);
+  }
 
   if (vm.count("policy") != 0) {
     auto Policy = vm["policy"].as<std::string>();
@@ -370,31 +742,114 @@ int main(int argc, char** argv) {
     }
   }
 
+  std::shared_ptr<gtirb_pprint::BlockCache> blockCache;
+  if (vm.count("block-cache") != 0) {
+    blockCache = std::make_shared<gtirb_pprint::BlockCache>();
+    const std::string& cachePath = vm["block-cache"].as<std::string>();
+    if (fs::exists(cachePath) && !blockCache->load(cachePath)) {
+      LOG_INFO << "Ignoring unreadable block cache " << cachePath << "\n";
+      blockCache->clear();
+    }
+    pp.setBlockCache(blockCache);
+  }
+
+  if (vm.count("temp-dir") != 0)
+    gtirb_bprint::TempFile::setDirectory(vm["temp-dir"].as<std::string>());
+  gtirb_bprint::TempFile::setMemoryBudget(vm["temp-memory"].as<uint64_t>()
+                                          << 20);
+
+  if (vm.count("integrated-assembler") != 0 &&
+      !gtirb_bprint::hasIntegratedAssembler()) {
+    LOG_ERROR << "This build of gtirb-pprinter does not have an integrated "
+                 "assembler.\n";
+    return EXIT_FAILURE;
+  }
+
+  std::shared_ptr<gtirb_bprint::ObjectCache> objectCache;
+  if (vm.count("object-cache") != 0) {
+    objectCache = std::make_shared<gtirb_bprint::ObjectCache>(
+        vm["object-cache"].as<std::string>(),
+        vm["object-cache-size"].as<uint64_t>() << 20);
+  }
+
+  std::shared_ptr<gtirb_bprint::LibraryIndex> libraryIndex;
+  if (vm.count("library-index") != 0) {
+    libraryIndex = std::make_shared<gtirb_bprint::LibraryIndex>();
+    const std::string& indexPath = vm["library-index"].as<std::string>();
+    if (fs::exists(indexPath) && !libraryIndex->load(indexPath))
+      LOG_INFO << "Ignoring unreadable library index " << indexPath << "\n";
+  }
+
+  // The actions run on each module: over the modules of the IR, or with
+  // --stream-modules, on each module as it is loaded.
+  std::vector<std::function<bool(gtirb::Context&, gtirb::Module&, int)>>
+      moduleActions;
+
   // Write ASM to a file.
   if (vm.count("asm") != 0) {
-    const auto asmPath = fs::path(vm["asm"].as<std::string>());
-    if (!asmPath.has_filename()) {
-      LOG_ERROR << "The given path \"" << asmPath << "\" has no filename.\n";
+    std::vector<fs::path> asmPaths =
+        getSyntaxAsmPaths(vm["asm"].as<std::string>(), syntaxes);
+    if (asmPaths.empty()) {
+      LOG_ERROR << "Expected one assembly file name per syntax.\n";
       return EXIT_FAILURE;
     }
-    int i = 0;
-    for (gtirb::Module& m : ir->modules()) {
-      fs::path name = getAsmFileName(asmPath, i);
-      std::ofstream ofs(name.generic_string());
-      if (ofs) {
-        pp.print(ofs, ctx, m);
-        LOG_INFO << "Module " << i << "'s assembly written to: " << name
-                 << "\n";
-      } else {
-        LOG_ERROR << "Could not output assembly output file: \"" << asmPath
-                  << "\".\n";
+    for (const auto& asmPath : asmPaths) {
+      if (!asmPath.has_filename()) {
+        LOG_ERROR << "The given path \"" << asmPath << "\" has no filename.\n";
+        return EXIT_FAILURE;
+      }
+      if (!gtirb_pprint::isCompressionSupported(
+              gtirb_pprint::compressionForPath(asmPath.generic_string()))) {
+        LOG_ERROR << "This build of gtirb-pprinter cannot write "
+                  << asmPath.extension() << " files.\n";
+        return EXIT_FAILURE;
       }
-      ++i;
     }
+    bool AsyncIO = vm.count("async-io") != 0;
+    moduleActions.push_back([&pp, &syntaxes, asmPaths,
+                             AsyncIO](gtirb::Context& C, gtirb::Module& m,
+                                      int i) {
+      std::vector<fs::path> names;
+      std::vector<std::unique_ptr<gtirb_pprint::OutputBuffer>> Bufs;
+      for (const auto& asmPath : asmPaths) {
+        fs::path name = getAsmFileName(asmPath, i);
+        auto Buf = openAsmFile(name, AsyncIO);
+        if (!Buf) {
+          LOG_ERROR << "Could not output assembly output file: \"" << asmPath
+                    << "\".\n";
+          return true;
+        }
+        names.push_back(name);
+        Bufs.push_back(std::move(Buf));
+      }
+
+      std::vector<std::unique_ptr<std::ostream>> Streams;
+      std::vector<std::pair<std::string, std::ostream*>> Outputs;
+      for (size_t S = 0; S < Bufs.size(); ++S) {
+        Streams.push_back(std::make_unique<std::ostream>(Bufs[S].get()));
+        Outputs.emplace_back(syntaxes[S], Streams.back().get());
+      }
+      if (Outputs.size() == 1) {
+        pp.print(*Streams.front(), C, m);
+      } else {
+        pp.print(Outputs, C, m);
+      }
+      for (size_t S = 0; S < Bufs.size(); ++S) {
+        if (Bufs[S]->close() && *Streams[S]) {
+          LOG_INFO << "Module " << i << "'s assembly written to: " << names[S]
+                   << "\n";
+        } else {
+          LOG_ERROR << "Could not write assembly output file: " << names[S]
+                    << ".\n";
+        }
+      }
+      return true;
+    });
   }
 
   // Write out assembled object files for the given IR, but do not link into a
   // final executable.
+  std::shared_ptr<gtirb_bprint::BinaryPrinter> binariesPrinter;
   if (vm.count("binaries") != 0) {
     const auto asmPath = fs::path(vm["binaries"].as<std::string>());
     if (!asmPath.has_filename()) {
@@ -409,27 +864,130 @@ int main(int argc, char** argv) {
     if (vm.count("library-paths") != 0)
       libraryPaths = vm["library-paths"].as<std::vector<std::string>>();
 
-    std::unique_ptr<gtirb_bprint::BinaryPrinter> binaryPrinter =
+    std::shared_ptr<gtirb_bprint::BinaryPrinter> binaryPrinter =
         getBinaryPrinter(format, pp, extraCompilerArgs, libraryPaths);
+    binariesPrinter = binaryPrinter;
     if (!binaryPrinter) {
       LOG_ERROR << "'" << format
                 << "' is an unsupported binary printing format.\n";
       return EXIT_FAILURE;
     }
+    if (Profile)
+      binaryPrinter->setEmissionProfile(*Profile);
+    binaryPrinter->setObjectCache(objectCache);
+    binaryPrinter->setPipeSources(vm.count("pipe-sources") != 0);
+    binaryPrinter->setDirectObjects(vm.count("direct-objects") != 0);
+    if (auto* elfPrinter = dynamic_cast<gtirb_bprint::ElfBinaryPrinter*>(
+            binaryPrinter.get()))
+      elfPrinter->setIntegratedAssembler(vm.count("integrated-assembler") !=
+                                         0);
+    if (vm.count("compress-temp-sources") != 0) {
+      gtirb_pprint::Compression TempCompression =
+          gtirb_pprint::preferredCompression();
+      if (TempCompression == gtirb_pprint::Compression::None) {
+        LOG_ERROR << "This build of gtirb-pprinter does not support "
+                     "compression.\n";
+        return EXIT_FAILURE;
+      }
+      binaryPrinter->setSourceCompression(TempCompression);
+    }
 
+    moduleActions.push_back(
+        [binaryPrinter, asmPath](gtirb::Context& C, gtirb::Module& m, int i) {
+          fs::path name = getAsmFileName(asmPath, i);
+          if (binaryPrinter->assemble(name.string(), C, m)) {
+            LOG_ERROR << "Unable to assemble '" << name.string() << "'.\n";
+            return false;
+          }
+          return true;
+        });
+  }
+
+  // A failed action stops the loops, but the builds that --binaries already
+  // ran still go into the profile.
+  bool actionsFailed = false;
+  if (moduleCtx) {
+    // Keep a single module in memory at a time: the previous module's
+    // Context, and the pages of the file that held it, are released before
+    // the next module is loaded.
+    for (size_t i = 0; i < serialized->moduleCount() && !actionsFailed; ++i) {
+      if (i > 0) {
+        moduleCtx.reset();
+        mapped->discard(serialized->moduleData(i - 1),
+                        serialized->moduleSize(i - 1));
+        moduleCtx = std::make_unique<gtirb::Context>();
+        ir = serialized->loadModule(*moduleCtx, i);
+        if (!ir) {
+          LOG_ERROR << "Failed to load module " << i << " of the IR.\n";
+          actionsFailed = true;
+          break;
+        }
+        gtirb::Module& M = *ir->modules_begin();
+        prepareModule(*moduleCtx, M,
+                      vm.count("layout") || gtirb_layout::layoutRequired(M));
+      }
+      for (auto& action : moduleActions)
+        if (!action(*moduleCtx, *ir->modules_begin(), static_cast<int>(i))) {
+          actionsFailed = true;
+          break;
+        }
+    }
+  } else if (!moduleActions.empty()) {
     int i = 0;
     for (gtirb::Module& m : ir->modules()) {
-      fs::path name = getAsmFileName(asmPath, i);
-      if (binaryPrinter->assemble(name.string(), ctx, m)) {
-        LOG_ERROR << "Unable to assemble '" << name.string() << "'.\n";
-        return EXIT_FAILURE;
-      }
+      for (auto& action : moduleActions)
+        if (!action(ctx, m, i)) {
+          actionsFailed = true;
+          break;
+        }
+      if (actionsFailed)
+        break;
       ++i;
     }
   }
+  // The profile holds the builds of both --binaries and --binary.
+  const std::string buildProfilePath =
+      vm.count("build-profile") != 0 ? vm["build-profile"].as<std::string>()
+                                     : std::string();
+  BuildProfile buildProfile;
+  if (binariesPrinter)
+    reportBuild(*binariesPrinter, "binaries", buildProfile);
+  if (actionsFailed) {
+    if (binaryPrinter)
+      reportBuild(*binaryPrinter, "binary", buildProfile);
+    writeBuildProfile(buildProfile, buildProfilePath);
+    return EXIT_FAILURE;
+  }
 
-  // Link directly to a binary.
-  if (vm.count("binary") != 0) {
+  // Patch the original binary when the changes allow it, and link directly to
+  // a binary otherwise.
+  bool patched = false;
+  if (vm.count("binary") != 0 && vm.count("patch") != 0) {
+    const auto binaryPath = fs::path(vm["binary"].as<std::string>());
+    // The patched binary keeps all of the original, as it was compiled, so
+    // options that select what is printed or how it is built need a rebuild.
+    std::string reason;
+    for (const char* option :
+         {"policy", "skip-function", "skip-symbol", "skip-section",
+          "skip-array-section", "compiler-args"})
+      if (reason.empty() && vm.count(option) != 0)
+        reason = std::string("--") + option + " is given";
+    if (reason.empty() && ir->modules_begin() == ir->modules_end())
+      reason = "the IR holds no module";
+    if (reason.empty() && std::next(ir->modules_begin()) != ir->modules_end())
+      reason = "the IR holds more than one module";
+    gtirb_bprint::BinaryPatcher patcher;
+    if (reason.empty())
+      patched = patcher.patch(*ir->modules_begin(), binaryPath.string(),
+                              reason);
+    if (patched)
+      LOG_INFO << "Patched " << patcher.patchedBytes() << " bytes and "
+               << patcher.patchedRelocations() << " relocations of the "
+               << "original binary.\n";
+    else
+      LOG_INFO << "A full rebuild is required: " << reason << ".\n";
+  }
+  if (vm.count("binary") != 0 && !patched) {
     const auto binaryPath = fs::path(vm["binary"].as<std::string>());
 
     std::vector<std::string> extraCompilerArgs;
@@ -448,18 +1006,54 @@ int main(int argc, char** argv) {
                 << "' is an unsupported binary printing format.\n";
       return EXIT_FAILURE;
     }
-    if (binaryPrinter->link(binaryPath.string(), ctx, *ir)) {
+    if (Profile)
+      binaryPrinter->setEmissionProfile(*Profile);
+    binaryPrinter->setObjectCache(objectCache);
+    binaryPrinter->setPipeSources(vm.count("pipe-sources") != 0);
+    binaryPrinter->setDirectObjects(vm.count("direct-objects") != 0);
+    if (auto* elfPrinter = dynamic_cast<gtirb_bprint::ElfBinaryPrinter*>(
+            binaryPrinter.get())) {
+      elfPrinter->setIntegratedAssembler(vm.count("integrated-assembler") !=
+                                         0);
+      if (vm.count("linker") != 0)
+        elfPrinter->setLinker(vm["linker"].as<std::string>());
+      if (libraryIndex)
+        elfPrinter->setLibraryIndex(libraryIndex);
+    }
+    binaryPrinter->setJobs(vm["jobs"].as<unsigned>());
+    size_t shards = vm["shards"].as<size_t>();
+    if (vm.count("object-dir") != 0 || shards > 1) {
+      auto* elfPrinter =
+          dynamic_cast<gtirb_bprint::ElfBinaryPrinter*>(binaryPrinter.get());
+      if (!elfPrinter) {
+        LOG_ERROR << "--object-dir and --shards are only supported for ELF.\n";
+        return EXIT_FAILURE;
+      }
+      if (vm.count("object-dir") != 0)
+        elfPrinter->setObjectDirectory(vm["object-dir"].as<std::string>(),
+                                       vm["unit-size"].as<uint64_t>());
+      elfPrinter->setShards(shards);
+    }
+    int linked = binaryPrinter->link(binaryPath.string(), ctx, *ir);
+    reportBuild(*binaryPrinter, "binary", buildProfile);
+    if (linked) {
+      writeBuildProfile(buildProfile, buildProfilePath);
       return EXIT_FAILURE;
     }
   }
+  if (!writeBuildProfile(buildProfile, buildProfilePath))
+    return EXIT_FAILURE;
 
   // Write ASM to the standard output if no other action was taken.
-  if ((vm.count("asm") == 0) && (vm.count("binary") == 0) &&
-      (vm.count("binaries") == 0)) {
+  if (printToStdout) {
+    if (syntaxes.size() > 1) {
+      LOG_ERROR << "Printing several syntaxes requires --asm.\n";
+      return EXIT_FAILURE;
+    }
     gtirb::Module* module = nullptr;
     int i = 0;
     for (gtirb::Module& m : ir->modules()) {
-      if (i == vm["module"].as<int>()) {
+      if (i == moduleIndex) {
         module = &m;
         break;
       }
@@ -467,10 +1061,37 @@ int main(int argc, char** argv) {
     }
     if (!module) {
       LOG_ERROR << "The IR has " << i << " modules, module with index "
-                << vm["module"].as<int>() << " cannot be printed.\n";
+                << moduleIndex << " cannot be printed.\n";
       return EXIT_FAILURE;
     }
-    pp.print(std::cout, ctx, *module);
+    // Bypass std::cout's buffering and write the assembly in large blocks.
+    std::cout.flush();
+    gtirb_pprint::FdOutputBuffer Buf(getStreamFd(stdout));
+    std::ostream Out(&Buf);
+    pp.print(Out, ctx, *module);
+    if (!Buf.close() || !Out) {
+      LOG_ERROR << "Could not write assembly to the standard output.\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (objectCache) {
+    LOG_INFO << "Object cache: " << objectCache->hits() << " hits, "
+             << objectCache->misses() << " misses.\n";
+  }
+  if (libraryIndex) {
+    LOG_INFO << "Library index: " << libraryIndex->listings()
+             << " directories listed.\n";
+    if (!libraryIndex->save(vm["library-index"].as<std::string>())) {
+      LOG_ERROR << "Could not write the library index.\n";
+    }
+  }
+  if (blockCache) {
+    LOG_INFO << "Block cache: " << blockCache->hits() << " hits, "
+             << blockCache->misses() << " misses.\n";
+    if (!blockCache->save(vm["block-cache"].as<std::string>())) {
+      LOG_ERROR << "Could not write the block cache.\n";
+    }
   }
 
   return EXIT_SUCCESS;
@@ -26,9 +26,31 @@
 #pragma warning(disable : 4456) // variable shadowing warning
 #endif                          // __GNUC__
 #include <boost/filesystem.hpp>
+#include <boost/process/child.hpp>
+#include <boost/process/io.hpp>
+#include <boost/process/pipe.hpp>
 #include <boost/process/search_path.hpp>
-#include <boost/process/system.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif // __linux__
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif // _WIN32
 #ifdef __GNUC__
 #pragma GCC diagnostic pop
 #elif defined(_MSC_VER)
@@ -39,27 +61,171 @@ namespace fs = boost::filesystem;
 namespace bp = boost::process;
 
 namespace gtirb_bprint {
-TempFile::TempFile(const std::string extension) {
-  // FIXME: this has TOCTOU issues.
+// The directory of the temporary files on disk, if not the system's.
+static std::string TempDirectory;
+static std::mutex TempDirectoryMutex;
+
+// The size of the files kept in memory, and the limit it is kept under.
+static std::atomic<uint64_t> MemoryBudget{512ULL << 20};
+static std::atomic<uint64_t> MemoryInUse{0};
+
+static fs::path tempDirectory() {
+  {
+    std::lock_guard<std::mutex> Lock(TempDirectoryMutex);
+    if (!TempDirectory.empty())
+      return TempDirectory;
+  }
+  boost::system::error_code EC;
+  fs::path Dir = fs::temp_directory_path(EC);
+  return EC ? fs::path("/tmp") : Dir;
+}
+
+// Reserve Size bytes of the memory budget.
+static bool reserveMemory(uint64_t Size) {
+  if (MemoryBudget == 0)
+    return false;
+  uint64_t InUse = MemoryInUse;
+  do {
+    if (Size > MemoryBudget || InUse > MemoryBudget - Size)
+      return false;
+  } while (!MemoryInUse.compare_exchange_weak(InUse, InUse + Size));
+  return true;
+}
+
+void TempFile::setDirectory(const std::string& directory) {
+  std::lock_guard<std::mutex> Lock(TempDirectoryMutex);
+  TempDirectory = directory;
+}
+
+void TempFile::setMemoryBudget(uint64_t budget) { MemoryBudget = budget; }
+
+// Create a new file in the temporary directory and return its name.
+static std::string createOnDisk(const std::string& extension) {
+  fs::path Dir = tempDirectory();
 #ifdef _WIN32
+  // FIXME: this has TOCTOU issues.
   std::string TmpFileName;
   std::FILE* F = nullptr;
   while (!F) {
-    TmpFileName = std::tmpnam(nullptr);
+    TmpFileName = (Dir / fs::unique_path("file%%%%%%")).string();
     TmpFileName += extension;
     F = fopen(TmpFileName.c_str(), "wx");
   }
   fclose(F);
 #else
-  std::string TmpFileName = "/tmp/fileXXXXXX";
+  std::string TmpFileName = (Dir / "fileXXXXXX").string();
   TmpFileName += extension;
   ::close(mkstemps(TmpFileName.data(), extension.length())); // Create tmp file
 #endif // _WIN32
-  Name = TmpFileName;
+  return TmpFileName;
+}
+
+TempFile::TempFile(const std::string extension, uint64_t expectedSize)
+    : Extension(extension) {
+#ifdef __linux__
+  // A file of unknown size could take any part of the budget, so it goes to
+  // disk.
+  if (expectedSize != 0 && reserveMemory(expectedSize)) {
+    Fd = ::memfd_create(("gtirb-pprinter" + extension).c_str(), 0);
+    if (Fd >= 0) {
+      Reserved = expectedSize;
+      Name = "/proc/self/fd/" + std::to_string(Fd);
+      FileStream.open(Name);
+      return;
+    }
+    MemoryInUse -= expectedSize;
+  }
+#else
+  (void)expectedSize;
+#endif // __linux__
+
+  Name = createOnDisk(extension);
   FileStream.open(Name);
 }
 
-TempFile::~TempFile() { fs::remove(Name); }
+TempFile::TempFile(TempFile&& Other)
+    : Name(std::move(Other.Name)), Extension(std::move(Other.Extension)),
+      FileStream(std::move(Other.FileStream)), Fd(Other.Fd),
+      Reserved(Other.Reserved) {
+  Other.Name.clear();
+  Other.Fd = -1;
+  Other.Reserved = 0;
+}
+
+void TempFile::close() {
+  if (FileStream.is_open())
+    FileStream.close();
+#ifndef _WIN32
+  // Account for the size the file reached, instead of the expected one, and
+  // move the file to disk if it outgrew its share of the budget.
+  struct stat Stat;
+  if (Fd >= 0 && ::fstat(Fd, &Stat) == 0) {
+    uint64_t Size = static_cast<uint64_t>(Stat.st_size);
+    if (Size <= Reserved) {
+      MemoryInUse -= Reserved - Size;
+      Reserved = Size;
+    } else if (reserveMemory(Size - Reserved)) {
+      Reserved = Size;
+    } else if (!spill()) {
+      MemoryInUse += Size - Reserved;
+      Reserved = Size;
+    }
+  }
+#endif // _WIN32
+}
+
+bool TempFile::spill() {
+  std::string DiskName = createOnDisk(Extension);
+  std::ifstream In(Name, std::ios::binary);
+  std::ofstream Out(DiskName, std::ios::binary);
+  if (In && Out)
+    Out << In.rdbuf();
+  Out.close();
+  if (!In || !Out) {
+    boost::system::error_code EC;
+    fs::remove(DiskName, EC);
+    return false;
+  }
+  ::close(Fd);
+  Fd = -1;
+  MemoryInUse -= Reserved;
+  Reserved = 0;
+  Name = DiskName;
+  return true;
+}
+
+TempFile::~TempFile() {
+  if (Fd >= 0) {
+    FileStream.close();
+    ::close(Fd);
+    MemoryInUse -= Reserved;
+  } else if (!Name.empty()) {
+    boost::system::error_code EC;
+    fs::remove(Name, EC);
+  }
+}
+
+TempFifo::TempFifo(const std::string& extension) {
+#ifndef _WIN32
+  // Creating a new directory fails if it exists, so the name of the pipe
+  // cannot be taken in the meantime.
+  boost::system::error_code EC;
+  fs::path Dir = tempDirectory() / fs::unique_path("fifo%%%%%%%%%%%%", EC);
+  if (EC || !fs::create_directory(Dir, EC) || EC)
+    return;
+  Directory = Dir.string();
+  std::string FifoName = (Dir / ("input" + extension)).string();
+  if (::mkfifo(FifoName.c_str(), 0600) == 0)
+    Name = FifoName;
+#endif // _WIN32
+}
+
+TempFifo::~TempFifo() {
+  if (!Directory.empty()) {
+    boost::system::error_code EC;
+    fs::remove_all(Directory, EC);
+  }
+}
 
 std::string replaceExtension(const std::string path,
                              const std::string new_ext) {
@@ -86,12 +252,233 @@ std::optional<std::string> resolveRegularFilePath(const std::string& path,
   return resolveRegularFilePath(filePath.string());
 }
 
+std::optional<std::string> findTool(const std::string& tool) {
+  fs::path toolPath = bp::search_path(tool);
+  if (toolPath.empty())
+    return std::nullopt;
+  return toolPath.string();
+}
+
+// Tools are started on several threads, and a tool that inherits the write
+// end of the pipe to another tool's input keeps that tool from ever reading
+// the end of it. The pipes are therefore closed on exec, and a pipe is
+// created and marked so while holding this, which starting any tool holds
+// as well.
+static std::mutex SpawnMutex;
+
+static void closeOnExec(bp::pipe& pipe) {
+#ifdef _WIN32
+  (void)pipe;
+#else
+  for (int fd : {pipe.native_source(), pipe.native_sink()})
+    ::fcntl(fd, F_SETFD, ::fcntl(fd, F_GETFD) | FD_CLOEXEC);
+#endif // _WIN32
+}
+
+// Wait for a child to exit and return its exit code, as child::wait does,
+// and fill usage with the resources it used since start.
+static int waitChild(bp::child& child, ProcessUsage* usage,
+                     std::chrono::steady_clock::time_point start) {
+#ifdef _WIN32
+  child.wait();
+  int code = child.exit_code();
+#else
+  // Boost.Process does not report what the child used, which wait4 does,
+  // so the child is reaped here instead.
+  child.detach();
+  int status = 0;
+  struct rusage resources = {};
+  pid_t pid;
+  do {
+    pid = ::wait4(child.id(), &status, 0, &resources);
+  } while (pid < 0 && errno == EINTR);
+  int code = -1;
+  if (pid >= 0)
+    code = WIFEXITED(status)     ? WEXITSTATUS(status)
+           : WIFSIGNALED(status) ? WTERMSIG(status)
+                                 : status;
+#endif // _WIN32
+  if (usage) {
+    std::chrono::duration<double> wall =
+        std::chrono::steady_clock::now() - start;
+    usage->WallSeconds = wall.count();
+#ifndef _WIN32
+    usage->UserSeconds = static_cast<double>(resources.ru_utime.tv_sec) +
+                         static_cast<double>(resources.ru_utime.tv_usec) / 1e6;
+    usage->SystemSeconds =
+        static_cast<double>(resources.ru_stime.tv_sec) +
+        static_cast<double>(resources.ru_stime.tv_usec) / 1e6;
+#ifdef __APPLE__
+    usage->PeakRssBytes = static_cast<uint64_t>(resources.ru_maxrss);
+#else
+    usage->PeakRssBytes = static_cast<uint64_t>(resources.ru_maxrss) * 1024;
+#endif // __APPLE__
+#endif // _WIN32
+  }
+  return code;
+}
+
 std::optional<int> execute(const std::string& tool,
-                           const std::vector<std::string>& args) {
+                           const std::vector<std::string>& args,
+                           ProcessUsage* usage) {
+  fs::path toolPath = bp::search_path(tool);
+  if (toolPath.empty())
+    return std::nullopt;
+
+  auto start = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> spawnLock(SpawnMutex);
+  bp::child child(toolPath, args);
+  spawnLock.unlock();
+  return waitChild(child, usage, start);
+}
+
+std::optional<int>
+execute(const std::string& tool, const std::vector<std::string>& args,
+        const std::function<bool(std::ostream&)>& writeInput,
+        ProcessUsage* usage) {
+  fs::path toolPath = bp::search_path(tool);
+  if (toolPath.empty())
+    return std::nullopt;
+
+  auto start = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> spawnLock(SpawnMutex);
+  bp::opstream input;
+  closeOnExec(input.pipe());
+  bp::child child(toolPath, args, bp::std_in < input);
+  spawnLock.unlock();
+#ifndef _WIN32
+  // A tool that exits early makes writes fail with EPIPE, instead of raising
+  // SIGPIPE, which would end this process. The signal is blocked only after
+  // the child has started, so that the tool does not inherit the mask.
+  sigset_t pipeSignal, oldMask;
+  sigemptyset(&pipeSignal);
+  sigaddset(&pipeSignal, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipeSignal, &oldMask);
+#endif // _WIN32
+  bool written = writeInput(input);
+  input.flush();
+  input.pipe().close();
+#ifndef _WIN32
+  // Discard the SIGPIPE raised by failed writes before unblocking it.
+  if (!sigismember(&oldMask, SIGPIPE)) {
+    struct timespec noWait = {0, 0};
+    while (sigtimedwait(&pipeSignal, nullptr, &noWait) > 0) {
+    }
+  }
+  pthread_sigmask(SIG_SETMASK, &oldMask, nullptr);
+#endif // _WIN32
+  int code = waitChild(child, usage, start);
+  if (code == 0 && (!written || !input))
+    return -1;
+  return code;
+}
+
+std::optional<std::string> executeOutput(const std::string& tool,
+                                         const std::vector<std::string>& args) {
   fs::path toolPath = bp::search_path(tool);
   if (toolPath.empty())
     return std::nullopt;
 
-  return bp::system(toolPath, args);
+  std::unique_lock<std::mutex> spawnLock(SpawnMutex);
+  bp::ipstream output;
+  closeOnExec(output.pipe());
+  bp::child child(toolPath, args, bp::std_out > output, bp::std_err > bp::null);
+  spawnLock.unlock();
+  std::string text{std::istreambuf_iterator<char>(output),
+                   std::istreambuf_iterator<char>()};
+  child.wait();
+  if (child.exit_code() != 0)
+    return std::nullopt;
+  return text;
+}
+
+std::optional<int>
+execute(const std::string& tool, const std::vector<std::string>& args,
+        const std::vector<std::string>& fifos,
+        const std::function<bool(size_t, std::ostream&)>& writeInput,
+        ProcessUsage* usage) {
+  fs::path toolPath = bp::search_path(tool);
+  if (toolPath.empty())
+    return std::nullopt;
+
+#ifdef _WIN32
+  (void)args;
+  (void)fifos;
+  (void)writeInput;
+  (void)usage;
+  return -1;
+#else
+  std::atomic<bool> exited{false};
+  bool written = true;
+  std::thread writer([&]() {
+    // A tool that exits early makes writes fail with EPIPE, instead of
+    // raising SIGPIPE, which would end this process.
+    sigset_t pipeSignal;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, nullptr);
+
+    for (size_t i = 0; i < fifos.size(); ++i) {
+      // Opening a pipe blocks until the tool opens it as well, which it may
+      // never do. Poll instead, until the tool has opened it or exited.
+      int fd;
+      while ((fd = ::open(fifos[i].c_str(), O_WRONLY | O_NONBLOCK)) < 0) {
+        if (errno != ENXIO || exited) {
+          written = false;
+          return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      // The tool holds the pipe open for reading, so this does not block.
+      // Once a pipe fails, the remaining ones are left empty, so that the
+      // tool does not wait for them.
+      std::ofstream input(fifos[i], std::ios::binary);
+      ::close(fd);
+      if (written && !writeInput(i, input))
+        written = false;
+      input.close();
+      if (!input)
+        written = false;
+    }
+  });
+  auto start = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> spawnLock(SpawnMutex);
+  bp::child child(toolPath, args);
+  spawnLock.unlock();
+  int code = waitChild(child, usage, start);
+  exited = true;
+  writer.join();
+  if (code == 0 && !written)
+    return -1;
+  return code;
+#endif // _WIN32
+}
+
+bool runJobs(size_t count, unsigned jobs,
+             const std::function<bool(size_t)>& work) {
+  if (jobs == 0)
+    jobs = std::max(1u, std::thread::hardware_concurrency());
+  size_t threads = std::min<size_t>(jobs, count);
+  if (threads <= 1) {
+    for (size_t i = 0; i < count; ++i)
+      if (!work(i))
+        return false;
+    return true;
+  }
+
+  std::atomic<size_t> next{0};
+  std::atomic<bool> failed{false};
+  auto worker = [&]() {
+    for (size_t i = next++; i < count && !failed; i = next++)
+      if (!work(i))
+        failed = true;
+  };
+  std::vector<std::thread> pool;
+  for (size_t t = 1; t < threads; ++t)
+    pool.emplace_back(worker);
+  worker();
+  for (std::thread& thread : pool)
+    thread.join();
+  return !failed;
 }
 } // namespace gtirb_bprint
@@ -0,0 +1,219 @@
+//===- BlockCacheTest.cpp ---------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "BlockCache.hpp"
+#include "PrettyPrinter.hpp"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <gtirb/gtirb.hpp>
+#include <memory>
+#include <sstream>
+#include <string>
+
+using namespace gtirb_pprint;
+namespace fs = boost::filesystem;
+
+static Fingerprint fingerprint(std::initializer_list<std::string> Values) {
+  FingerprintBuilder Builder;
+  for (const std::string& Value : Values) {
+    Builder.add(Value);
+  }
+  return Builder.get();
+}
+
+TEST(Unit_Fingerprint, DependsOnValuesAndBoundaries) {
+  EXPECT_EQ(fingerprint({"mov", "eax"}), fingerprint({"mov", "eax"}));
+  EXPECT_FALSE(fingerprint({"mov", "eax"}) == fingerprint({"mov", "ebx"}));
+  EXPECT_FALSE(fingerprint({"mov", "eax"}) == fingerprint({"eax", "mov"}));
+  EXPECT_FALSE(fingerprint({"ab", "c"}) == fingerprint({"a", "bc"}));
+  EXPECT_FALSE(fingerprint({""}) == fingerprint({}));
+
+  FingerprintBuilder Zero, One;
+  Zero.add(uint64_t(0));
+  One.add(uint64_t(1));
+  EXPECT_FALSE(Zero.get() == One.get());
+}
+
+class Unit_BlockCache : public ::testing::Test {
+protected:
+  void SetUp() override {
+    Path = fs::temp_directory_path() / fs::unique_path("%%%%-%%%%-%%%%.bc");
+  }
+  void TearDown() override { fs::remove(Path); }
+
+  fs::path Path;
+};
+
+TEST_F(Unit_BlockCache, FindsInsertedEntries) {
+  BlockCache Cache;
+  Fingerprint A = fingerprint({"a"}), B = fingerprint({"b"});
+  EXPECT_EQ(Cache.find(A), nullptr);
+  Cache.insert(A, "text a\n", true, false);
+
+  const BlockCache::Entry* E = Cache.find(A);
+  ASSERT_NE(E, nullptr);
+  EXPECT_EQ(E->Text, "text a\n");
+  EXPECT_TRUE(E->InProcedure);
+  EXPECT_FALSE(E->AdvancesPC);
+  EXPECT_EQ(Cache.find(B), nullptr);
+  EXPECT_EQ(Cache.hits(), 1u);
+  EXPECT_EQ(Cache.misses(), 2u);
+
+  // An existing entry is kept.
+  Cache.insert(A, "other text\n", false, true);
+  EXPECT_EQ(Cache.find(A)->Text, "text a\n");
+}
+
+TEST_F(Unit_BlockCache, SavesUsedEntries) {
+  Fingerprint A = fingerprint({"a"}), B = fingerprint({"b"});
+  {
+    BlockCache Cache;
+    Cache.insert(A, "text a\n", false, true);
+    Cache.insert(B, std::string(100000, 'b'), true, true);
+    ASSERT_TRUE(Cache.save(Path.string()));
+  }
+  BlockCache Loaded;
+  ASSERT_TRUE(Loaded.load(Path.string()));
+  EXPECT_EQ(Loaded.size(), 2u);
+  ASSERT_NE(Loaded.find(B), nullptr);
+  EXPECT_EQ(Loaded.find(B)->Text, std::string(100000, 'b'));
+  EXPECT_TRUE(Loaded.find(B)->InProcedure);
+
+  // Only the entries used since loading are saved again.
+  ASSERT_TRUE(Loaded.save(Path.string()));
+  BlockCache Reloaded;
+  ASSERT_TRUE(Reloaded.load(Path.string()));
+  EXPECT_EQ(Reloaded.size(), 1u);
+  EXPECT_EQ(Reloaded.find(A), nullptr);
+  EXPECT_NE(Reloaded.find(B), nullptr);
+}
+
+TEST_F(Unit_BlockCache, RejectsDamagedFiles) {
+  BlockCache Cache;
+  EXPECT_FALSE(Cache.load(Path.string()));
+
+  {
+    std::ofstream Out(Path.string(), std::ios::binary);
+    Out << "not a cache file";
+  }
+  EXPECT_FALSE(Cache.load(Path.string()));
+
+  Cache.insert(fingerprint({"a"}), std::string(1000, 'a'), false, true);
+  ASSERT_TRUE(Cache.save(Path.string()));
+  uint64_t Size = fs::file_size(Path);
+
+  // A truncated entry.
+  fs::resize_file(Path, Size - 1);
+  EXPECT_FALSE(BlockCache().load(Path.string()));
+
+  // A text size far beyond the end of the file. It follows the magic, the
+  // fingerprint and the flags.
+  fs::resize_file(Path, Size);
+  {
+    std::fstream Out(Path.string(),
+                     std::ios::binary | std::ios::in | std::ios::out);
+    Out.seekp(8 + 16 + 1);
+    uint64_t Huge = ~uint64_t(0) >> 1;
+    Out.write(reinterpret_cast<const char*>(&Huge), sizeof(Huge));
+  }
+  EXPECT_FALSE(BlockCache().load(Path.string()));
+}
+
+class Unit_BlockCachePrint : public ::testing::Test {
+protected:
+  void SetUp() override {
+    using namespace gtirb;
+    Ir = IR::Create(Ctx);
+    M = Ir->addModule(Ctx, "test");
+    M->setISA(ISA::X64);
+    M->setFileFormat(FileFormat::ELF);
+    Section* S = M->addSection(Ctx, ".data");
+    BI = S->addByteInterval(Ctx, Addr(0x1000), 16, 16);
+    for (uint64_t Offset = 0; Offset < 16; Offset += 4) {
+      DataBlock* B = BI->addBlock<DataBlock>(Ctx, Offset, 4);
+      M->addSymbol(Ctx, B, "block" + std::to_string(Offset / 4));
+    }
+    Printer.setTarget(std::make_tuple("elf", "x64", "att"));
+    Printer.setBlockCache(Cache);
+  }
+
+  std::string print() {
+    std::ostringstream Out;
+    EXPECT_FALSE(Printer.print(Out, Ctx, *M));
+    return Out.str();
+  }
+
+  gtirb::Context Ctx;
+  gtirb::IR* Ir;
+  gtirb::Module* M;
+  gtirb::ByteInterval* BI;
+  std::shared_ptr<BlockCache> Cache = std::make_shared<BlockCache>();
+  PrettyPrinter Printer;
+};
+
+TEST_F(Unit_BlockCachePrint, ReusesUnchangedBlocks) {
+  std::string First = print();
+  EXPECT_EQ(Cache->hits(), 0u);
+  EXPECT_EQ(Cache->misses(), 4u);
+
+  EXPECT_EQ(print(), First);
+  EXPECT_EQ(Cache->hits(), 4u);
+  EXPECT_EQ(Cache->misses(), 4u);
+
+  // Only the changed block is printed again.
+  *BI->bytes_begin<uint8_t>() = 0x42;
+  std::string Changed = print();
+  EXPECT_NE(Changed, First);
+  EXPECT_EQ(Cache->hits(), 7u);
+  EXPECT_EQ(Cache->misses(), 5u);
+
+  // The output matches a print without the cache.
+  Printer.setBlockCache(nullptr);
+  EXPECT_EQ(print(), Changed);
+}
+
+TEST_F(Unit_BlockCachePrint, ConfigurationChangesMissTheCache) {
+  std::string Att = print();
+  Printer.setTarget(std::make_tuple("elf", "x64", "intel"));
+  std::string Intel = print();
+  EXPECT_EQ(Cache->hits(), 0u);
+  EXPECT_EQ(Cache->misses(), 8u);
+
+  Printer.setEmissionProfile(Machine);
+  print();
+  EXPECT_EQ(Cache->hits(), 0u);
+
+  Printer.setEmissionProfile(HumanReadable);
+  EXPECT_EQ(print(), Intel);
+  Printer.setTarget(std::make_tuple("elf", "x64", "att"));
+  EXPECT_EQ(print(), Att);
+  EXPECT_EQ(Cache->hits(), 8u);
+}
+
+TEST_F(Unit_BlockCachePrint, SavedCacheServesTheNextRun) {
+  std::string First = print();
+  fs::path Path =
+      fs::temp_directory_path() / fs::unique_path("%%%%-%%%%-%%%%.bc");
+  ASSERT_TRUE(Cache->save(Path.string()));
+
+  auto Loaded = std::make_shared<BlockCache>();
+  ASSERT_TRUE(Loaded->load(Path.string()));
+  fs::remove(Path);
+  Printer.setBlockCache(Loaded);
+  EXPECT_EQ(print(), First);
+  EXPECT_EQ(Loaded->hits(), 4u);
+  EXPECT_EQ(Loaded->misses(), 0u);
+}
@@ -0,0 +1,118 @@
+//===- CApiTest.cpp ---------------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "c_api.h"
+
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <string>
+
+static const char* TwoModules = TEST_DATA_DIR "/two_modules.gtirb";
+
+static int appendBlock(void* UserData, const char* Data, size_t Size) {
+  static_cast<std::string*>(UserData)->append(Data, Size);
+  return 1;
+}
+
+static int refuseBlock(void*, const char*, size_t) { return 0; }
+
+TEST(Unit_CApi, PrintsModulesFromFile) {
+  gtirb_pprint_ir* Ir = nullptr;
+  ASSERT_EQ(gtirb_pprint_ir_load_file(TwoModules, &Ir), GTIRB_PPRINT_OK);
+  ASSERT_EQ(gtirb_pprint_ir_module_count(Ir), 2u);
+
+  for (size_t Module = 0; Module < 2; ++Module) {
+    gtirb_pprint_string* Text = nullptr;
+    ASSERT_EQ(gtirb_pprint_print_module_to_string(Ir, Module, nullptr, &Text),
+              GTIRB_PPRINT_OK);
+    std::string FromString(gtirb_pprint_string_data(Text),
+                           gtirb_pprint_string_size(Text));
+    gtirb_pprint_string_free(Text);
+    EXPECT_NE(FromString.find(".text"), std::string::npos);
+
+    // Both sinks produce the same assembly.
+    std::string FromCallback;
+    ASSERT_EQ(gtirb_pprint_print_module(Ir, Module, nullptr, appendBlock,
+                                        &FromCallback),
+              GTIRB_PPRINT_OK);
+    EXPECT_EQ(FromCallback, FromString);
+  }
+  gtirb_pprint_ir_free(Ir);
+}
+
+TEST(Unit_CApi, LoadsFromMemory) {
+  std::ifstream In(TwoModules, std::ios::in | std::ios::binary);
+  std::string Bytes((std::istreambuf_iterator<char>(In)),
+                    std::istreambuf_iterator<char>());
+  ASSERT_FALSE(Bytes.empty());
+
+  gtirb_pprint_ir* Ir = nullptr;
+  ASSERT_EQ(gtirb_pprint_ir_load_memory(Bytes.data(), Bytes.size(), &Ir),
+            GTIRB_PPRINT_OK);
+  EXPECT_EQ(gtirb_pprint_ir_module_count(Ir), 2u);
+  gtirb_pprint_ir_free(Ir);
+
+  Ir = nullptr;
+  EXPECT_EQ(gtirb_pprint_ir_load_memory(Bytes.data(), Bytes.size() / 2, &Ir),
+            GTIRB_PPRINT_LOAD_FAILED);
+  EXPECT_EQ(Ir, nullptr);
+}
+
+TEST(Unit_CApi, RejectsMalformedMemory) {
+  std::ifstream In(TwoModules, std::ios::in | std::ios::binary);
+  std::string Bytes((std::istreambuf_iterator<char>(In)),
+                    std::istreambuf_iterator<char>());
+  ASSERT_GT(Bytes.size(), 64u);
+
+  // Keep the header but scramble everything after it, so the load gets past
+  // the magic and fails inside the IR.
+  std::string Malformed = Bytes;
+  for (size_t I = 16; I < Malformed.size(); ++I) {
+    Malformed[I] = static_cast<char>(Malformed[I] ^ (I * 131 + 7));
+  }
+  std::string Garbage(4096, '\xff');
+
+  for (const std::string* Data : {&Malformed, &Garbage}) {
+    gtirb_pprint_ir* Ir = nullptr;
+    EXPECT_EQ(gtirb_pprint_ir_load_memory(Data->data(), Data->size(), &Ir),
+              GTIRB_PPRINT_LOAD_FAILED);
+    EXPECT_EQ(Ir, nullptr);
+  }
+}
+
+TEST(Unit_CApi, ReportsErrors) {
+  gtirb_pprint_ir* Ir = nullptr;
+  EXPECT_EQ(gtirb_pprint_ir_load_file(nullptr, &Ir),
+            GTIRB_PPRINT_INVALID_ARGUMENT);
+  EXPECT_EQ(gtirb_pprint_ir_load_file(TEST_DATA_DIR "/missing.gtirb", &Ir),
+            GTIRB_PPRINT_LOAD_FAILED);
+  EXPECT_EQ(gtirb_pprint_ir_module_count(nullptr), 0u);
+  gtirb_pprint_ir_free(nullptr);
+  gtirb_pprint_string_free(nullptr);
+
+  ASSERT_EQ(gtirb_pprint_ir_load_file(TwoModules, &Ir), GTIRB_PPRINT_OK);
+  gtirb_pprint_string* Text = nullptr;
+  EXPECT_EQ(gtirb_pprint_print_module_to_string(Ir, 2, nullptr, &Text),
+            GTIRB_PPRINT_INVALID_ARGUMENT);
+  EXPECT_EQ(gtirb_pprint_print_module_to_string(Ir, 0, "no-such-syntax",
+                                                &Text),
+            GTIRB_PPRINT_UNSUPPORTED_TARGET);
+  EXPECT_EQ(Text, nullptr);
+  EXPECT_EQ(gtirb_pprint_print_module(Ir, 0, nullptr, nullptr, nullptr),
+            GTIRB_PPRINT_INVALID_ARGUMENT);
+  EXPECT_EQ(gtirb_pprint_print_module(Ir, 0, nullptr, refuseBlock, nullptr),
+            GTIRB_PPRINT_OUTPUT_FAILED);
+  gtirb_pprint_ir_free(Ir);
+}
@@ -0,0 +1,208 @@
+//===- CompressionTest.cpp --------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "Compression.hpp"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <ostream>
+#include <string>
+#ifdef GTIRB_PPRINTER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace gtirb_pprint;
+namespace fs = boost::filesystem;
+
+class Unit_Compression : public ::testing::TestWithParam<Compression> {
+protected:
+  void SetUp() override {
+    Path = fs::temp_directory_path() / fs::unique_path("%%%%-%%%%-%%%%.out");
+  }
+  void TearDown() override { fs::remove(Path); }
+
+  std::string decompress(Compression Format, bool& Ok) {
+    std::string Text;
+    Ok = decompressFile(Path.string(), Format,
+                        [&](const char* Data, size_t Size) {
+                          Text.append(Data, Size);
+                          return true;
+                        });
+    return Text;
+  }
+
+  fs::path Path;
+};
+
+TEST_P(Unit_Compression, RoundTrip) {
+  Compression Format = GetParam();
+  if (!isCompressionSupported(Format)) {
+    GTEST_SKIP() << "compression format not supported by this build";
+  }
+
+  std::string Expected;
+  {
+    auto Buffer = CompressedOutputBuffer::open(Path.string(), Format, 4096);
+    ASSERT_TRUE(Buffer);
+    std::ostream Out(Buffer.get());
+    // Assembly-like lines, then a block larger than the buffer.
+    for (int I = 0; I < 100000; ++I) {
+      std::string Line = "  mov $" + std::to_string(I * 7919 % 65521) +
+                         ", %eax  # line " + std::to_string(I) + "\n";
+      Out << Line;
+      Expected += Line;
+    }
+    std::string Block(1 << 20, 'z');
+    Out << Block;
+    Expected += Block;
+    ASSERT_TRUE(Buffer->close());
+  }
+  EXPECT_LT(fs::file_size(Path), Expected.size());
+
+  bool Ok = false;
+  std::string Actual = decompress(Format, Ok);
+  EXPECT_TRUE(Ok);
+  EXPECT_TRUE(Actual == Expected);
+}
+
+TEST_P(Unit_Compression, RoundTripEmpty) {
+  Compression Format = GetParam();
+  if (!isCompressionSupported(Format)) {
+    GTEST_SKIP() << "compression format not supported by this build";
+  }
+  auto Buffer = CompressedOutputBuffer::open(Path.string(), Format);
+  ASSERT_TRUE(Buffer);
+  ASSERT_TRUE(Buffer->close());
+
+  bool Ok = false;
+  EXPECT_EQ(decompress(Format, Ok), "");
+  EXPECT_TRUE(Ok);
+}
+
+TEST_P(Unit_Compression, RejectsTruncatedInput) {
+  Compression Format = GetParam();
+  if (!isCompressionSupported(Format)) {
+    GTEST_SKIP() << "compression format not supported by this build";
+  }
+  {
+    auto Buffer = CompressedOutputBuffer::open(Path.string(), Format);
+    ASSERT_TRUE(Buffer);
+    std::ostream Out(Buffer.get());
+    for (int I = 0; I < 10000; ++I) {
+      Out << "line " << I << "\n";
+    }
+    ASSERT_TRUE(Buffer->close());
+  }
+  fs::resize_file(Path, fs::file_size(Path) / 2);
+
+  bool Ok = true;
+  decompress(Format, Ok);
+  EXPECT_FALSE(Ok);
+}
+
+INSTANTIATE_TEST_SUITE_P(Formats, Unit_Compression,
+                         ::testing::Values(Compression::Gzip,
+                                           Compression::Zstd));
+
+TEST(Unit_Compression, FormatForPath) {
+  EXPECT_EQ(compressionForPath("out.s.gz"), Compression::Gzip);
+  EXPECT_EQ(compressionForPath("out.s.zst"), Compression::Zstd);
+  EXPECT_EQ(compressionForPath("out.s"), Compression::None);
+  EXPECT_EQ(compressionExtension(Compression::Gzip), ".gz");
+  EXPECT_EQ(compressionExtension(Compression::Zstd), ".zst");
+  EXPECT_EQ(compressionExtension(Compression::None), "");
+}
+
+#ifdef GTIRB_PPRINTER_HAVE_ZLIB
+// Compress Size bytes of 'a' followed by stored (uncompressed) bytes, so that
+// input and output advance together after the compressible part.
+static std::string gzipStream(size_t Size, const std::string& Stored) {
+  z_stream Stream{};
+  deflateInit2(&Stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8,
+               Z_DEFAULT_STRATEGY);
+  std::string Input(Size, 'a');
+  std::string Result(deflateBound(&Stream, Size + Stored.size()) + 1024, '\0');
+  Stream.next_out = reinterpret_cast<Bytef*>(&Result[0]);
+  Stream.avail_out = static_cast<uInt>(Result.size());
+  Stream.next_in = reinterpret_cast<Bytef*>(&Input[0]);
+  Stream.avail_in = static_cast<uInt>(Input.size());
+  deflate(&Stream, Z_FULL_FLUSH);
+  deflateParams(&Stream, Z_NO_COMPRESSION, Z_DEFAULT_STRATEGY);
+  Stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(Stored.data()));
+  Stream.avail_in = static_cast<uInt>(Stored.size());
+  deflate(&Stream, Z_FINISH);
+  Result.resize(Stream.total_out);
+  deflateEnd(&Stream);
+  return Result;
+}
+
+// The number of bytes inflated from the first Input bytes of a stream.
+static size_t inflatedSize(const std::string& Compressed, size_t Input) {
+  z_stream Stream{};
+  inflateInit2(&Stream, 32 + MAX_WBITS);
+  std::string Out(1 << 16, '\0');
+  Stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(
+      Compressed.data()));
+  Stream.avail_in = static_cast<uInt>(std::min(Input, Compressed.size()));
+  size_t Total = 0;
+  int Ret;
+  do {
+    Stream.next_out = reinterpret_cast<Bytef*>(&Out[0]);
+    Stream.avail_out = static_cast<uInt>(Out.size());
+    Ret = inflate(&Stream, Z_NO_FLUSH);
+    Total += Out.size() - Stream.avail_out;
+  } while (Ret == Z_OK && Stream.avail_out == 0);
+  inflateEnd(&Stream);
+  return Total;
+}
+
+TEST(Unit_Compression, GzipInputEndingWithFullOutput) {
+  // decompressFile reads and inflates 128 KiB at a time. Find a stream
+  // whose first 128 KiB of input inflate to a whole number of 128 KiB
+  // output blocks, so that inflate runs out of input right after filling
+  // its output.
+  const size_t Chunk = 1 << 17;
+  std::string Stored;
+  for (size_t I = 0; I < 2 * Chunk; ++I) {
+    Stored += static_cast<char>((I * 2654435761u) >> 13);
+  }
+  std::string Compressed;
+  size_t Size = 2 * Chunk;
+  for (; Size < 3 * Chunk; ++Size) {
+    Compressed = gzipStream(Size, Stored);
+    if (inflatedSize(Compressed, Chunk) % Chunk == 0) {
+      break;
+    }
+  }
+  ASSERT_LT(Size, 3 * Chunk);
+
+  fs::path Path =
+      fs::temp_directory_path() / fs::unique_path("%%%%-%%%%-%%%%.gz");
+  {
+    std::ofstream Out(Path.string(), std::ios::binary);
+    Out << Compressed;
+  }
+  std::string Actual;
+  bool Ok = decompressFile(Path.string(), Compression::Gzip,
+                           [&](const char* Data, size_t Length) {
+                             Actual.append(Data, Length);
+                             return true;
+                           });
+  fs::remove(Path);
+  EXPECT_TRUE(Ok);
+  EXPECT_TRUE(Actual == std::string(Size, 'a') + Stored);
+}
+#endif // GTIRB_PPRINTER_HAVE_ZLIB
@@ -0,0 +1,127 @@
+//===- LibraryIndexTest.cpp -------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "LibraryIndex.hpp"
+
+#include <boost/filesystem.hpp>
+#include <ctime>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif // __linux__
+
+using namespace gtirb_bprint;
+namespace fs = boost::filesystem;
+
+class Unit_LibraryIndex : public ::testing::Test {
+protected:
+  void SetUp() override {
+    Dir = fs::temp_directory_path() / fs::unique_path("%%%%-%%%%-%%%%");
+    fs::create_directories(Dir);
+    std::ofstream(Library().string()) << "not a real library";
+    Path = Dir.string() + ".index";
+  }
+  void TearDown() override {
+    fs::remove_all(Dir);
+    fs::remove(Path);
+  }
+
+  fs::path Library() const { return Dir / "libfoo.so"; }
+
+  // Move the time of the directory out of the second before a save, so that
+  // a saved listing of it is reused.
+  void age() { fs::last_write_time(Dir, std::time(nullptr) - 60); }
+
+  fs::path Dir;
+  std::string Path;
+};
+
+TEST_F(Unit_LibraryIndex, FindsLibraries) {
+  LibraryIndex Index;
+  std::optional<std::string> Found = Index.find("libfoo.so", {Dir.string()});
+  ASSERT_TRUE(Found);
+  EXPECT_TRUE(fs::equivalent(*Found, Library()));
+  EXPECT_FALSE(Index.find("libbar.so", {Dir.string()}));
+  EXPECT_EQ(Index.listings(), 1u);
+}
+
+TEST_F(Unit_LibraryIndex, ReusesSavedListings) {
+  age();
+  LibraryIndex Index;
+  ASSERT_TRUE(Index.find("libfoo.so", {Dir.string()}));
+  ASSERT_TRUE(Index.save(Path));
+
+  LibraryIndex Loaded;
+  ASSERT_TRUE(Loaded.load(Path));
+  std::optional<std::string> Found = Loaded.find("libfoo.so", {Dir.string()});
+  ASSERT_TRUE(Found);
+  EXPECT_TRUE(fs::equivalent(*Found, Library()));
+  EXPECT_EQ(Loaded.listings(), 0u);
+}
+
+TEST_F(Unit_LibraryIndex, RejectsDamagedFiles) {
+  LibraryIndex Index;
+  EXPECT_FALSE(Index.load(Path));
+
+  {
+    std::ofstream Out(Path, std::ios::binary);
+    Out << "not an index file";
+  }
+  EXPECT_FALSE(Index.load(Path));
+
+  ASSERT_TRUE(Index.find("libfoo.so", {Dir.string()}));
+  ASSERT_TRUE(Index.save(Path));
+  uint64_t Size = fs::file_size(Path);
+
+  // A truncated entry.
+  fs::resize_file(Path, Size - 1);
+  EXPECT_FALSE(LibraryIndex().load(Path));
+
+  // A directory name size far beyond the end of the file. It follows the
+  // magic and the save time.
+  fs::resize_file(Path, Size);
+  {
+    std::fstream Out(Path, std::ios::binary | std::ios::in | std::ios::out);
+    Out.seekp(16);
+    uint64_t Huge = ~uint64_t(0) >> 1;
+    Out.write(reinterpret_cast<const char*>(&Huge), sizeof(Huge));
+  }
+  EXPECT_FALSE(LibraryIndex().load(Path));
+}
+
+#ifdef __linux__
+TEST_F(Unit_LibraryIndex, RelistsRacilyCleanDirectories) {
+  LibraryIndex Index;
+  ASSERT_TRUE(Index.find("libfoo.so", {Dir.string()}));
+  ASSERT_TRUE(Index.save(Path));
+
+  // Add a file without changing the time of the directory, as a change in
+  // the same tick of a file system with coarse times would.
+  struct stat St;
+  ASSERT_EQ(::stat(Dir.string().c_str(), &St), 0);
+  std::ofstream((Dir / "libbar.so").string()) << "not a real library";
+  struct timespec Times[2] = {{0, UTIME_OMIT}, St.st_mtim};
+  ASSERT_EQ(::utimensat(AT_FDCWD, Dir.string().c_str(), Times, 0), 0);
+
+  // The directory changed within a second of the save, so it is listed again
+  // and the new file is found.
+  LibraryIndex Loaded;
+  ASSERT_TRUE(Loaded.load(Path));
+  EXPECT_TRUE(Loaded.find("libbar.so", {Dir.string()}));
+  EXPECT_EQ(Loaded.listings(), 1u);
+}
+#endif // __linux__
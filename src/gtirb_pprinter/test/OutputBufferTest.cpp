@@ -0,0 +1,158 @@
+//===- OutputBufferTest.cpp -------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "OutputBuffer.hpp"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <ostream>
+#include <string>
+#include <vector>
+#if !defined(_MSC_VER)
+#include <sys/mman.h>
+#endif
+
+using namespace gtirb_pprint;
+namespace fs = boost::filesystem;
+
+TEST(Unit_OutputBuffer, StringCollectsOutput) {
+  StringOutputBuffer Buffer(4);
+  std::ostream Out(&Buffer);
+  Out << "mov" << ' ' << 42 << '\n';
+  Out << std::string(100, 'x');
+  EXPECT_EQ(Buffer.take(), "mov 42\n" + std::string(100, 'x'));
+
+  // The buffer starts over empty after take().
+  Out << "nop";
+  EXPECT_EQ(Buffer.take(), "nop");
+  EXPECT_EQ(Buffer.take(), "");
+}
+
+TEST(Unit_OutputBuffer, StringKeepsBufferedOutputWhenGrowing) {
+  StringOutputBuffer Buffer(8);
+  std::ostream Out(&Buffer);
+  Out << "abc";
+  ASSERT_TRUE(Buffer.reserve(1 << 16));
+  Out << "def";
+  EXPECT_EQ(Buffer.take(), "abcdef");
+}
+
+TEST(Unit_OutputBuffer, CallbackReceivesBlocksInOrder) {
+  std::vector<std::string> Blocks;
+  CallbackOutputBuffer Buffer(
+      [&](const char* Data, size_t Size) {
+        Blocks.emplace_back(Data, Size);
+        return true;
+      },
+      16);
+  std::ostream Out(&Buffer);
+  std::string Expected;
+  for (int I = 0; I < 100; ++I) {
+    std::string Line = "line " + std::to_string(I) + "\n";
+    Out << Line;
+    Expected += Line;
+  }
+  // A block larger than the buffer is delivered without being copied.
+  std::string Large(64, 'y');
+  Out << Large;
+  Expected += Large;
+  ASSERT_TRUE(Buffer.close());
+
+  std::string Actual;
+  for (const std::string& Block : Blocks) {
+    EXPECT_LE(Block.size(), Large.size());
+    Actual += Block;
+  }
+  EXPECT_EQ(Actual, Expected);
+  EXPECT_GT(Blocks.size(), 1u);
+}
+
+TEST(Unit_OutputBuffer, CallbackFailureStopsOutput) {
+  int Calls = 0;
+  CallbackOutputBuffer Buffer(
+      [&](const char*, size_t) {
+        ++Calls;
+        return false;
+      },
+      4);
+  std::ostream Out(&Buffer);
+  Out << "first block" << "second block";
+  EXPECT_FALSE(Buffer.close());
+  EXPECT_EQ(Calls, 1);
+}
+
+TEST(Unit_OutputBuffer, AsyncFileWritesAllSlots) {
+  fs::path Path =
+      fs::temp_directory_path() / fs::unique_path("%%%%-%%%%-%%%%.s");
+  auto Buffer = AsyncFileOutputBuffer::open(Path.string(), 16, 2);
+  ASSERT_TRUE(Buffer);
+  std::string Expected;
+  {
+    std::ostream Out(Buffer.get());
+    for (int I = 0; I < 1000; ++I) {
+      std::string Line = "line " + std::to_string(I) + "\n";
+      Out << Line;
+      Expected += Line;
+    }
+  }
+  EXPECT_TRUE(Buffer->close());
+  std::ifstream In(Path.string(), std::ios::binary);
+  std::string Written{std::istreambuf_iterator<char>(In),
+                      std::istreambuf_iterator<char>()};
+  EXPECT_EQ(Written, Expected);
+  fs::remove(Path);
+}
+
+#if !defined(_MSC_VER)
+// An output area larger than INT_MAX, backed by untouched address space.
+class LargeAreaBuffer : public OutputBuffer {
+public:
+  explicit LargeAreaBuffer(size_t Size_) : OutputBuffer(1), Size(Size_) {
+    void* Mapped = mmap(nullptr, Size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    Area = Mapped == MAP_FAILED ? nullptr : static_cast<char*>(Mapped);
+    if (Area) {
+      setArea(Area, Size);
+    }
+  }
+  ~LargeAreaBuffer() override {
+    if (Area) {
+      munmap(Area, Size);
+    }
+  }
+
+  bool mapped() const { return Area != nullptr; }
+  void skip(size_t Count) { advance(Count); }
+
+protected:
+  bool drain(const char*, size_t) override { return true; }
+
+private:
+  char* Area;
+  size_t Size;
+};
+
+TEST(Unit_OutputBuffer, AdvancesPastIntMax) {
+  const size_t Size = size_t(3) << 30;
+  LargeAreaBuffer Buffer(Size);
+  if (!Buffer.mapped()) {
+    GTEST_SKIP() << "could not reserve 3 GiB of address space";
+  }
+  Buffer.skip(Size - 1);
+  EXPECT_EQ(Buffer.size(), Size - 1);
+  EXPECT_EQ(Buffer.capacity(), Size);
+}
+#endif
@@ -0,0 +1,97 @@
+//===- PreparedModuleTest.cpp -----------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "PrettyPrinter.hpp"
+
+#include <gtest/gtest.h>
+#include <gtirb/gtirb.hpp>
+#include <sstream>
+#include <string>
+
+using namespace gtirb;
+
+class Unit_PreparedModule : public ::testing::Test {
+protected:
+  void SetUp() override {
+    Ir = IR::Create(Ctx);
+    M = Ir->addModule(Ctx, "test");
+    M->setISA(ISA::X64);
+    M->setFileFormat(FileFormat::ELF);
+    Section* S = M->addSection(Ctx, ".data");
+    ByteInterval* BI = S->addByteInterval(Ctx, Addr(0x1000), 16, 16);
+    for (uint64_t Offset = 0; Offset < 16; Offset += 4) {
+      Blocks.push_back(BI->addBlock<DataBlock>(Ctx, Offset, 4));
+    }
+    M->addSymbol(Ctx, Blocks[0], "foo");
+    M->addSymbol(Ctx, Blocks[1], "foo");
+    Printer.setTarget(std::make_tuple("elf", "x64", "att"));
+  }
+
+  std::string print(gtirb_pprint::PreparedModule& Prepared) {
+    std::ostringstream Out;
+    EXPECT_FALSE(Printer.print(Out, Prepared));
+    return Out.str();
+  }
+
+  Context Ctx;
+  IR* Ir;
+  Module* M;
+  std::vector<DataBlock*> Blocks;
+  gtirb_pprint::PrettyPrinter Printer;
+};
+
+TEST_F(Unit_PreparedModule, RepeatedPrintsAreIdentical) {
+  gtirb_pprint::PreparedModule Prepared(Ctx, *M);
+  std::string First = print(Prepared);
+  EXPECT_NE(First.find("foo_disambig_0"), std::string::npos);
+  EXPECT_NE(First.find("foo_disambig_1"), std::string::npos);
+  EXPECT_EQ(print(Prepared), First);
+
+  std::ostringstream Unprepared;
+  EXPECT_FALSE(Printer.print(Unprepared, Ctx, *M));
+  EXPECT_EQ(Unprepared.str(), First);
+}
+
+TEST_F(Unit_PreparedModule, SeesAddedSymbols) {
+  gtirb_pprint::PreparedModule Prepared(Ctx, *M);
+  print(Prepared);
+
+  // A third symbol sharing the ambiguous name, and a symbol at a block that
+  // already had its symbols looked up.
+  M->addSymbol(Ctx, Blocks[2], "foo");
+  M->addSymbol(Ctx, Blocks[1], "bar");
+  std::string Second = print(Prepared);
+  EXPECT_NE(Second.find("foo_disambig_2"), std::string::npos);
+  EXPECT_NE(Second.find("bar"), std::string::npos);
+
+  std::ostringstream Unprepared;
+  EXPECT_FALSE(Printer.print(Unprepared, Ctx, *M));
+  EXPECT_EQ(Unprepared.str(), Second);
+}
+
+TEST_F(Unit_PreparedModule, SeesRenamedSymbols) {
+  Symbol* Baz = M->addSymbol(Ctx, Blocks[3], "baz");
+  gtirb_pprint::PreparedModule Prepared(Ctx, *M);
+  print(Prepared);
+
+  // The number of symbols does not change.
+  Baz->setName("foo");
+  std::string Second = print(Prepared);
+  EXPECT_NE(Second.find("foo_disambig_2"), std::string::npos);
+  EXPECT_EQ(Second.find("baz"), std::string::npos);
+
+  std::ostringstream Unprepared;
+  EXPECT_FALSE(Printer.print(Unprepared, Ctx, *M));
+  EXPECT_EQ(Unprepared.str(), Second);
+}
@@ -0,0 +1,103 @@
+//===- SymbolNameTest.cpp ---------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "PrettyPrinter.hpp"
+
+#include <gtest/gtest.h>
+#include <gtirb/gtirb.hpp>
+#include <sstream>
+#include <string>
+
+using namespace gtirb;
+
+class Unit_SymbolName : public ::testing::Test {
+protected:
+  void SetUp() override {
+    Ir = IR::Create(Ctx);
+    M = Ir->addModule(Ctx, "test");
+    M->setISA(ISA::X64);
+    M->setFileFormat(FileFormat::ELF);
+    Section* S = M->addSection(Ctx, ".data");
+    ByteInterval* BI = S->addByteInterval(Ctx, Addr(0x1000), 16, 16);
+    for (uint64_t Offset = 0; Offset < 16; Offset += 4) {
+      Blocks.push_back(BI->addBlock<DataBlock>(Ctx, Offset, 4));
+    }
+    Printer.setTarget(std::make_tuple("elf", "x64", "att"));
+  }
+
+  std::string print() {
+    std::ostringstream Out;
+    EXPECT_FALSE(Printer.print(Out, Ctx, *M));
+    return Out.str();
+  }
+
+  // The position of a label in the output, or npos.
+  static size_t label(const std::string& Text, const std::string& Name) {
+    return Text.find("\n" + Name + ":\n");
+  }
+
+  // The number of labels with a name in the output.
+  static int labels(const std::string& Text, const std::string& Name) {
+    int Count = 0;
+    for (size_t Pos = label(Text, Name); Pos != std::string::npos;
+         Pos = Text.find("\n" + Name + ":\n", Pos + 1)) {
+      ++Count;
+    }
+    return Count;
+  }
+
+  Context Ctx;
+  IR* Ir;
+  Module* M;
+  std::vector<DataBlock*> Blocks;
+  gtirb_pprint::PrettyPrinter Printer;
+};
+
+TEST_F(Unit_SymbolName, NumberedByAddress) {
+  // Add the symbols out of address order: the numbers follow the addresses.
+  M->addSymbol(Ctx, Blocks[2], "foo");
+  M->addSymbol(Ctx, Blocks[0], "foo");
+  M->addSymbol(Ctx, Blocks[3], "foo");
+  M->addSymbol(Ctx, Blocks[1], "foo");
+  std::string Text = print();
+
+  size_t Previous = 0;
+  for (int N = 0; N < 4; ++N) {
+    size_t Position = label(Text, "foo_disambig_" + std::to_string(N));
+    ASSERT_NE(Position, std::string::npos) << N;
+    EXPECT_GT(Position, Previous) << N;
+    Previous = Position;
+  }
+}
+
+TEST_F(Unit_SymbolName, SkipsNamesOfOtherSymbols) {
+  M->addSymbol(Ctx, Blocks[0], "foo");
+  M->addSymbol(Ctx, Blocks[1], "foo");
+  M->addSymbol(Ctx, Blocks[2], "foo_d0");
+  M->addSymbol(Ctx, Blocks[3], "foo_disambig_1");
+
+  Printer.setEmissionProfile(gtirb_pprint::Machine);
+  std::string Text = print();
+  EXPECT_EQ(labels(Text, "foo_d0"), 1);
+  EXPECT_EQ(labels(Text, "foo_d1"), 0);
+  EXPECT_EQ(labels(Text, "foo_d2"), 1);
+  EXPECT_EQ(labels(Text, "foo_d3"), 1);
+
+  Printer.setEmissionProfile(gtirb_pprint::HumanReadable);
+  Text = print();
+  EXPECT_EQ(labels(Text, "foo_disambig_0"), 0);
+  EXPECT_EQ(labels(Text, "foo_disambig_1"), 1);
+  EXPECT_EQ(labels(Text, "foo_disambig_2"), 1);
+  EXPECT_EQ(labels(Text, "foo_disambig_3"), 1);
+}
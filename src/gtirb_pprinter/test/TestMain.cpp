@@ -0,0 +1,27 @@
+//===- TestMain.cpp ---------------------------------------------*- C++ -*-===//
+//
+//  Copyright (C) 2021 GrammaTech, Inc.
+//
+//  This code is licensed under the MIT license. See the LICENSE file in the
+//  project root for license terms.
+//
+//  This project is sponsored by the Office of Naval Research, One Liberty
+//  Center, 875 N. Randolph Street, Arlington, VA 22203 under contract #
+//  N68335-17-C-0700.  The content of the information does not necessarily
+//  reflect the position or policy of the Government and no official
+//  endorsement should be inferred.
+//
+//===----------------------------------------------------------------------===//
+#include "PrettyPrinter.hpp"
+
+#include <gtest/gtest.h>
+#include <gtirb_layout/gtirb_layout.hpp>
+
+int main(int argc, char** argv) {
+  gtirb_layout::registerAuxDataTypes();
+  gtirb_pprint::registerAuxDataTypes();
+  gtirb_pprint::registerPrettyPrinters();
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
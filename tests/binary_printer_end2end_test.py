@@ -2,6 +2,7 @@ import unittest
 from pathlib import Path
 import os
 import shutil
+import string
 import subprocess
 import sys
 import tempfile
@@ -57,6 +58,175 @@ class TestBinaryGeneration(unittest.TestCase):
         finally:
             shutil.rmtree("/tmp/two_mods")
 
+    def build_and_run(self, *args):
+        """Print two_modules.gtirb to a binary with the given extra options
+        of gtirb-pprinter, and return what the binary prints."""
+        with tempfile.TemporaryDirectory() as tmpdir:
+            binary = os.path.join(tmpdir, "a.out")
+            subprocess.check_output(
+                [
+                    "gtirb-pprinter",
+                    "--ir",
+                    str(two_modules_gtirb),
+                    "--binary",
+                    binary,
+                ]
+                + list(args)
+            ).decode(sys.stdout.encoding)
+            return subprocess.check_output(binary).decode(sys.stdout.encoding)
+
+    def test_binary_shards(self):
+        if os.name == "nt":
+            return
+
+        output_bin = self.build_and_run("--shards", "4", "-j", "4")
+        self.assertTrue("!!!Hello World!!!" in output_bin)
+
+    def test_binary_pipe_sources(self):
+        if os.name == "nt":
+            return
+
+        output_bin = self.build_and_run("--pipe-sources")
+        self.assertTrue("!!!Hello World!!!" in output_bin)
+
+        # Each job pipes its module into an assembler of its own, which must
+        # not inherit the pipe of the other job.
+        output_bin = self.build_and_run("--pipe-sources", "-j", "2")
+        self.assertTrue("!!!Hello World!!!" in output_bin)
+
+    def test_binary_jobs(self):
+        if os.name == "nt":
+            return
+
+        # One job prints all of the modules for a single compiler run, while
+        # several jobs assemble each module on its own before linking.
+        serial = self.build_and_run("-j", "1")
+        parallel = self.build_and_run("-j", "0")
+        self.assertTrue("!!!Hello World!!!" in serial)
+        self.assertEqual(serial, parallel)
+
+    def read_object(self, obj):
+        """Return the contents of the sections of code and data of an object,
+        and the sections, offsets and types of its relocations."""
+        contents = subprocess.check_output(
+            ["readelf", "-x", ".text", "-x", ".data", "-x", ".rodata", obj],
+            stderr=subprocess.DEVNULL,
+        ).decode(sys.stdout.encoding)
+        relocations = []
+        output = subprocess.check_output(["readelf", "-rW", obj]).decode(
+            sys.stdout.encoding
+        )
+        section = None
+        for line in output.splitlines():
+            fields = line.split()
+            if line.startswith("Relocation section"):
+                section = fields[2]
+            elif len(fields) >= 3 and all(
+                c in string.hexdigits for c in fields[0]
+            ):
+                relocations.append((section, fields[0], fields[2]))
+        return contents, sorted(relocations)
+
+    def test_direct_objects(self):
+        if os.name == "nt":
+            return
+        try:
+            import gtirb
+        except ImportError:
+            self.skipTest("the gtirb Python package is not installed")
+
+        # Modules with call frame information are assembled, so the objects
+        # are written from a copy of the IR without it, and match the ones
+        # the assembler makes out of the printed assembly.
+        with tempfile.TemporaryDirectory() as tmpdir:
+            ir_path = os.path.join(tmpdir, "two_modules.gtirb")
+            ir = gtirb.IR.load_protobuf(str(two_modules_gtirb))
+            for module in ir.modules:
+                module.aux_data.pop("cfiDirectives", None)
+            ir.save_protobuf(ir_path)
+
+            objects = {}
+            for kind, args in (
+                ("assembled", []),
+                ("direct", ["--direct-objects"]),
+            ):
+                os.mkdir(os.path.join(tmpdir, kind))
+                output = subprocess.check_output(
+                    [
+                        "gtirb-pprinter",
+                        "--ir",
+                        ir_path,
+                        "--binaries",
+                        os.path.join(tmpdir, kind, "two_modules.o"),
+                    ]
+                    + args
+                ).decode(sys.stdout.encoding)
+                written = "Wrote 2 objects directly from the IR" in output
+                self.assertEqual(written, kind == "direct")
+                objects[kind] = sorted(os.listdir(os.path.join(tmpdir, kind)))
+            self.assertEqual(objects["assembled"], objects["direct"])
+            for obj in objects["assembled"]:
+                self.assertEqual(
+                    self.read_object(os.path.join(tmpdir, "assembled", obj)),
+                    self.read_object(os.path.join(tmpdir, "direct", obj)),
+                )
+
+        # The modules of the original IR fall back to the assembler.
+        output_bin = self.build_and_run("--direct-objects")
+        self.assertTrue("!!!Hello World!!!" in output_bin)
+
+    def test_patch(self):
+        if os.name == "nt":
+            return
+        if shutil.which("ddisasm") is None:
+            self.skipTest("ddisasm is not installed")
+        try:
+            import gtirb
+        except ImportError:
+            self.skipTest("the gtirb Python package is not installed")
+
+        with tempfile.TemporaryDirectory() as tmpdir:
+            source = os.path.join(tmpdir, "hello.c")
+            original = os.path.join(tmpdir, "hello")
+            ir_path = os.path.join(tmpdir, "hello.gtirb")
+            patched = os.path.join(tmpdir, "patched")
+            with open(source, "w") as f:
+                f.write(
+                    "#include <stdio.h>\n"
+                    'int main(void) { puts("Hello, world"); return 0; }\n'
+                )
+            subprocess.check_output(["gcc", source, "-o", original])
+            subprocess.check_output(["ddisasm", original, "--ir", ir_path])
+
+            # Change a byte of the string, which keeps the layout.
+            ir = gtirb.IR.load_protobuf(ir_path)
+            changed = False
+            for interval in ir.modules[0].byte_intervals:
+                at = interval.contents.find(b"Hello, world")
+                if at >= 0:
+                    contents = bytearray(interval.contents)
+                    contents[at] = ord("J")
+                    interval.contents = bytes(contents)
+                    changed = True
+            self.assertTrue(changed)
+            ir.save_protobuf(ir_path)
+
+            output = subprocess.check_output(
+                [
+                    "gtirb-pprinter",
+                    "--ir",
+                    ir_path,
+                    "--binary",
+                    patched,
+                    "--patch",
+                ]
+            ).decode(sys.stdout.encoding)
+            self.assertTrue("Patched 1 bytes" in output)
+            output_bin = subprocess.check_output(patched).decode(
+                sys.stdout.encoding
+            )
+            self.assertTrue("Jello, world" in output_bin)
+
     def test_keep_function(self):
         tmp = tempfile.NamedTemporaryFile(suffix=".s")
         try:
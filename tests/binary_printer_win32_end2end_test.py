@@ -1,6 +1,7 @@
 import unittest
 from pathlib import Path
 import os
+import shutil
 import subprocess
 import sys
 import tempfile
@@ -24,3 +25,28 @@ class TestBinaryGeneration(unittest.TestCase):
         ).decode(sys.stdout.encoding)
         output = subprocess.check_output(out_path).decode(sys.stdout.encoding)
         self.assertTrue("Test resource string" in output)
+
+    def test_direct_objects(self):
+        if shutil.which("llvm-objdump") is None:
+            self.skipTest("llvm-objdump is not installed")
+
+        # The object is written from the IR, without ml64, on any system.
+        with tempfile.TemporaryDirectory() as base_path:
+            out_path = os.path.join(base_path, "ConsoleApplication1.obj")
+            subprocess.check_output(
+                [
+                    "gtirb-pprinter",
+                    "--ir",
+                    str(pe32plus_gtirb),
+                    "--binaries",
+                    out_path,
+                    "--direct-objects",
+                ]
+            ).decode(sys.stdout.encoding)
+            output = subprocess.check_output(
+                ["llvm-objdump", "-h", "-r", out_path]
+            ).decode(sys.stdout.encoding)
+        self.assertTrue("coff-x86-64" in output)
+        self.assertTrue(".drectve" in output)
+        for relocation in ("REL32", "ADDR64", "ADDR32NB"):
+            self.assertTrue("IMAGE_REL_AMD64_" + relocation in output)
@@ -42,6 +42,29 @@ class TestPrintToFile(unittest.TestCase):
             self.assertTrue(".globl fun" in f.read())
 
 
+class TestDeterministicOutput(unittest.TestCase):
+    def test_repeated_prints_are_identical(self):
+        for ir, syntax in (
+            (two_modules_gtirb, "intel"),
+            (two_modules_gtirb, "att"),
+            (Path("tests", "ConsoleApplication1.exe.gtirb"), "masm"),
+        ):
+            with self.subTest(ir=str(ir), syntax=syntax):
+                outputs = [
+                    subprocess.check_output(
+                        [
+                            "gtirb-pprinter",
+                            "--ir",
+                            str(ir),
+                            "--syntax",
+                            syntax,
+                        ]
+                    )
+                    for _ in range(2)
+                ]
+                self.assertEqual(outputs[0], outputs[1])
+
+
 class TestPrettyPrinter(unittest.TestCase):
     def test_avx512_att(self):
         # This test ensures that we do not regress on the following issue: